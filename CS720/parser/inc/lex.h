@@ -11,5 +11,8 @@ typedef struct lex_t lex_t;
 lex_t *lex_initialize(FILE *stream);
 void lex_uninitialize(lex_t *lex);
 status_t lex_get_next_token(lex_t *lex, tok_t **tok);
+//Every token handed out so far can be reused for the next ones
+void lex_release_tokens(lex_t *lex);
+const char *lex_get_source(lex_t *lex);
 
 #endif
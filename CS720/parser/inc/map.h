@@ -1 +0,0 @@
-/home/austin/CS/Personal/map_t/map.h
\ No newline at end of file
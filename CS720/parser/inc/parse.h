@@ -1,6 +1,12 @@
 #ifndef _PARSE_H_
 #define _PARSE_H_
 
+#include <stddef.h>
+
+#include "lex.h"
+#include "status.h"
+#include "tok.h"
+
 /*
 GRAMMAR:
 	<prog>                   -> <line> { <prog> }
@@ -91,4 +97,58 @@ TOKENS:
 	JGE      -> jge
 */
 
+/*
+	A parsed program is one array of fixed-size instructions, in the order they
+	appear. Nothing in it points back into the source, so it can outlive the
+	lexer it was parsed from.
+ */
+typedef enum
+{
+	ARG_NONE = 0,
+	ARG_REGISTER,
+	ARG_MEMORY,
+	ARG_LITERAL,
+} arg_kind_t;
+
+/*
+	One <arg_inner>: a register, the memory a register points to, or a
+	literal
+ */
+typedef struct
+{
+	unsigned char kind;
+	unsigned char reg;
+	unsigned short literal;
+} arg_part_t;
+
+/*
+	An <arg>. The second part is ARG_NONE unless the two were added together.
+ */
+typedef struct
+{
+	arg_part_t parts[2];
+} arg_t;
+
+typedef struct
+{
+	tok_type_t op;
+	/*
+		For a jump, the index of the instruction it goes to
+	 */
+	unsigned int target;
+	/*
+		As many as op takes, in the order they were written; the rest are
+		ARG_NONE
+	 */
+	arg_t args[2];
+} instr_t;
+
+typedef struct program_t program_t;
+
+status_t parse_program(lex_t *lex, program_t **program);
+void program_uninitialize(program_t *program);
+size_t program_get_length(program_t *program);
+instr_t *program_get_instructions(program_t *program);
+void program_print(program_t *program);
+
 #endif
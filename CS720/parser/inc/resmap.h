@@ -1,10 +0,0 @@
-#ifndef _RESMAP_H_
-#define _RESMAP_H_
-
-#include "map.h"
-#include "string_t.h"
-#include "lex.h"
-
-MAKE_MAP_H(resmap, string_t *, tok_type_t)
-
-#endif
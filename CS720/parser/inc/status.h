@@ -8,6 +8,10 @@ typedef enum
 	UNEXPECTED_CHAR,
 	CMD_ARGS,
 	FILE_OPEN_ERROR,
+	FILE_READ_ERROR,
+	SYNTAX_ERROR,
+	DUPLICATE_LABEL,
+	UNDEFINED_LABEL,
 } status_t;
 
 #endif
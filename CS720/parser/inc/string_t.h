@@ -1 +0,0 @@
-/home/austin/CS/Personal/string_t/v2/inc/string_t.h
\ No newline at end of file
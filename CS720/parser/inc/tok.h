@@ -1,7 +1,7 @@
 #ifndef _TOK_H_
 #define _TOK_H_
 
-#include "string_t.h"
+#include <stddef.h>
 
 typedef enum
 {
@@ -47,6 +47,7 @@ typedef enum
 	MOV,
 	AND,
 	OR,
+	NOT,
 	XOR,
 	CMP,
 	JEQ,
@@ -57,11 +58,25 @@ typedef enum
 } tok_type_t;
 
 typedef struct tok_t tok_t;
-tok_t *tok_initialize(void);
-void tok_uninitialize(tok_t *tok);
+
+/*
+	Tokens come from an arena, in blocks, and all go away together when the
+	arena does or is reset. Resetting keeps one block to hand out the next
+	tokens from, so a caller that's done with every token it has can keep
+	memory to a block however long the source is. A token's value isn't
+	copied anywhere; it's where the token's text starts in the source and
+	how long it is.
+ */
+typedef struct tok_arena_t tok_arena_t;
+tok_arena_t *tok_arena_initialize(void);
+void tok_arena_uninitialize(tok_arena_t *arena);
+void tok_arena_reset(tok_arena_t *arena);
+
+tok_t *tok_initialize(tok_arena_t *arena);
 tok_type_t tok_get_type(tok_t *tok);
 void tok_set_type(tok_t *tok, tok_type_t type);
-string_t *tok_get_value(tok_t *tok);
-void tok_value_append(tok_t *tok, char c);
-void tok_print(tok_t *tok);
+size_t tok_get_offset(tok_t *tok);
+size_t tok_get_length(tok_t *tok);
+void tok_set_value(tok_t *tok, size_t offset, size_t length);
+void tok_print(tok_t *tok, const char *source);
 #endif
@@ -1 +0,0 @@
-/home/austin/CS/Personal/vector_t/v2/inc/vector.h
\ No newline at end of file
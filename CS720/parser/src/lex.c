@@ -1,90 +1,111 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <ctype.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "lex.h"
 
-#include "resmap.h"
-#include "string.h"
 #include "tok.h"
 
+//How much more of the stream is read at a time, when its size isn't known
+//up front
+#define READ_BLOCK_SIZE (64 * 1024)
+
 struct lex_t
 {
-	FILE *stream;
+	//The whole source, followed by a '\0' so that every scan stops at the
+	//end without checking where it is. A '\0' before end is just an
+	//unexpected character.
+	char *buffer;
+	char *end;
+	char *cur;
 	char next;
-	resmap_t *reserved;
+	//Every token this lexer has made, freed along with it
+	tok_arena_t *toks;
+};
+
+//Character classes, as bits in char_classes
+#define CLASS_SPACE       0x01 //Whitespace other than a newline
+#define CLASS_IDENT_START 0x02
+#define CLASS_IDENT       0x04
+#define CLASS_DIGIT       0x08
+#define CLASS_HEXI_DIGIT  0x10
+#define CLASS_SEPARATOR   0x20 //Can follow a literal or an identifier-like token
+
+static const unsigned char char_classes[256] =
+{
+	['\t'] = CLASS_SPACE | CLASS_SEPARATOR,
+	['\v'] = CLASS_SPACE | CLASS_SEPARATOR,
+	['\f'] = CLASS_SPACE | CLASS_SEPARATOR,
+	['\r'] = CLASS_SPACE | CLASS_SEPARATOR,
+	[' ']  = CLASS_SPACE | CLASS_SEPARATOR,
+	['\n'] = CLASS_SEPARATOR,
+	[';']  = CLASS_SEPARATOR,
+	[':']  = CLASS_SEPARATOR,
+	[',']  = CLASS_SEPARATOR,
+	[')']  = CLASS_SEPARATOR,
+	['+']  = CLASS_SEPARATOR,
+	['0' ... '9'] = CLASS_IDENT | CLASS_DIGIT | CLASS_HEXI_DIGIT,
+	['A' ... 'F'] = CLASS_IDENT_START | CLASS_IDENT | CLASS_HEXI_DIGIT,
+	['G' ... 'Z'] = CLASS_IDENT_START | CLASS_IDENT,
+	['a' ... 'z'] = CLASS_IDENT_START | CLASS_IDENT,
+	['_']  = CLASS_IDENT_START | CLASS_IDENT,
+};
+
+//What the first character of a token says it is. Anything not listed can't
+//start one.
+typedef enum
+{
+	START_UNEXPECTED = 0,
+	START_END,
+	START_NEWLINE,
+	START_PUNCTUATION,
+	START_HEXI,
+	START_DECI,
+	START_IDENT,
+} start_state_t;
+
+static const unsigned char start_states[256] =
+{
+	['\0'] = START_END,
+	['\n'] = START_NEWLINE,
+	['(']  = START_PUNCTUATION,
+	[')']  = START_PUNCTUATION,
+	[':']  = START_PUNCTUATION,
+	[',']  = START_PUNCTUATION,
+	['+']  = START_PUNCTUATION,
+	['#']  = START_HEXI,
+	['$']  = START_DECI,
+	['A' ... 'Z'] = START_IDENT,
+	['a' ... 'z'] = START_IDENT,
+	['_']  = START_IDENT,
+};
+
+static const tok_type_t punctuation_types[256] =
+{
+	['('] = LPAREN,
+	[')'] = RPAREN,
+	[':'] = COLON,
+	[','] = COMMA,
+	['+'] = PLUS,
 };
 
-static unsigned short in_range(char c, char lo, char hi);
-static unsigned short is_hexi_digit(char c);
-static unsigned short is_register(string_t *reg);
+static unsigned short has_class(char c, unsigned char class);
+static tok_type_t classify_word(const char *s, size_t length);
+static status_t lex_read_source(lex_t *lex, FILE *stream);
 static void lex_get_character_tok(lex_t *lex, tok_t *tok, tok_type_t type);
 static unsigned short lex_is_next_separator(lex_t *lex);
+static char *lex_skip_comment(lex_t *lex, char *cur);
 static void lex_skip_insignificant(lex_t *lex);
+static void lex_skip_blank_lines(lex_t *lex);
 
 static void lex_get_eof(lex_t *lex, tok_t *tok);
 static void lex_get_newline(lex_t *lex, tok_t *tok);
-static void lex_get_lparen(lex_t *lex, tok_t *tok);
-static void lex_get_rparen(lex_t *lex, tok_t *tok);
-static void lex_get_colon(lex_t *lex, tok_t *tok);
-static void lex_get_comma(lex_t *lex, tok_t *tok);
-static void lex_get_plus(lex_t *lex, tok_t *tok);
+static void lex_get_punctuation(lex_t *lex, tok_t *tok);
 static status_t lex_get_hexi(lex_t *lex, tok_t *tok);
 static status_t lex_get_deci(lex_t *lex, tok_t *tok);
 static status_t lex_get_ident_like(lex_t *lex, tok_t *tok);
 
-static char *reserved_words[] =
-{
-	"nop",
-	"halt",
-	"clr",
-	"inc",
-	"dec",
-	"frm",
-	"dis",
-	"alm",
-	"add",
-	"sub",
-	"mul",
-	"div",
-	"mov",
-	"and",
-	"or",
-	"xor",
-	"cmp",
-	"jeq",
-	"jgt",
-	"jlt",
-	"jge",
-	"jle",
-};
-
-static const tok_type_t reserved_types[] =
-{
-	NOP,
-	HALT,
-	CLR,
-	INC,
-	DEC,
-	FRM,
-	DIS,
-	ALM,
-	ADD,
-	SUB,
-	MUL,
-	DIV,
-	MOV,
-	AND,
-	OR,
-	XOR,
-	CMP,
-	JEQ,
-	JGT,
-	JLT,
-	JGE,
-	JLE,
-};
-
 lex_t *lex_initialize(FILE *stream)
 {
 	lex_t *lex = malloc(sizeof *lex);
@@ -93,38 +114,25 @@ lex_t *lex_initialize(FILE *stream)
 		goto error0;
 	}
 
-	lex->stream = stream;
-	lex->reserved = resmap_initialize(64);
-	if (lex->reserved == NULL)
+	if (lex_read_source(lex, stream))
 	{
 		goto error1;
 	}
 
-	string_t *str = string_initialize();
-	if (str == NULL)
+	lex->toks = tok_arena_initialize();
+	if (lex->toks == NULL)
 	{
 		goto error2;
 	}
 
-	map_status_t error;
-	size_t i;
-	for (i = 0; i < sizeof(reserved_words) / sizeof(*reserved_words); i++)
-	{
-		string_assign_from_char_array(str, reserved_words[i]);
-		error = resmap_put(lex->reserved, str, reserved_types[i]);
-		if (error)
-		{
-			goto error3;
-		}
-	}
+	//Nothing before the first instruction or label makes a token, just as
+	//nothing between two lines does
+	lex_skip_blank_lines(lex);
 
-	string_uninitialize(str);
 	goto success;
 
-error3:
-	string_uninitialize(str);
 error2:
-	resmap_uninitialize(lex->reserved);
+	free(lex->buffer);
 error1:
 	free(lex);
 error0:
@@ -136,206 +144,291 @@ success:
 
 void lex_uninitialize(lex_t *lex)
 {
-	resmap_uninitialize(lex->reserved);
+	tok_arena_uninitialize(lex->toks);
+	free(lex->buffer);
 	free(lex);
 }
 
+void lex_release_tokens(lex_t *lex)
+{
+	tok_arena_reset(lex->toks);
+}
+
+const char *lex_get_source(lex_t *lex)
+{
+	return lex->buffer;
+}
+
 status_t lex_get_next_token(lex_t *lex, tok_t **tok)
 {
 	status_t error = SUCCESS;
 
-	*tok = tok_initialize();
+	*tok = tok_initialize(lex->toks);
 	if (*tok == NULL)
 	{
 		return OUT_OF_MEM;
 	}
 
-	//Start by getting the first character to be analyzed
-	lex->next = getc(lex->stream);
+	//Start by getting the first character to be analyzed. Its entry in
+	//start_states says which kind of token it begins
+	lex->next = *lex->cur;
 
-	if (lex->next == EOF)
-	{
-		lex_get_eof(lex, *tok);
-	}
-	else if (lex->next == '\n')
+	switch (start_states[(unsigned char) lex->next])
 	{
-		lex_get_newline(lex, *tok);
-	}
-	else if (lex->next == '(')
-	{
-		lex_get_lparen(lex, *tok);
-	}
-	else if (lex->next == ')')
-	{
-		lex_get_rparen(lex, *tok);
-	}
-	else if (lex->next == ':')
-	{
-		lex_get_colon(lex, *tok);
-	}
-	else if (lex->next == ',')
-	{
-		lex_get_comma(lex, *tok);
+		case START_END:
+			if (lex->cur == lex->end)
+			{
+				lex_get_eof(lex, *tok);
+				break;
+			}
+			error = UNEXPECTED_CHAR;
+			fprintf(stderr, "Unexpected character: %c\n", lex->next);
+			break;
+
+		case START_NEWLINE:
+			lex_get_newline(lex, *tok);
+			break;
+
+		case START_PUNCTUATION:
+			lex_get_punctuation(lex, *tok);
+			break;
+
+		case START_HEXI:
+			if ((error = lex_get_hexi(lex, *tok)))
+			{
+				fprintf(stderr, "Unexpected character in HEXI: %c. Must have form #WXYZ\n", lex->next);
+			}
+			break;
+
+		case START_DECI:
+			if ((error = lex_get_deci(lex, *tok)))
+			{
+				fprintf(stderr, "Unexpected character in DECI: %c. Must have form $VWXYZ\n", lex->next);
+			}
+			break;
+
+		case START_IDENT:
+			//Everything either IS an identifier or looks like one (registers and instructions),
+			//so "get it" as an identifer, but, in the function, it is checked against the keywords
+			//and against the possible registers. All of these must start with an alpha or a "_",
+			//which is what START_IDENT covers
+			if ((error = lex_get_ident_like(lex, *tok)))
+			{
+				fprintf(stderr, "Unexpected character in identifier-like token: %c\n", lex->next);
+			}
+			break;
+
+		default:
+			//If we matched nothing else, that means we've got an unexpected character here.
+			error = UNEXPECTED_CHAR;
+			fprintf(stderr, "Unexpected character: %c\n", lex->next);
+			break;
 	}
-	else if (lex->next == '+')
+
+	return error;
+}
+
+static unsigned short has_class(char c, unsigned char class)
+{
+	return (char_classes[(unsigned char) c] & class) != 0;
+}
+
+//Packs a three letter word into one value, so that the instructions can be
+//told apart by a single switch
+#define WORD3(a, b, c) \
+	(((unsigned long) (unsigned char) (a) << 16) | ((unsigned long) (unsigned char) (b) << 8) | \
+	 (unsigned long) (unsigned char) (c))
+
+//Says whether the word s is a register, an instruction, or just an
+//identifier. Every reserved word is two to four letters long, so the
+//length rules out most identifiers before any of their characters are read.
+static tok_type_t classify_word(const char *s, size_t length)
+{
+	switch (length)
 	{
-		lex_get_plus(lex, *tok);
+		case 2:
+			if (s[0] == 'R' && s[1] >= '0' && s[1] <= '7')
+			{
+				return REGISTER;
+			}
+			if (s[0] == 'o' && s[1] == 'r')
+			{
+				return OR;
+			}
+			break;
+
+		case 3:
+			switch (WORD3(s[0], s[1], s[2]))
+			{
+				case WORD3('n', 'o', 'p'): return NOP;
+				case WORD3('c', 'l', 'r'): return CLR;
+				case WORD3('i', 'n', 'c'): return INC;
+				case WORD3('d', 'e', 'c'): return DEC;
+				case WORD3('f', 'r', 'm'): return FRM;
+				case WORD3('d', 'i', 's'): return DIS;
+				case WORD3('a', 'l', 'm'): return ALM;
+				case WORD3('a', 'd', 'd'): return ADD;
+				case WORD3('s', 'u', 'b'): return SUB;
+				case WORD3('m', 'u', 'l'): return MUL;
+				case WORD3('d', 'i', 'v'): return DIV;
+				case WORD3('m', 'o', 'v'): return MOV;
+				case WORD3('n', 'o', 't'): return NOT;
+				case WORD3('a', 'n', 'd'): return AND;
+				case WORD3('x', 'o', 'r'): return XOR;
+				case WORD3('c', 'm', 'p'): return CMP;
+				case WORD3('j', 'e', 'q'): return JEQ;
+				case WORD3('j', 'g', 't'): return JGT;
+				case WORD3('j', 'l', 't'): return JLT;
+				case WORD3('j', 'g', 'e'): return JGE;
+				case WORD3('j', 'l', 'e'): return JLE;
+			}
+			break;
+
+		case 4:
+			if (s[0] == 'h' && s[1] == 'a' && s[2] == 'l' && s[3] == 't')
+			{
+				return HALT;
+			}
+			break;
 	}
-	else if (lex->next == '#')
+
+	return IDENT;
+}
+
+//Reads all of stream into lex's buffer, in one read when the stream is a
+//file whose size is known, and in large blocks otherwise. Only a buffer for a
+//stream of unknown size ever grows.
+static status_t lex_read_source(lex_t *lex, FILE *stream)
+{
+	size_t capacity = READ_BLOCK_SIZE;
+	unsigned short size_known = 0;
+	struct stat st;
+	if (fstat(fileno(stream), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
 	{
-		if ((error = lex_get_hexi(lex, *tok)))
-		{
-			fprintf(stderr, "Unexpected character in HEXI: %c. Must have form #WXYZ\n", lex->next);
-			tok_uninitialize(*tok);
-		}
+		capacity = st.st_size;
+		size_known = 1;
 	}
-	else if (lex->next == '$')
+
+	size_t length = 0;
+	//Room for the '\0' after it
+	char *buffer = malloc(capacity + 1);
+	if (buffer == NULL)
 	{
-		if ((error = lex_get_deci(lex, *tok)))
-		{
-			fprintf(stderr, "Unexpected character in DECI: %c. Must have form $VWXYZ\n", lex->next);
-			tok_uninitialize(*tok);
-		}
+		return OUT_OF_MEM;
 	}
-	else if (isalpha(lex->next) || (lex->next == '_'))
+
+	size_t n;
+	while ((n = fread(buffer + length, 1, capacity - length, stream)) > 0)
 	{
-		//Everything either IS an identifier or looks like one (registers and instructions),
-		//so "get it" as an identifer, but, in the function, it is checked against the keywords
-		//and against the possible registers. All of these must start with an alpha or a "_",
-		//so make sure before going into the function
-		if ((error = lex_get_ident_like(lex, *tok)))
+		length += n;
+		if (length == capacity)
 		{
-			fprintf(stderr, "Unexpected character in identifier-like token: %c\n", lex->next);
-			tok_uninitialize(*tok);
+			if (size_known)
+			{
+				break;
+			}
+
+			char *tmp = realloc(buffer, 2 * capacity + 1);
+			if (tmp == NULL)
+			{
+				free(buffer);
+				return OUT_OF_MEM;
+			}
+			buffer = tmp;
+			capacity *= 2;
 		}
 	}
-	else
+
+	if (ferror(stream))
 	{
-		//If we matched nothing else, that means we've got an unexpected character here.
-		error = UNEXPECTED_CHAR;
-		fprintf(stderr, "Unexpected character: %c\n", lex->next);
-		tok_uninitialize(*tok);
+		free(buffer);
+		return FILE_READ_ERROR;
 	}
 
-	return error;
-}
-
-static unsigned short in_range(char c, char lo, char hi)
-{
-	return c >= lo && c <= hi;
-}
-
-static unsigned short is_hexi_digit(char c)
-{
-	return isdigit(c) || in_range(c, 'A', 'F');
-}
-
-static unsigned short is_register(string_t *s)
-{
-	return string_length(s) == 2 &&
-		string_get(s, 0) == 'R' &&
-		in_range(string_get(s, 1), '0', '7');
+	buffer[length] = '\0';
+	lex->buffer = lex->cur = buffer;
+	lex->end = buffer + length;
+	return SUCCESS;
 }
 
 static void lex_get_character_tok(lex_t *lex, tok_t *tok, tok_type_t type)
 {
 	tok_set_type(tok, type);
-	tok_value_append(tok, lex->next);
+	tok_set_value(tok, lex->cur - lex->buffer, 1);
+	lex->cur++;
 }
 
+//The end of the source also ends a token, so that the last line doesn't
+//need a newline after it
 static unsigned short lex_is_next_separator(lex_t *lex)
 {
-	char next = getc(lex->stream);
-	unsigned short is_next_separator = isspace(next) || (next == ';') || (next == ':') || (next == ',') || (next == ')') || (next == '+');
-	ungetc(next, lex->stream);
-	return is_next_separator;
+	return lex->cur == lex->end || has_class(*lex->cur, CLASS_SEPARATOR);
+}
+
+//Returns where the comment starting at cur ends: its newline, or the end of
+//the source
+static char *lex_skip_comment(lex_t *lex, char *cur)
+{
+	char *newline = memchr(cur, '\n', lex->end - cur);
+	return newline != NULL ? newline : lex->end;
 }
 
 static void lex_skip_insignificant(lex_t *lex)
 {
 	//Whitespace that *isn't* newlines are insignificant. However, newlines are used to delineate
 	//instructions, so they are significant, and cannot be skipped
-	char next = getc(lex->stream);
-	while (isspace(next) && (next != '\n'))
+	char *cur = lex->cur;
+	while (has_class(*cur, CLASS_SPACE))
 	{
-		next = getc(lex->stream);
+		cur++;
 	}
 
-	//If we hit a comment while skipping over whitespace, then continue to the end of the line
-	if (next == ';')
+	//If we hit a comment while skipping over whitespace, then continue to the end of the line,
+	//leaving the newline for the next token
+	if (*cur == ';')
 	{
-		do
-		{
-			next = getc(lex->stream);
-		} while (next != '\n');
+		cur = lex_skip_comment(lex, cur);
 	}
 
-	// Will have end up getting one more character that is *not* a space/part of a comment,
-	// so put it back
-	ungetc(next, lex->stream);
+	lex->cur = cur;
 }
 
 static void lex_get_newline(lex_t *lex, tok_t *tok)
 {
 	lex_get_character_tok(lex, tok, NEWLINE);
+	lex_skip_blank_lines(lex);
+}
 
-	char next = getc(lex->stream);
-	unsigned short more_after_comment = 1;
-	while (more_after_comment)
+//Blank lines and lines holding only comments don't make tokens of their own
+static void lex_skip_blank_lines(lex_t *lex)
+{
+	char *cur = lex->cur;
+	for (;;)
 	{
-		while (isspace(next))
+		while (has_class(*cur, CLASS_SPACE) || *cur == '\n')
 		{
-			next = getc(lex->stream);
+			cur++;
 		}
 
-		if (next == ';')
-		{
-			do
-			{
-				next = getc(lex->stream);
-			} while (next != '\n');
-		}
-		else
+		if (*cur != ';')
 		{
-			more_after_comment = 0;
+			break;
 		}
+		cur = lex_skip_comment(lex, cur);
 	}
 
-	ungetc(next, lex->stream);
+	lex->cur = cur;
 }
 
 static void lex_get_eof(lex_t *lex, tok_t *tok)
 {
-	lex_get_character_tok(lex, tok, TOK_EOF);
-}
-
-static void lex_get_lparen(lex_t *lex, tok_t *tok)
-{
-	lex_get_character_tok(lex, tok, LPAREN);
-	lex_skip_insignificant(lex);
-}
-
-static void lex_get_rparen(lex_t *lex, tok_t *tok)
-{
-	lex_get_character_tok(lex, tok, RPAREN);
-	lex_skip_insignificant(lex);
+	tok_set_type(tok, TOK_EOF);
+	tok_set_value(tok, lex->end - lex->buffer, 0);
 }
 
-static void lex_get_colon(lex_t *lex, tok_t *tok)
+static void lex_get_punctuation(lex_t *lex, tok_t *tok)
 {
-	lex_get_character_tok(lex, tok, COLON);
-	lex_skip_insignificant(lex);
-}
-
-static void lex_get_comma(lex_t *lex, tok_t *tok)
-{
-	lex_get_character_tok(lex, tok, COMMA);
-	lex_skip_insignificant(lex);
-}
-
-static void lex_get_plus(lex_t *lex, tok_t *tok)
-{
-	lex_get_character_tok(lex, tok, PLUS);
+	lex_get_character_tok(lex, tok, punctuation_types[(unsigned char) lex->next]);
 	lex_skip_insignificant(lex);
 }
 
@@ -344,19 +437,20 @@ static status_t lex_get_hexi(lex_t *lex, tok_t *tok)
 	status_t error = SUCCESS;
 
 	tok_set_type(tok, HEXI);
+	//The value is the digits, without the '#'
+	tok_set_value(tok, lex->cur + 1 - lex->buffer, 4);
 
 	size_t i;
 	for (i = 0; i < 4; i++)
 	{
-		lex->next = getc(lex->stream);
-		if (!is_hexi_digit(lex->next))
+		lex->next = *++lex->cur;
+		if (!has_class(lex->next, CLASS_HEXI_DIGIT))
 		{
 			error = UNEXPECTED_CHAR;
 			goto exit0;
 		}
-
-		tok_value_append(tok, lex->next);
 	}
+	lex->cur++;
 
 	if (!lex_is_next_separator(lex))
 	{
@@ -374,22 +468,25 @@ static status_t lex_get_deci(lex_t *lex, tok_t *tok)
 {
 	status_t error = SUCCESS;
 	tok_set_type(tok, DECI);
+	//The value is the digits, without the '$'
+	tok_set_value(tok, lex->cur + 1 - lex->buffer, 5);
 
+	int d = 0;
 	size_t i;
 	for (i = 0; i < 5; i++)
 	{
-		lex->next = getc(lex->stream);
-		if (!isdigit(lex->next))
+		lex->next = *++lex->cur;
+		if (!has_class(lex->next, CLASS_DIGIT))
 		{
 			error = UNEXPECTED_CHAR;
 			goto exit0;
 		}
 
-		tok_value_append(tok, lex->next);
+		d = d * 10 + (lex->next - '0');
 	}
+	lex->cur++;
 
 	//Decimal values must be 16-bit. Enforce that here
-	int d = atoi(string_c_str(tok_get_value(tok)));
 	if (d >= (1 << 16))
 	{
 		error = UNEXPECTED_CHAR;
@@ -412,16 +509,14 @@ static status_t lex_get_ident_like(lex_t *lex, tok_t *tok)
 {
 	status_t error = SUCCESS;
 
-	tok_value_append(tok, lex->next);
-	lex->next = getc(lex->stream);
-
-	while (isalnum(lex->next) || lex->next == '_')
+	char *start = lex->cur;
+	do
 	{
-		tok_value_append(tok, lex->next);
-		lex->next = getc(lex->stream);
-	}
-	//Got one character that's not an alphanum or a '_', so put it back
-	ungetc(lex->next, lex->stream);
+		lex->next = *++lex->cur;
+	} while (has_class(lex->next, CLASS_IDENT));
+
+	size_t length = lex->cur - start;
+	tok_set_value(tok, start - lex->buffer, length);
 
 	if (!lex_is_next_separator(lex))
 	{
@@ -429,20 +524,9 @@ static status_t lex_get_ident_like(lex_t *lex, tok_t *tok)
 	}
 
 	//The registers and instructions look just like identifiers, so need
-	//to check the format for registers and the hash map for instructions.
-	//If we find a type associated with this identifier, then we use that.
-	//Otherwise, it's not a reserved word, so it's just an identifier
-	tok_type_t type;
-	if (is_register(tok_get_value(tok)))
-	{
-		type = REGISTER;
-	}
-	else if (resmap_get(lex->reserved, tok_get_value(tok), &type) != MAP_SUCCESS)
-	{
-		type = IDENT;
-	}
-
-	tok_set_type(tok, type);
+	//to check whether this is one of them. If it isn't, it's just an
+	//identifier.
+	tok_set_type(tok, classify_word(start, length));
 
 	lex_skip_insignificant(lex);
 
@@ -1,23 +1,31 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "lex.h"
+#include "parse.h"
 #include "status.h"
 #include "tok.h"
 
+static status_t dump_tokens(lex_t *lex);
+static status_t print_program(lex_t *lex);
+
+//With -t, the tokens are printed one per line instead of the parsed program
 int main(int argc, char *argv[])
 {
 	status_t error = SUCCESS;
-	if (argc != 2)
+	unsigned short tokens = argc == 3 && strcmp(argv[1], "-t") == 0;
+	if (argc != 2 + tokens)
 	{
-		fprintf(stderr, "Usage: %s file\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-t] file\n", argv[0]);
 		error = CMD_ARGS;
 		goto exit0;
 	}
 
-	FILE *stream = fopen(argv[1], "r");
+	const char *path = argv[1 + tokens];
+	FILE *stream = fopen(path, "r");
 	if (stream == NULL)
 	{
-		fprintf(stderr, "Could not open file %s\n", argv[1]);
+		fprintf(stderr, "Could not open file %s\n", path);
 		error = FILE_OPEN_ERROR;
 		goto exit0;
 	}
@@ -30,24 +38,40 @@ int main(int argc, char *argv[])
 		goto exit1;
 	}
 
+	error = tokens ? dump_tokens(lex) : print_program(lex);
+
+	lex_uninitialize(lex);
+exit1:
+	fclose(stream);
+exit0:
+	return error;
+}
+
+static status_t dump_tokens(lex_t *lex)
+{
+	status_t error;
+	const char *source = lex_get_source(lex);
+
 	tok_t *tok;
 	while (!(error = lex_get_next_token(lex, &tok)) && tok_get_type(tok) != TOK_EOF)
 	{
-		tok_print(tok);
-		tok_uninitialize(tok);
+		tok_print(tok, source);
+		lex_release_tokens(lex);
 	}
 
-	if (!error)
+	return error;
+}
+
+static status_t print_program(lex_t *lex)
+{
+	program_t *program;
+	status_t error = parse_program(lex, &program);
+	if (error)
 	{
-		tok_uninitialize(tok);
+		return error;
 	}
 
-	goto exit2;
-
-exit2:
-	lex_uninitialize(lex);
-exit1:
-	fclose(stream);
-exit0:
-	return error;
+	program_print(program);
+	program_uninitialize(program);
+	return SUCCESS;
 }
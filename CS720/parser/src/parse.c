@@ -0,0 +1,706 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse.h"
+
+#include "lex.h"
+#include "tok.h"
+
+//How many instructions and labels there's room for to begin with. Both
+//double whenever they fill up.
+#define INITIAL_INSTRUCTIONS 1024
+#define INITIAL_LABELS 64
+
+//Ends a chain of jumps waiting on a label, and marks a label that hasn't
+//been defined yet
+#define NO_TARGET ((unsigned int) -1)
+
+struct program_t
+{
+	instr_t *instrs;
+	size_t length;
+	size_t capacity;
+};
+
+/*
+	A label, found through the parser's open addressing table by its text.
+	Until it's defined, the jumps to it are chained together through their
+	target fields, starting from pending, and are all patched at once when it
+	is.
+ */
+typedef struct
+{
+	//Where the label's text is in the source; a length of 0 is an empty slot
+	size_t offset;
+	size_t length;
+	//Where it was first used, for reporting it if it's never defined
+	size_t used_at;
+	unsigned int index;
+	unsigned int pending;
+} label_t;
+
+typedef struct
+{
+	lex_t *lex;
+	const char *source;
+	//The next token, which hasn't been consumed yet. It's the only one that
+	//is kept; the lexer reuses the rest.
+	tok_t *tok;
+	program_t *program;
+	label_t *labels;
+	size_t label_count;
+	size_t label_capacity;
+} parser_t;
+
+static const char *mnemonics[] =
+{
+	[NOP]  = "nop",
+	[HALT] = "halt",
+	[FRM]  = "frm",
+	[DIS]  = "dis",
+	[CLR]  = "clr",
+	[INC]  = "inc",
+	[DEC]  = "dec",
+	[ALM]  = "alm",
+	[ADD]  = "add",
+	[SUB]  = "sub",
+	[MUL]  = "mul",
+	[DIV]  = "div",
+	[MOV]  = "mov",
+	[AND]  = "and",
+	[OR]   = "or",
+	[NOT]  = "not",
+	[XOR]  = "xor",
+	[CMP]  = "cmp",
+	[JEQ]  = "jeq",
+	[JGT]  = "jgt",
+	[JLT]  = "jlt",
+	[JLE]  = "jle",
+	[JGE]  = "jge",
+};
+
+static size_t line_of(const char *source, size_t offset);
+static size_t hash_text(const char *text, size_t length);
+static void print_arg(arg_t *arg);
+
+static status_t parse_advance(parser_t *parser);
+static status_t parse_expect(parser_t *parser, tok_type_t type, const char *what);
+static status_t parse_syntax_error(parser_t *parser, const char *what);
+static status_t parse_new_instruction(parser_t *parser, tok_type_t op, instr_t **instr);
+static status_t parse_grow_labels(parser_t *parser);
+static status_t parse_find_label(parser_t *parser, size_t offset, size_t length, label_t **label);
+static status_t parse_define_label(parser_t *parser, size_t offset, size_t length);
+static status_t parse_check_labels(parser_t *parser);
+
+static status_t parse_line(parser_t *parser);
+static status_t parse_instruction(parser_t *parser);
+static status_t parse_jump_target(parser_t *parser, size_t index);
+static status_t parse_dest_arg(parser_t *parser, arg_t *arg);
+static status_t parse_arg(parser_t *parser, arg_t *arg);
+static status_t parse_arg_inner(parser_t *parser, arg_part_t *part, unsigned short allow_literal);
+
+status_t parse_program(lex_t *lex, program_t **program)
+{
+	status_t error = SUCCESS;
+
+	parser_t parser;
+	parser.lex = lex;
+	parser.source = lex_get_source(lex);
+	parser.labels = NULL;
+	parser.label_count = 0;
+	parser.label_capacity = INITIAL_LABELS;
+
+	parser.program = malloc(sizeof *parser.program);
+	if (parser.program == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto error0;
+	}
+
+	parser.program->length = 0;
+	parser.program->capacity = INITIAL_INSTRUCTIONS;
+	parser.program->instrs = malloc(parser.program->capacity * sizeof *parser.program->instrs);
+	if (parser.program->instrs == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto error1;
+	}
+
+	parser.labels = calloc(parser.label_capacity, sizeof *parser.labels);
+	if (parser.labels == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto error2;
+	}
+
+	if ((error = parse_advance(&parser)))
+	{
+		goto error2;
+	}
+
+	while (tok_get_type(parser.tok) != TOK_EOF)
+	{
+		if ((error = parse_line(&parser)))
+		{
+			goto error2;
+		}
+	}
+
+	if ((error = parse_check_labels(&parser)))
+	{
+		goto error2;
+	}
+
+	goto success;
+
+error2:
+	free(parser.program->instrs);
+error1:
+	free(parser.program);
+error0:
+	parser.program = NULL;
+
+success:
+	//The labels have all been resolved into the program by now
+	free(parser.labels);
+	*program = parser.program;
+	return error;
+}
+
+void program_uninitialize(program_t *program)
+{
+	free(program->instrs);
+	free(program);
+}
+
+size_t program_get_length(program_t *program)
+{
+	return program->length;
+}
+
+instr_t *program_get_instructions(program_t *program)
+{
+	return program->instrs;
+}
+
+void program_print(program_t *program)
+{
+	size_t i;
+	for (i = 0; i < program->length; i++)
+	{
+		instr_t *instr = program->instrs + i;
+		printf("%zu\t%s", i, mnemonics[instr->op]);
+
+		if (instr->op >= JEQ)
+		{
+			printf(" %u", instr->target);
+		}
+		else if (instr->args[0].parts[0].kind != ARG_NONE)
+		{
+			printf(" ");
+			print_arg(&instr->args[0]);
+			if (instr->args[1].parts[0].kind != ARG_NONE)
+			{
+				printf(", ");
+				print_arg(&instr->args[1]);
+			}
+		}
+
+		printf("\n");
+	}
+}
+
+//Lines aren't counted while parsing, since the lexer folds blank ones away;
+//this is only needed once, for an error
+static size_t line_of(const char *source, size_t offset)
+{
+	size_t line = 1;
+	const char *cur = source;
+	const char *end = source + offset;
+	while ((cur = memchr(cur, '\n', end - cur)) != NULL)
+	{
+		line++;
+		cur++;
+	}
+
+	return line;
+}
+
+//FNV-1a
+static size_t hash_text(const char *text, size_t length)
+{
+	size_t hash_val = 2166136261u;
+	size_t i;
+	for (i = 0; i < length; i++)
+	{
+		hash_val = (hash_val ^ (unsigned char) text[i]) * 16777619u;
+	}
+
+	return hash_val;
+}
+
+static void print_arg(arg_t *arg)
+{
+	size_t i;
+	for (i = 0; i < 2 && arg->parts[i].kind != ARG_NONE; i++)
+	{
+		arg_part_t *part = arg->parts + i;
+		if (i > 0)
+		{
+			printf(" + ");
+		}
+
+		switch (part->kind)
+		{
+			case ARG_REGISTER:
+				printf("R%u", part->reg);
+				break;
+
+			case ARG_MEMORY:
+				printf("(R%u)", part->reg);
+				break;
+
+			case ARG_LITERAL:
+				printf("#%04X", part->literal);
+				break;
+		}
+	}
+}
+
+static status_t parse_advance(parser_t *parser)
+{
+	//Nothing looks back past the current token, so the tokens can be reused
+	//rather than kept for the whole source
+	lex_release_tokens(parser->lex);
+
+	//The lexer has already said what was wrong, if anything was
+	return lex_get_next_token(parser->lex, &parser->tok);
+}
+
+static status_t parse_expect(parser_t *parser, tok_type_t type, const char *what)
+{
+	if (tok_get_type(parser->tok) != type)
+	{
+		return parse_syntax_error(parser, what);
+	}
+
+	return parse_advance(parser);
+}
+
+static status_t parse_syntax_error(parser_t *parser, const char *what)
+{
+	tok_t *tok = parser->tok;
+	size_t offset = tok_get_offset(tok);
+	size_t length = tok_get_length(tok);
+	size_t line = line_of(parser->source, offset);
+
+	switch (tok_get_type(tok))
+	{
+		case TOK_EOF:
+			fprintf(stderr, "Line %zu: expected %s, found end of file\n", line, what);
+			break;
+
+		case NEWLINE:
+			fprintf(stderr, "Line %zu: expected %s, found end of line\n", line, what);
+			break;
+
+		case HEXI:
+		case DECI:
+			//A literal's value leaves out the '#' or '$' before it
+			offset--;
+			length++;
+			//Fall through
+		default:
+			fprintf(stderr, "Line %zu: expected %s, found %.*s\n", line, what,
+				(int) length, parser->source + offset);
+			break;
+	}
+
+	return SYNTAX_ERROR;
+}
+
+static status_t parse_new_instruction(parser_t *parser, tok_type_t op, instr_t **instr)
+{
+	program_t *program = parser->program;
+	if (program->length == program->capacity)
+	{
+		//Jump targets have to fit, and NO_TARGET can't be one of them
+		if (program->capacity >= NO_TARGET / 2)
+		{
+			return OUT_OF_MEM;
+		}
+
+		instr_t *tmp = realloc(program->instrs, 2 * program->capacity * sizeof *tmp);
+		if (tmp == NULL)
+		{
+			return OUT_OF_MEM;
+		}
+		program->instrs = tmp;
+		program->capacity *= 2;
+	}
+
+	*instr = program->instrs + program->length++;
+	memset(*instr, 0, sizeof **instr);
+	(*instr)->op = op;
+	return SUCCESS;
+}
+
+static status_t parse_grow_labels(parser_t *parser)
+{
+	size_t capacity = 2 * parser->label_capacity;
+	label_t *labels = calloc(capacity, sizeof *labels);
+	if (labels == NULL)
+	{
+		return OUT_OF_MEM;
+	}
+
+	size_t i;
+	for (i = 0; i < parser->label_capacity; i++)
+	{
+		label_t *label = parser->labels + i;
+		if (label->length == 0)
+		{
+			continue;
+		}
+
+		size_t slot = hash_text(parser->source + label->offset, label->length) & (capacity - 1);
+		while (labels[slot].length != 0)
+		{
+			slot = (slot + 1) & (capacity - 1);
+		}
+		labels[slot] = *label;
+	}
+
+	free(parser->labels);
+	parser->labels = labels;
+	parser->label_capacity = capacity;
+	return SUCCESS;
+}
+
+//Finds the label named by the length characters at offset in the source,
+//adding it as not yet defined if it's new
+static status_t parse_find_label(parser_t *parser, size_t offset, size_t length, label_t **label)
+{
+	const char *text = parser->source + offset;
+
+	//Kept at most half full, so probes stay short
+	if (2 * (parser->label_count + 1) > parser->label_capacity)
+	{
+		status_t error = parse_grow_labels(parser);
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	size_t mask = parser->label_capacity - 1;
+	size_t slot = hash_text(text, length) & mask;
+	label_t *found;
+	for (;;)
+	{
+		found = parser->labels + slot;
+		if (found->length == 0)
+		{
+			found->offset = offset;
+			found->length = length;
+			found->used_at = offset;
+			found->index = NO_TARGET;
+			found->pending = NO_TARGET;
+			parser->label_count++;
+			break;
+		}
+
+		if (found->length == length && memcmp(parser->source + found->offset, text, length) == 0)
+		{
+			break;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	*label = found;
+	return SUCCESS;
+}
+
+//The label at offset is on the next instruction, so every jump waiting on it
+//can now be given that instruction
+static status_t parse_define_label(parser_t *parser, size_t offset, size_t length)
+{
+	label_t *label;
+	status_t error = parse_find_label(parser, offset, length, &label);
+	if (error)
+	{
+		return error;
+	}
+
+	if (label->index != NO_TARGET)
+	{
+		fprintf(stderr, "Line %zu: label %.*s is already defined on line %zu\n",
+			line_of(parser->source, offset), (int) label->length,
+			parser->source + label->offset, line_of(parser->source, label->offset));
+		return DUPLICATE_LABEL;
+	}
+
+	//It's the position of its definition that's reported from now on
+	label->offset = offset;
+	label->index = parser->program->length;
+
+	instr_t *instrs = parser->program->instrs;
+	unsigned int i = label->pending;
+	while (i != NO_TARGET)
+	{
+		unsigned int next = instrs[i].target;
+		instrs[i].target = label->index;
+		i = next;
+	}
+	label->pending = NO_TARGET;
+
+	return SUCCESS;
+}
+
+static status_t parse_check_labels(parser_t *parser)
+{
+	size_t i;
+	for (i = 0; i < parser->label_capacity; i++)
+	{
+		label_t *label = parser->labels + i;
+		if (label->length != 0 && label->index == NO_TARGET)
+		{
+			fprintf(stderr, "Line %zu: label %.*s is never defined\n",
+				line_of(parser->source, label->used_at), (int) label->length,
+				parser->source + label->offset);
+			return UNDEFINED_LABEL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+static status_t parse_line(parser_t *parser)
+{
+	status_t error;
+
+	//<labeled_instruction> -> <label> COLON NEWLINE <instruction>
+	if (tok_get_type(parser->tok) == IDENT)
+	{
+		//The token itself is reused once it's consumed
+		size_t offset = tok_get_offset(parser->tok);
+		size_t length = tok_get_length(parser->tok);
+		if ((error = parse_advance(parser)) ||
+			(error = parse_expect(parser, COLON, "a colon")) ||
+			(error = parse_expect(parser, NEWLINE, "a new line after a label")) ||
+			(error = parse_define_label(parser, offset, length)))
+		{
+			return error;
+		}
+	}
+
+	if ((error = parse_instruction(parser)))
+	{
+		return error;
+	}
+
+	//Each instruction ends its line, unless it's the last one in the file and
+	//there's no newline after it
+	if (tok_get_type(parser->tok) == TOK_EOF)
+	{
+		return SUCCESS;
+	}
+
+	return parse_expect(parser, NEWLINE, "the end of the line");
+}
+
+static status_t parse_instruction(parser_t *parser)
+{
+	status_t error;
+
+	tok_type_t op = tok_get_type(parser->tok);
+	if (op < NOP)
+	{
+		return parse_syntax_error(parser, "an instruction");
+	}
+
+	instr_t *instr;
+	if ((error = parse_new_instruction(parser, op, &instr)) ||
+		(error = parse_advance(parser)))
+	{
+		return error;
+	}
+
+	//The arguments are parsed into place. Nothing else is added to the
+	//program meanwhile, so instr stays where it is.
+	switch (op)
+	{
+		case NOP:
+		case HALT:
+			break;
+
+		case CLR:
+		case INC:
+		case DEC:
+			error = parse_dest_arg(parser, &instr->args[0]);
+			break;
+
+		case FRM:
+		case DIS:
+			error = parse_arg(parser, &instr->args[0]);
+			break;
+
+		case ALM:
+		case ADD:
+		case SUB:
+		case MUL:
+		case DIV:
+		case MOV:
+		case AND:
+		case OR:
+		case NOT:
+		case XOR:
+			if (!(error = parse_dest_arg(parser, &instr->args[0])) &&
+				!(error = parse_expect(parser, COMMA, "a comma")))
+			{
+				error = parse_arg(parser, &instr->args[1]);
+			}
+			break;
+
+		case CMP:
+			if (!(error = parse_arg(parser, &instr->args[0])) &&
+				!(error = parse_expect(parser, COMMA, "a comma")))
+			{
+				error = parse_arg(parser, &instr->args[1]);
+			}
+			break;
+
+		default:
+			//The jumps
+			error = parse_jump_target(parser, instr - parser->program->instrs);
+			break;
+	}
+
+	return error;
+}
+
+//<jmp_instruction>'s label. If it isn't defined yet, the jump joins the ones
+//waiting on it.
+static status_t parse_jump_target(parser_t *parser, size_t index)
+{
+	if (tok_get_type(parser->tok) != IDENT)
+	{
+		return parse_syntax_error(parser, "a label");
+	}
+
+	label_t *label;
+	status_t error = parse_find_label(parser, tok_get_offset(parser->tok), tok_get_length(parser->tok), &label);
+	if (error)
+	{
+		return error;
+	}
+
+	instr_t *instr = parser->program->instrs + index;
+	if (label->index != NO_TARGET)
+	{
+		instr->target = label->index;
+	}
+	else
+	{
+		instr->target = label->pending;
+		label->pending = index;
+	}
+
+	return parse_advance(parser);
+}
+
+static status_t parse_dest_arg(parser_t *parser, arg_t *arg)
+{
+	return parse_arg_inner(parser, &arg->parts[0], 0);
+}
+
+static status_t parse_arg(parser_t *parser, arg_t *arg)
+{
+	status_t error = parse_arg_inner(parser, &arg->parts[0], 1);
+	if (error || tok_get_type(parser->tok) != PLUS)
+	{
+		return error;
+	}
+
+	if ((error = parse_advance(parser)))
+	{
+		return error;
+	}
+
+	return parse_arg_inner(parser, &arg->parts[1], 1);
+}
+
+static status_t parse_arg_inner(parser_t *parser, arg_part_t *part, unsigned short allow_literal)
+{
+	status_t error;
+
+	tok_t *tok = parser->tok;
+	const char *text = parser->source + tok_get_offset(tok);
+	size_t i;
+
+	switch (tok_get_type(tok))
+	{
+		case REGISTER:
+			part->kind = ARG_REGISTER;
+			part->reg = text[1] - '0';
+			return parse_advance(parser);
+
+		case LPAREN:
+			if ((error = parse_advance(parser)))
+			{
+				return error;
+			}
+
+			if (tok_get_type(parser->tok) != REGISTER)
+			{
+				return parse_syntax_error(parser, "a register");
+			}
+
+			part->kind = ARG_MEMORY;
+			part->reg = parser->source[tok_get_offset(parser->tok) + 1] - '0';
+			if ((error = parse_advance(parser)))
+			{
+				return error;
+			}
+
+			return parse_expect(parser, RPAREN, "a closing parenthesis");
+
+		case HEXI:
+			if (!allow_literal)
+			{
+				break;
+			}
+
+			//The lexer has already made sure these are four hex digits
+			part->kind = ARG_LITERAL;
+			part->literal = 0;
+			for (i = 0; i < 4; i++)
+			{
+				part->literal = part->literal * 16 +
+					(text[i] <= '9' ? text[i] - '0' : text[i] - 'A' + 10);
+			}
+			return parse_advance(parser);
+
+		case DECI:
+			if (!allow_literal)
+			{
+				break;
+			}
+
+			//And that these are five digits that fit in 16 bits
+			part->kind = ARG_LITERAL;
+			part->literal = 0;
+			for (i = 0; i < 5; i++)
+			{
+				part->literal = part->literal * 10 + (text[i] - '0');
+			}
+			return parse_advance(parser);
+
+		default:
+			break;
+	}
+
+	return parse_syntax_error(parser, allow_literal ? "a register, memory or a literal" : "a register or memory");
+}
@@ -1 +0,0 @@
-/home/austin/CS/Personal/string_t/v2/src/string_t.c
\ No newline at end of file
@@ -1,31 +1,98 @@
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "tok.h"
 
-#include "string_t.h"
+//Tokens are handed out from blocks of this many, so lexing allocates once per
+//block rather than once per token
+#define TOK_ARENA_BLOCK_SIZE 4096
 
 struct tok_t
 {
 	tok_type_t type;
-	string_t *value;
+	size_t offset;
+	size_t length;
 };
 
-tok_t *tok_initialize(void)
+typedef struct tok_block_t
 {
-	tok_t *tok = malloc(sizeof *tok);
-	if (tok == NULL)
+	struct tok_block_t *prev;
+	size_t used;
+	tok_t toks[TOK_ARENA_BLOCK_SIZE];
+} tok_block_t;
+
+struct tok_arena_t
+{
+	//The block tokens are being handed out from, which leads back through
+	//all the full ones
+	tok_block_t *current;
+};
+
+tok_arena_t *tok_arena_initialize(void)
+{
+	tok_arena_t *arena = malloc(sizeof *arena);
+	if (arena == NULL)
 	{
 		return NULL;
 	}
 
-	tok->value = string_initialize();
-	return tok;
+	arena->current = NULL;
+	return arena;
+}
+
+void tok_arena_uninitialize(tok_arena_t *arena)
+{
+	tok_block_t *block = arena->current;
+	while (block != NULL)
+	{
+		tok_block_t *prev = block->prev;
+		free(block);
+		block = prev;
+	}
+
+	free(arena);
+}
+
+void tok_arena_reset(tok_arena_t *arena)
+{
+	tok_block_t *block = arena->current;
+	if (block == NULL)
+	{
+		return;
+	}
+
+	//The newest block is kept for the tokens to come
+	tok_block_t *prev = block->prev;
+	while (prev != NULL)
+	{
+		tok_block_t *next = prev->prev;
+		free(prev);
+		prev = next;
+	}
+
+	block->prev = NULL;
+	block->used = 0;
 }
 
-void tok_uninitialize(tok_t *tok)
+tok_t *tok_initialize(tok_arena_t *arena)
 {
-	string_uninitialize(tok->value);
-	free(tok);
+	tok_block_t *block = arena->current;
+	if (block == NULL || block->used == TOK_ARENA_BLOCK_SIZE)
+	{
+		block = malloc(sizeof *block);
+		if (block == NULL)
+		{
+			return NULL;
+		}
+
+		block->prev = arena->current;
+		block->used = 0;
+		arena->current = block;
+	}
+
+	tok_t *tok = block->toks + block->used++;
+	tok->offset = tok->length = 0;
+	return tok;
 }
 
 tok_type_t tok_get_type(tok_t *tok)
@@ -38,22 +105,23 @@ void tok_set_type(tok_t *tok, tok_type_t type)
 	tok->type = type;
 }
 
-string_t *tok_get_value(tok_t *tok)
+size_t tok_get_offset(tok_t *tok)
 {
-	return tok->value;
+	return tok->offset;
 }
 
-void tok_set_value(tok_t *tok, string_t *s)
+size_t tok_get_length(tok_t *tok)
 {
-	string_copy(tok->value, s);
+	return tok->length;
 }
 
-void tok_value_append(tok_t *tok, char c)
+void tok_set_value(tok_t *tok, size_t offset, size_t length)
 {
-	string_push_back(tok->value, c);
+	tok->offset = offset;
+	tok->length = length;
 }
 
-void tok_print(tok_t *tok)
+void tok_print(tok_t *tok, const char *source)
 {
 #define SWITCH_CASE(x)\
 	case x:\
@@ -88,6 +156,7 @@ void tok_print(tok_t *tok)
 		SWITCH_CASE(MOV);
 		SWITCH_CASE(AND);
 		SWITCH_CASE(OR);
+		SWITCH_CASE(NOT);
 		SWITCH_CASE(XOR);
 		SWITCH_CASE(CMP);
 		SWITCH_CASE(JEQ);
@@ -102,5 +171,5 @@ void tok_print(tok_t *tok)
 	}
 #undef SWITCH_CASE
 
-	printf("%s, %s\n", type, string_c_str(tok->value));
+	printf("%s, %.*s\n", type, (int) tok->length, source + tok->offset);
 }
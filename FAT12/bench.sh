@@ -0,0 +1,145 @@
+#!/bin/sh
+#Benchmarks msdosdir and msdosextr on images made by msdosgen, and prints one
+#CSV line per run: files/sec and MB/sec are averaged over REPS repetitions,
+#and syscalls is from one extra run under strace -f -c (n/a without strace).
+#
+#	REPS     repetitions per run (default 5)
+#	THREADS  msdosextr -j for the parallel runs (default: number of CPUs)
+#	WORK     scratch directory (default: a new one under /tmp)
+#	BASELINE CSV from an earlier run to compare against: every run whose
+#	         files/sec or MB/sec is more than TOLERANCE percent below the
+#	         baseline's is reported on stderr, and the script exits 1. Runs
+#	         are matched on config, tool and threads; ones the baseline
+#	         doesn't have are only noted.
+#	TOLERANCE percent either rate may drop by (default 10)
+set -e
+cd "$(dirname "$0")"
+
+REPS=${REPS:-5}
+THREADS=${THREADS:-$(nproc 2>/dev/null || echo 1)}
+TOLERANCE=${TOLERANCE:-10}
+if [ -n "$BASELINE" ] && [ ! -r "$BASELINE" ]
+then
+	echo "Could not read baseline $BASELINE" >&2
+	exit 2
+fi
+
+WORK=${WORK:-$(mktemp -d /tmp/msdosbench.XXXXXX)}
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+#name:msdosgen options
+CONFIGS="floppy:-t 12 -n 100 -z 12000
+fragmented:-t 12 -n 100 -z 12000 -f 50
+tree:-t 16 -s 65536 -n 2000 -d 3 -w 4 -z 16384
+large:-t 16 -s 262144 -n 400 -z 524288 -f 5"
+
+now()
+{
+	date +%s.%N
+}
+
+count_syscalls()
+{
+	if command -v strace >/dev/null 2>&1
+	then
+		strace -f -c -o "$WORK/strace" "$@" >/dev/null 2>&1
+		awk '$NF == "total" { print $4 }' "$WORK/strace"
+	else
+		echo n/a
+	fi
+}
+
+#config tool threads files bytes command...
+run()
+{
+	config=$1 tool=$2 threads=$3 files=$4 bytes=$5
+	shift 5
+
+	elapsed=0
+	i=0
+	while [ $i -lt "$REPS" ]
+	do
+		rm -rf "$WORK/out"
+		mkdir "$WORK/out"
+		start=$(now)
+		"$@" >/dev/null
+		end=$(now)
+		elapsed=$(echo "$elapsed $start $end" | awk '{ printf "%.9f", $1 + $3 - $2 }')
+		i=$((i + 1))
+	done
+
+	rm -rf "$WORK/out"
+	mkdir "$WORK/out"
+	syscalls=$(count_syscalls "$@")
+
+	echo "$config $tool $threads $files $bytes $elapsed $REPS $syscalls" | awk '{
+		per_run = $6 / $7
+		printf "%s,%s,%s,%d,%d,%.6f,%.0f,%.2f,%s\n", $1, $2, $3, $4, $5, per_run, $4 / per_run, $5 / per_run / 1048576, $8
+	}'
+}
+
+#Against the baseline; exits 1 if anything got slower than the tolerance allows
+compare()
+{
+	awk -F, -v tolerance="$TOLERANCE" '
+		function check(key, what, before, after)
+		{
+			if (after < before * (1 - tolerance / 100))
+			{
+				printf "%s: %s dropped from %s to %s\n", key, what, before, after > "/dev/stderr"
+				failed = 1
+			}
+		}
+
+		FNR == 1 { next }
+
+		#With THREADS=1 the parallel run has the same key as the serial one,
+		#so a key is matched to the one as many runs into the baseline
+		{
+			key = $1 "," $2 "," $3
+			slot = key "," (NR == FNR ? ++before_runs[key] : ++after_runs[key])
+		}
+
+		NR == FNR {
+			files[slot] = $7
+			mb[slot] = $8
+			next
+		}
+
+		{
+			if (!(slot in files))
+			{
+				printf "%s: not in the baseline\n", key > "/dev/stderr"
+				next
+			}
+			check(key, "files/sec", files[slot], $7)
+			check(key, "MB/sec", mb[slot], $8)
+		}
+
+		END { exit failed }
+	' "$BASELINE" "$1"
+}
+
+benchmark()
+{
+	echo "config,tool,threads,files,bytes,seconds,files_per_sec,mb_per_sec,syscalls"
+	echo "$CONFIGS" | while IFS=: read -r name options
+	do
+		image="$WORK/$name.img"
+		#"N file(s), B bytes, ..."
+		summary=$(./msdosgen.out $options "$image")
+		files=$(echo "$summary" | awk '{ print $1 }')
+		bytes=$(echo "$summary" | awk '{ print $3 }')
+
+		run "$name" msdosdir 1 "$files" "$bytes" ./msdosdir.out "$image"
+		run "$name" msdosextr 1 "$files" "$bytes" ./msdosextr.out "$image" "$WORK/out"
+		run "$name" msdosextr "$THREADS" "$files" "$bytes" ./msdosextr.out -j "$THREADS" "$image" "$WORK/out"
+	done
+}
+
+benchmark | tee "$WORK/results.csv"
+if [ -n "$BASELINE" ]
+then
+	compare "$WORK/results.csv"
+fi
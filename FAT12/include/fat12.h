@@ -1,6 +1,7 @@
 #ifndef __FAT_12_H__
 #define __FAT_12_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define BOOT_MEMBER_SIZE 512
@@ -21,11 +22,25 @@ typedef struct
 	uint16_t num_hidden; //bytes 28-29 (2 bytes)
 	uint8_t bootstrap[480]; //bytes 30-509 (480 bytes)
 	uint8_t signature[2]; //bytes 510-511 (2 bytes)
+
+	//These are inside the bootstrap bytes, which volumes too big for the
+	//16-bit counts above use for 32-bit ones (the 16-bit ones are then 0)
+	uint32_t total_sectors_32; //bytes 32-35 (4 bytes)
+	uint32_t sectors_per_fat_32; //bytes 36-39 (4 bytes), FAT32 only
+	uint32_t root_cluster; //bytes 44-47 (4 bytes), FAT32 only
 } boot_t;
 
 #define DIR_ENTRY_MEMBER_SIZE 32
 #define MAX_FILE_NAME 8
 #define MAX_EXTENSION 3
+
+//Bits in direntry_t's attributes
+#define READ_ONLY 1
+#define HIDDEN 2
+#define SYSTEM_FILE 4
+#define VOLUME_LABEL 8
+#define SUBDIRECTORY 16
+#define ARCHIVE 32
 typedef struct
 {
 	unsigned char filename[MAX_FILE_NAME];
@@ -34,23 +49,145 @@ typedef struct
 	uint8_t reserved_bytes[10];
 	uint16_t time;
 	uint16_t date;
-	uint16_t start_cluster;
+	//On FAT32 the high 16 bits are the last two of reserved_bytes
+	uint32_t start_cluster;
 	uint32_t filesize;
 } direntry_t;
 
+//A run of physically contiguous clusters in a file's chain
+typedef struct
+{
+	uint32_t start_cluster;
+	uint32_t clusters;
+} extent_t;
+
+typedef struct
+{
+	extent_t *extents;
+	size_t count;
+	size_t capacity;
+} extent_list_t;
+
+#define NO_NODE UINT32_MAX
+
+//A file or directory anywhere in the tree
+typedef struct
+{
+	//Relative to the root, with '/' between components, e.g. "NET/HOSTS"
+	char *path;
+	direntry_t entry;
+	//Index of the directory holding this node, or NO_NODE for the root
+	uint32_t parent;
+	//A directory's children are next to each other in the node array
+	uint32_t first_child;
+	uint32_t child_count;
+} fat_node_t;
+
+typedef struct fat12 fat12_t;
+
+//How the entries of one FAT width are read, after fat_entry_operations in the
+//kernel's fs/fat/fatent.c
 typedef struct
 {
+	uint8_t bits;
+	//Entries at or above this end a chain
+	uint32_t end_of_chain;
+	//Called once the table is found, for widths that need to prepare it
+	uint8_t (*load)(fat12_t *fat);
+	uint32_t (*get)(fat12_t *fat, uint32_t cluster);
+} fat_entry_ops_t;
+
+//Despite the name, this is any of FAT12, FAT16 or FAT32
+struct fat12
+{
+	//The whole image, mapped read-only by read_fat12, or just the part before
+	//the data area, in memory from malloc, for read_fat12_head
+	uint8_t *image;
+	size_t image_size;
+	uint8_t image_mapped;
+
 	boot_t boot;
+	const fat_entry_ops_t *ops;
 	uint8_t media_descriptor;
-	uint16_t eof_marker;
+	//Entry 1, which FAT12 chains may also end with; for the other widths,
+	//just ops->end_of_chain
+	uint32_t eof_marker;
+	//The first FAT, in the mapping. Entries are read straight out of it on
+	//demand, except for FAT12's, which are small enough to decode up front
+	//into fat_entries
+	const uint8_t *fat_table;
 	uint16_t *fat_entries;
+	//Entries for clusters 2 and up
+	uint32_t num_fat_entries;
+	//Where cluster 2 starts in the image, and how big every cluster is
+	uint64_t data_offset;
+	uint32_t cluster_size;
 	direntry_t *root_dir_entries;
+	//Entries in use, which is everything before the first free one
+	uint32_t root_dir_count;
 	direntry_t *volume_label;
-} fat12_t;
+
+	//Every file and directory in the image, breadth first, so the root's
+	//children come first and each directory's children are contiguous
+	fat_node_t *nodes;
+	uint32_t num_nodes;
+	uint32_t nodes_capacity;
+	uint32_t num_root_nodes;
+	size_t max_path_len;
+	//Open addressing hash table from path to node index + 1 (0 is empty)
+	uint32_t *path_index;
+	uint32_t path_index_size;
+};
+
+//Optional extras for extract_files, indexed by node. Every file written gets
+//its data's xxh64 and CRC32 in hashes and crcs, and hashed set. A file that
+//comes in hashed (from an earlier run's manifest) is left alone instead, as
+//long as its output is still there at the right size and its data in the
+//image hashes the same.
+typedef struct
+{
+	uint64_t *hashes;
+	uint32_t *crcs;
+	uint8_t *hashed;
+	//How many files were left alone
+	uint32_t skipped;
+} extract_options_t;
 
 uint8_t read_fat12(int fd, fat12_t *fat);
 void print_fat12(fat12_t *fat);
-void extract_files(int fd, fat12_t *fat, char *out_dir);
+uint8_t print_path(fat12_t *fat, const char *path);
+uint32_t find_path(fat12_t *fat, const char *path);
+uint32_t hash_path(const char *path);
+uint32_t extract_files(fat12_t *fat, char *out_dir, uint32_t selected, int threads, extract_options_t *options);
 void free_fat12(fat12_t *fat);
 
+//For readers that can't map the whole image, and build the tree themselves
+void init_fat12(fat12_t *fat);
+uint64_t fat12_head_size(const uint8_t *head);
+uint8_t read_fat12_head(uint8_t *head, size_t size, fat12_t *fat);
+uint8_t read_directory_block(fat12_t *fat, const uint8_t *src, uint64_t size, uint32_t parent, uint8_t *ended);
+uint8_t order_fat12_tree(fat12_t *fat);
+
+uint8_t is_end_of_chain(fat12_t *fat, uint32_t cluster);
+uint8_t build_extents(fat12_t *fat, uint32_t cluster, extent_list_t *list);
+void free_extents(extent_list_t *list);
+uint8_t image_has(fat12_t *fat, uint64_t offset, uint64_t n);
+uint8_t write_all(int fd, const uint8_t *buff, size_t n);
+unsigned int file_permissions(direntry_t *entry);
+
+//Decoding helpers. These work on the mapped image, so the loads are done a
+//byte at a time to stay independent of host endianness and alignment
+uint16_t load_uint16_little_endian(const uint8_t *src);
+uint32_t load_uint32_little_endian(const uint8_t *src);
+
+//For readers that look at raw directory entries, deleted ones included
+void read_directory_entry(fat12_t *fat, const uint8_t *src, direntry_t *entry);
+size_t format_entry_name(direntry_t *entry, char *dst);
+uint8_t is_safe_name(const char *name);
+uint8_t is_volume_label(direntry_t *entry);
+uint8_t is_entry_free(direntry_t *entry);
+uint8_t is_entry_deleted(direntry_t *entry);
+uint8_t is_dot_entry(direntry_t *entry);
+uint8_t is_directory(direntry_t *entry);
+
 #endif
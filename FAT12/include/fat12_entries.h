@@ -0,0 +1,19 @@
+#ifndef __FAT_12_ENTRIES_H__
+#define __FAT_12_ENTRIES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Number of bytes count packed 12-bit entries take up
+#define FAT12_PACKED_SIZE(count) (((count) * 3 + 1) / 2)
+
+//Unpacks count 12-bit FAT entries from src into dst. src has to hold
+//FAT12_PACKED_SIZE(count) bytes. Uses SSSE3 when the CPU has it.
+void decode_fat12_entries(const uint8_t *src, uint16_t *dst, size_t count);
+
+//The reverse of decode_fat12_entries: packs the low 12 bits of count entries
+//into FAT12_PACKED_SIZE(count) bytes at dst. With an odd count the high
+//nibble of the last byte (which belongs to the next entry) is left alone.
+void encode_fat12_entries(const uint16_t *src, uint8_t *dst, size_t count);
+
+#endif
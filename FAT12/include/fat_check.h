@@ -0,0 +1,10 @@
+#ifndef __FAT_CHECK_H__
+#define __FAT_CHECK_H__
+
+#include <stdint.h>
+
+#include "fat12.h"
+
+uint32_t check_fat12(fat12_t *fat, int threads);
+
+#endif
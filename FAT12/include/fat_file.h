@@ -0,0 +1,26 @@
+#ifndef __FAT_FILE_H__
+#define __FAT_FILE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "fat12.h"
+
+//A file opened for reading at any offset. Its whole cluster chain is walked
+//once, at open, into extents; each extent also records the file offset it
+//starts at, so a read finds its extent with a binary search instead of
+//walking the chain again (the same idea as fat_cache_lookup in the kernel's
+//fs/fat/cache.c, but keeping every extent rather than the last few).
+typedef struct
+{
+	fat12_t *fat;
+	fat_node_t *node;
+	extent_list_t extents;
+	uint64_t *extent_offsets;
+} fat_file_t;
+
+uint8_t fat_open(fat12_t *fat, const char *path, fat_file_t *file);
+ssize_t fat_pread(fat_file_t *file, void *buf, size_t count, uint64_t offset);
+void fat_close(fat_file_t *file);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __FAT_HASH_H__
+#define __FAT_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//xxh64, fed in pieces of any size
+typedef struct
+{
+	uint64_t seed;
+	uint64_t accumulators[4];
+	uint64_t total_len;
+	//Input that didn't make a whole 32 byte stripe yet
+	uint8_t buffer[32];
+	uint32_t buffered;
+} xxh64_state_t;
+
+void xxh64_init(xxh64_state_t *state, uint64_t seed);
+void xxh64_update(xxh64_state_t *state, const uint8_t *data, size_t len);
+uint64_t xxh64_digest(xxh64_state_t *state);
+uint64_t xxh64(const uint8_t *data, size_t len, uint64_t seed);
+
+//The zlib/PKZIP CRC32. Start crc at 0, and pass back what each call returns.
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+//Both of the checksums kept for an extracted file, fed together so each piece
+//of the file is only brought into cache once
+typedef struct
+{
+	xxh64_state_t xxh64;
+	uint32_t crc32;
+} file_hash_t;
+
+void file_hash_init(file_hash_t *hash);
+void file_hash_update(file_hash_t *hash, const uint8_t *data, size_t len);
+
+#endif
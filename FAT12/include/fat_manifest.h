@@ -0,0 +1,17 @@
+#ifndef __FAT_MANIFEST_H__
+#define __FAT_MANIFEST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fat12.h"
+
+#define MANIFEST_CSV 0
+#define MANIFEST_JSON 1
+
+uint8_t write_manifest(fat12_t *fat, const char *image_name, FILE *out, uint8_t format, const extract_options_t *hashes);
+uint8_t read_manifest_hashes(fat12_t *fat, FILE *in, extract_options_t *hashes);
+void write_csv_string(FILE *out, const char *s);
+void write_json_string(FILE *out, const char *s);
+
+#endif
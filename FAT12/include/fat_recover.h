@@ -0,0 +1,49 @@
+#ifndef __FAT_RECOVER_H__
+#define __FAT_RECOVER_H__
+
+#include <stdint.h>
+
+#include "fat12.h"
+
+//What a recovered item is
+#define RECOVERED_FILE 0
+#define RECOVERED_ORPHAN 1
+
+//Whether a deleted file's data can still be trusted
+#define RECOVERABLE 0
+//Some of the clusters it would have used are allocated again
+#define RECOVER_OVERWRITTEN 1
+//Its first cluster or size runs off the end of the volume
+#define RECOVER_OUT_OF_RANGE 2
+//Some of its clusters are still allocated, but no live file or directory has
+//them, so they most likely still hold its data and were never freed
+#define RECOVER_LOST_CHAIN 3
+
+typedef struct
+{
+	//Where it goes under the output directory: for a deleted file, "deleted/"
+	//and the path it had, with '_' for the first character of its name (which
+	//deleting it overwrote); for an orphan, "orphans/" and its first cluster
+	char *path;
+	uint8_t kind;
+	uint8_t status;
+	//The entry it was found in; zeroed for an orphan
+	direntry_t entry;
+	//The run of clusters it's taken from, and how much of it is used
+	uint32_t start_cluster;
+	uint32_t clusters;
+	uint32_t size;
+} recovered_t;
+
+typedef struct
+{
+	recovered_t *items;
+	uint32_t count;
+	uint32_t capacity;
+} recovery_t;
+
+uint8_t scan_recoverable(fat12_t *fat, recovery_t *recovery);
+uint32_t write_recovered(fat12_t *fat, recovery_t *recovery, const char *out_dir, int threads);
+void free_recovery(recovery_t *recovery);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __FAT_STREAM_H__
+#define __FAT_STREAM_H__
+
+#include <stdint.h>
+
+#include "fat12.h"
+
+uint8_t is_stream_name(const char *name);
+uint8_t read_fat12_stream(int fd, fat12_t *fat, const char *out_dir, const char *selected);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __FAT_WRITER_H__
+#define __FAT_WRITER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "fat12.h"
+
+//Builds a FAT12 or FAT16 image in place in a shared mapping of the output
+//file. Clusters are handed out in order from a single cursor, so anything
+//allocated in one call is contiguous; leaving holes (to make fragmented test
+//images) has to be asked for with fat_writer_skip. The table itself is kept
+//unpacked in memory and only encoded into every FAT copy by
+//fat_writer_finish.
+typedef struct
+{
+	int fd;
+	uint8_t *image;
+	uint64_t image_size;
+
+	uint8_t bits;
+	uint32_t cluster_size;
+	uint32_t num_clusters;
+	uint64_t fat_offset;
+	uint32_t bytes_per_fat;
+	uint8_t fat_copies;
+	uint64_t root_offset;
+	uint16_t max_root_dir_entries;
+	//Just the volume label, if there is one
+	uint16_t root_entries_used;
+	uint64_t data_offset;
+
+	//Entries for every cluster, including the first two
+	uint32_t *entries;
+	uint32_t next_free;
+} fat_writer_t;
+
+//A cluster chain under construction
+typedef struct
+{
+	uint32_t first;
+	uint32_t last;
+} fat_chain_t;
+
+//A directory being filled. Every directory is allocated at its final size up
+//front, contiguously, so entries just go one after the other.
+typedef struct
+{
+	//0 for the root directory
+	uint32_t cluster;
+	uint64_t offset;
+	uint32_t free_entries;
+} fat_dir_t;
+
+uint8_t fat_writer_create(fat_writer_t *w, int fd, uint64_t size, uint8_t bits, const char *label);
+uint8_t fat_writer_finish(fat_writer_t *w);
+void fat_writer_free(fat_writer_t *w);
+
+uint32_t fat_writer_clusters_for(fat_writer_t *w, uint64_t bytes);
+uint8_t fat_writer_extend(fat_writer_t *w, fat_chain_t *chain, uint32_t clusters);
+void fat_writer_skip(fat_writer_t *w, uint32_t clusters);
+uint8_t *fat_writer_cluster_data(fat_writer_t *w, uint32_t cluster);
+
+uint8_t fat_writer_short_name(const char *host_name, unsigned char name[MAX_FILE_NAME + MAX_EXTENSION]);
+void fat_writer_root(fat_writer_t *w, fat_dir_t *root);
+uint8_t fat_writer_add_entry(fat_writer_t *w, fat_dir_t *dir, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint8_t attributes, uint32_t start_cluster, uint32_t size, time_t mtime);
+uint8_t fat_writer_mkdir(fat_writer_t *w, fat_dir_t *parent, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint32_t entries, time_t mtime, fat_dir_t *child);
+
+#endif
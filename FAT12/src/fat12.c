@@ -1,14 +1,22 @@
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "fat12.h"
+#include "fat12_entries.h"
+#include "fat_hash.h"
 
 //Need a macro (and not a function) to make use of sizeof on the array
-#define READ_INTO_ARRAY(fd, array)\
-	bool_read(fd, array, sizeof(array))
+#define COPY_INTO_ARRAY(array, src)\
+	memcpy(array, src, sizeof(array))
 
 #define PRINT_ARRAY(array)\
 	printf("%.*s", (int) sizeof(array), (char *) array)
@@ -23,13 +31,6 @@
 #define FILE_DELETED 0xe5
 #define ENTRY_FREE 0
 
-#define READ_ONLY 1
-#define HIDDEN 2
-#define SYSTEM_FILE 4
-#define VOLUME_LABEL 8
-#define SUBDIRECTORY 16
-#define ARCHIVE 32
-
 #define SECONDS_BITS_TO_RIGHT 0
 #define SECONDS_MASK 0x1f
 #define MINUTES_BITS_TO_RIGHT 5
@@ -48,198 +49,418 @@
 #define MASK_AND_SHIFT(expr, mask)\
 	(((expr) & mask##_MASK) >> mask##_BITS_TO_RIGHT)
 
-//Reading helper functions
-uint8_t bool_read(int fd, void *array, size_t n);
-uint8_t bool_seek(int fd, size_t n);
-uint8_t read_uint8(int fd, uint8_t *integer);
-uint8_t read_uint16_little_endian(int fd, uint16_t *integer);
-uint8_t read_twelve_bits_twice(int fd, uint16_t *integers);
+//Volumes with fewer clusters than these are FAT12 and FAT16 respectively
+#define FAT12_MAX_CLUSTERS 4085
+#define FAT16_MAX_CLUSTERS 65525
+
+//How much of a file is hashed before it's written while extracting
+#define HASH_PIECE_SIZE (256 * 1024)
+
+typedef struct
+{
+	fat12_t *fat;
+	char *out_dir;
+	//Only this node and what's under it is extracted (NO_NODE for everything)
+	uint32_t selected;
+	//Index of the next node to hand out
+	uint32_t next_node;
+	extract_options_t *options;
+	//Files that couldn't be written, added to by every worker
+	uint32_t failures;
+} extract_job_t;
 
 //Boot sector functions
-uint8_t read_boot_sector(int fd, boot_t *boot);
-uint8_t skip_remaining_boot_sector(int fd, boot_t *boot);
+uint8_t map_image(int fd, fat12_t *fat);
+uint8_t read_boot_sector(fat12_t *fat);
+uint64_t first_data_sector(boot_t *boot);
+
+//FAT entry functions, one set per width
+uint8_t fat12_load(fat12_t *fat);
+uint32_t fat12_get(fat12_t *fat, uint32_t cluster);
+uint32_t fat16_get(fat12_t *fat, uint32_t cluster);
+uint32_t fat32_get(fat12_t *fat, uint32_t cluster);
+
+static const fat_entry_ops_t fat12_ops = { 12, 0xff8, fat12_load, fat12_get };
+static const fat_entry_ops_t fat16_ops = { 16, 0xfff8, NULL, fat16_get };
+static const fat_entry_ops_t fat32_ops = { 32, 0x0ffffff8, NULL, fat32_get };
 
 //Directory entry functions
-uint8_t read_directory_entry(int fd, direntry_t *entry);
-uint8_t read_root_directory(int fd, fat12_t *fat);
-uint8_t is_volume_label(direntry_t *entry);
-uint8_t is_entry_free(direntry_t *entry);
-uint8_t is_entry_deleted(direntry_t *entry);
+uint8_t read_root_directory(fat12_t *fat);
+uint8_t read_root_cluster_chain(fat12_t *fat);
+uint8_t read_root_entries(fat12_t *fat, const uint8_t *src, uint32_t count);
 uint8_t is_regular_entry(direntry_t *entry);
 
+//Directory tree functions
+uint8_t add_root_nodes(fat12_t *fat);
+uint8_t read_directory_tree(fat12_t *fat);
+uint8_t read_subdirectory(fat12_t *fat, uint32_t dir, extent_list_t *extents);
+uint8_t add_node(fat12_t *fat, direntry_t *entry, uint32_t parent);
+uint8_t build_path_index(fat12_t *fat);
+uint8_t is_within(fat12_t *fat, uint32_t node, uint32_t ancestor);
+
 //General fat12 functions
-uint8_t skip_reserved_sectors(int fd, boot_t *boot);
-uint8_t read_file_allocation_tables(int fd, fat12_t *fat);
+uint8_t read_file_allocation_tables(fat12_t *fat);
 void print_volume_data(fat12_t *fat);
 void print_file_data(fat12_t *fat);
+void print_directory_listing(fat12_t *fat, uint32_t first, uint32_t count, uint32_t *total_files, uint64_t *total_size);
 void print_single_file_data(direntry_t *entry);
-void extract_single_file(int fd, fat12_t *fat, uint16_t i, char *full_name, size_t dirlen);
-void write_cluster(int fatFd, int outFd, uint32_t base_address, uint16_t
-	cluster, uint32_t cluster_size, uint32_t write_size);
+char *make_output_name(fat12_t *fat, char *out_dir, size_t *dir_len);
+void *extract_worker(void *arg);
+uint8_t extract_single_file(fat12_t *fat, uint32_t n, char *full_name, size_t dirlen, extent_list_t *extents, extract_options_t *options);
+uint8_t is_unchanged(fat12_t *fat, direntry_t *entry, const char *full_name, extent_list_t *extents, uint64_t hash, uint32_t *crc);
+uint8_t copy_file_data(fat12_t *fat, direntry_t *entry, extent_list_t *extents, int fd, file_hash_t *hash, uint32_t *remaining);
+uint8_t write_hashed(int fd, const uint8_t *buff, size_t n, file_hash_t *hash);
+
+uint16_t load_uint16_little_endian(const uint8_t *src)
+{
+	return (uint16_t) src[0] | ((uint16_t) src[1] << 8);
+}
+
+uint32_t load_uint32_little_endian(const uint8_t *src)
+{
+	return (uint32_t) src[0] | ((uint32_t) src[1] << 8) |
+		((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+//Whether the n bytes at offset are inside the image. Everything read out of
+//the map has to be checked with this first, since a truncated or corrupt image
+//would otherwise fault instead of failing
+uint8_t image_has(fat12_t *fat, uint64_t offset, uint64_t n)
+{
+	return offset <= fat->image_size && n <= fat->image_size - offset;
+}
+
+uint8_t map_image(int fd, fat12_t *fat)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < BOOT_MEMBER_SIZE)
+	{
+		return 0;
+	}
+
+	void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (image == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	fat->image = image;
+	fat->image_size = st.st_size;
+	fat->image_mapped = 1;
+	return 1;
+}
+
+uint8_t read_boot_sector(fat12_t *fat)
+{
+	//Can't just copy the sector straight into boot because the struct is
+	//padded. The padding could be removed using _attribute_((packed)), but
+	//doing so could/would cause a performance degradation
+	boot_t *boot = &fat->boot;
+	const uint8_t *src = fat->image;
+	COPY_INTO_ARRAY(boot->jmp_boot, src);
+	COPY_INTO_ARRAY(boot->oem_name, src + 3);
+	boot->bytes_per_sector = load_uint16_little_endian(src + 11);
+	boot->sectors_per_cluster = src[13];
+	boot->reserved_sectors = load_uint16_little_endian(src + 14);
+	boot->fat_copies = src[16];
+	boot->max_root_dir_entries = load_uint16_little_endian(src + 17);
+	boot->total_sectors = load_uint16_little_endian(src + 19);
+	boot->media_type = src[21];
+	boot->sectors_per_fat = load_uint16_little_endian(src + 22);
+	boot->sectors_per_track = load_uint16_little_endian(src + 24);
+	boot->num_heads = load_uint16_little_endian(src + 26);
+	boot->num_hidden = load_uint16_little_endian(src + 28);
+	COPY_INTO_ARRAY(boot->bootstrap, src + 30);
+	COPY_INTO_ARRAY(boot->signature, src + 510);
+	boot->total_sectors_32 = load_uint32_little_endian(src + 32);
+	boot->sectors_per_fat_32 = load_uint32_little_endian(src + 36);
+	boot->root_cluster = load_uint32_little_endian(src + 44);
 
-uint8_t bool_read(int fd, void *array, size_t n)
+	//The rest of the code divides by and multiplies with these, so reject
+	//images where they make no sense
+	return boot->bytes_per_sector >= BOOT_MEMBER_SIZE &&
+		boot->sectors_per_cluster != 0 &&
+		boot->reserved_sectors != 0 &&
+		boot->fat_copies != 0;
+}
+
+//free_fat will free these, so make sure they're set to NULL as a precaution
+//in case reading fails before they're allocated
+void init_fat12(fat12_t *fat)
 {
-	return read(fd, array, n) < 0 ? 0 : 1;
+	fat->image = NULL;
+	fat->image_size = 0;
+	fat->image_mapped = 0;
+	fat->ops = NULL;
+	fat->fat_table = NULL;
+	fat->fat_entries = NULL;
+	fat->root_dir_entries = NULL;
+	fat->root_dir_count = 0;
+	fat->volume_label = NULL;
+	fat->nodes = NULL;
+	fat->num_nodes = 0;
+	fat->nodes_capacity = 0;
+	fat->num_root_nodes = 0;
+	fat->max_path_len = 0;
+	fat->path_index = NULL;
+	fat->path_index_size = 0;
 }
 
-uint8_t bool_seek(int fd, size_t n)
+uint8_t read_fat12(int fd, fat12_t *fat)
 {
-	return lseek(fd, n, SEEK_CUR) >= 0;
+	init_fat12(fat);
+	return map_image(fd, fat) &&
+		read_boot_sector(fat) &&
+		read_file_allocation_tables(fat) &&
+		read_root_directory(fat) &&
+		read_directory_tree(fat);
 }
 
-uint8_t read_uint8(int fd, uint8_t *integer)
+//Returns how many bytes come before the data area (everything read_fat12_head
+//needs), going by the boot sector at the start of head, or 0 if it's no good
+uint64_t fat12_head_size(const uint8_t *head)
 {
-	return bool_read(fd, integer, 1);
+	fat12_t fat;
+	fat.image = (uint8_t *) head;
+	fat.image_size = BOOT_MEMBER_SIZE;
+	if (!read_boot_sector(&fat))
+	{
+		return 0;
+	}
+
+	return first_data_sector(&fat.boot) * fat.boot.bytes_per_sector;
 }
 
-uint8_t read_uint16_little_endian(int fd, uint16_t *integer)
+//Reads everything in head, the first fat12_head_size bytes of an image: the
+//boot sector, the FAT and, except on FAT32, the root directory and its nodes.
+//For readers that can't map the whole image; the rest of the tree is up to
+//them (read_directory_block, then order_fat12_tree). head has to come from
+//malloc, and belongs to fat from here on, even if this fails.
+uint8_t read_fat12_head(uint8_t *head, size_t size, fat12_t *fat)
 {
-	//Linux on x86-64 is already little endian, so don't actually have to convert
-	return bool_read(fd, integer, sizeof *integer);
+	init_fat12(fat);
+	fat->image = head;
+	fat->image_size = size;
+	if (!read_boot_sector(fat) || !read_file_allocation_tables(fat))
+	{
+		return 0;
+	}
+
+	//The FAT32 root is in the data area; this is just somewhere to keep its
+	//label
+	if (fat->ops->bits == 32)
+	{
+		fat->root_dir_entries = malloc(sizeof *fat->root_dir_entries);
+		return fat->root_dir_entries != NULL;
+	}
+
+	return read_root_directory(fat) && add_root_nodes(fat);
 }
 
-uint8_t read_uint32_little_endian(int fd, uint32_t *integer)
+//After the reserved sectors, every copy of the FAT and the fixed root
+//directory, if there is one
+uint64_t first_data_sector(boot_t *boot)
 {
-	return bool_read(fd, integer, sizeof *integer);
+	uint32_t sectors_per_fat = boot->sectors_per_fat ? boot->sectors_per_fat : boot->sectors_per_fat_32;
+	uint32_t root_dir_sectors =
+		(boot->max_root_dir_entries * DIR_ENTRY_MEMBER_SIZE + boot->bytes_per_sector - 1) / boot->bytes_per_sector;
+	return boot->reserved_sectors + (uint64_t) sectors_per_fat * boot->fat_copies + root_dir_sectors;
 }
 
-uint8_t read_twelve_bits_twice(int fd, uint16_t *integers)
+uint8_t read_file_allocation_tables(fat12_t *fat)
 {
-	uint8_t tmp[3];
-	if (!READ_INTO_ARRAY(fd, tmp))
+	boot_t *boot = &fat->boot;
+	uint32_t sectors_per_fat = boot->sectors_per_fat ? boot->sectors_per_fat : boot->sectors_per_fat_32;
+	uint32_t total_sectors = boot->total_sectors ? boot->total_sectors : boot->total_sectors_32;
+	uint64_t first_data = first_data_sector(boot);
+	uint64_t fat_offset = (uint64_t) boot->reserved_sectors * boot->bytes_per_sector;
+	uint64_t bytes_per_fat = (uint64_t) sectors_per_fat * boot->bytes_per_sector;
+	//Only the first copy is used, but the root directory comes after all of
+	//them, so they all have to be there
+	if (sectors_per_fat == 0 || total_sectors <= first_data ||
+		!image_has(fat, fat_offset, bytes_per_fat * boot->fat_copies))
+	{
+		return 0;
+	}
+
+	//Nothing records the width; it follows from the number of clusters, the
+	//same way every other implementation decides it
+	uint32_t clusters = (total_sectors - first_data) / boot->sectors_per_cluster;
+	if (clusters < FAT12_MAX_CLUSTERS)
+	{
+		fat->ops = &fat12_ops;
+	}
+	else if (clusters < FAT16_MAX_CLUSTERS)
+	{
+		fat->ops = &fat16_ops;
+	}
+	else
+	{
+		fat->ops = &fat32_ops;
+	}
+
+	//Subtract out 2 for the media_descriptor and the eof_marker, and ignore
+	//entries past the end of the data area
+	uint64_t table_entries = bytes_per_fat * 8 / fat->ops->bits;
+	if (table_entries < 3)
+	{
+		return 0;
+	}
+	fat->num_fat_entries = table_entries - 2 < clusters ? table_entries - 2 : clusters;
+	fat->fat_table = fat->image + fat_offset;
+	fat->data_offset = first_data * boot->bytes_per_sector;
+	fat->cluster_size = boot->bytes_per_sector * boot->sectors_per_cluster;
+
+	if (fat->ops->load != NULL && !fat->ops->load(fat))
 	{
 		return 0;
 	}
 
-	integers[0] = (((uint16_t) tmp[1] & 0x0f) << 8) | tmp[0];
-	integers[1] = ((uint16_t ) tmp[2] << 4) | ((tmp[1] & 0xf0) >> 4);
+	fat->media_descriptor = fat->ops->get(fat, 0);
+	//FAT16 and FAT32 keep the clean shutdown and hard error bits in entry 1,
+	//so on a volume that wasn't unmounted it's no end of chain marker, and
+	//only the range from ops says where chains end
+	fat->eof_marker = fat->ops->bits == 12 ? fat->ops->get(fat, 1) : fat->ops->end_of_chain;
 	return 1;
 }
 
-uint8_t read_boot_sector(int fd, boot_t *boot)
+//Decodes the whole table (including the media descriptor and eof marker),
+//which is at most 6KB for FAT12
+uint8_t fat12_load(fat12_t *fat)
 {
-	//Can't just read directly from the file into boot because the struct
-	//is padded. The padding could be removed using _attribute_((packed)),
-	//but doing so could/would cause a performance degradation
-	return READ_INTO_ARRAY(fd, boot->jmp_boot) &&
-		READ_INTO_ARRAY(fd, boot->oem_name) &&
-		read_uint16_little_endian(fd, &boot->bytes_per_sector) &&
-		read_uint8(fd, &boot->sectors_per_cluster) &&
-		read_uint16_little_endian(fd, &boot->reserved_sectors) &&
-		read_uint8(fd, &boot->fat_copies) &&
-		read_uint16_little_endian(fd, &boot->max_root_dir_entries) &&
-		read_uint16_little_endian(fd, &boot->total_sectors) &&
-		read_uint8(fd, &boot->media_type) &&
-		read_uint16_little_endian(fd, &boot->sectors_per_fat) &&
-		read_uint16_little_endian(fd, &boot->sectors_per_track) &&
-		read_uint16_little_endian(fd, &boot->num_heads) &&
-		read_uint16_little_endian(fd, &boot->num_hidden) &&
-		READ_INTO_ARRAY(fd, boot->bootstrap) &&
-		READ_INTO_ARRAY(fd, boot->signature) &&
-		skip_remaining_boot_sector(fd, boot);
+	uint32_t count = fat->num_fat_entries + 2;
+	fat->fat_entries = malloc(count * sizeof *fat->fat_entries);
+	if (fat->fat_entries == NULL)
+	{
+		return 0;
+	}
+
+	decode_fat12_entries(fat->fat_table, fat->fat_entries, count);
+	return 1;
 }
 
-uint8_t skip_remaining_boot_sector(int fd, boot_t *boot)
+uint32_t fat12_get(fat12_t *fat, uint32_t cluster)
 {
-	size_t boot_sector_remaining = boot->bytes_per_sector - BOOT_MEMBER_SIZE;
-	return bool_seek(fd, boot_sector_remaining);
+	return fat->fat_entries[cluster];
 }
 
-uint8_t read_fat12(int fd, fat12_t *fat)
+uint32_t fat16_get(fat12_t *fat, uint32_t cluster)
 {
-	//free_fat will free these, so make sure they're set to NULL as a
-	//precaution in case the function fails before they're allocated
-	fat->fat_entries = NULL;
-	fat->root_dir_entries = NULL;
+	return load_uint16_little_endian(fat->fat_table + cluster * 2);
+}
 
-	return read_boot_sector(fd, &fat->boot) &&
-		skip_reserved_sectors(fd, &fat->boot) &&
-		read_file_allocation_tables(fd, fat) &&
-		read_root_directory(fd, fat);
+uint32_t fat32_get(fat12_t *fat, uint32_t cluster)
+{
+	//The top 4 bits are reserved
+	return load_uint32_little_endian(fat->fat_table + (uint64_t) cluster * 4) & 0x0fffffff;
 }
 
-uint8_t skip_reserved_sectors(int fd, boot_t *boot)
+void read_directory_entry(fat12_t *fat, const uint8_t *src, direntry_t *entry)
 {
-	//Minus 1 because of the boot sector. Use uint32 because each is 16 bits,
-	//so could end up with 32 bits through multiplication
-	uint32_t reserved_sector_bytes = (boot->reserved_sectors - 1) *
-		boot->bytes_per_sector;
-	return bool_seek(fd, reserved_sector_bytes);
+	COPY_INTO_ARRAY(entry->filename, src);
+	COPY_INTO_ARRAY(entry->extension, src + 8);
+	entry->attributes = src[11];
+	COPY_INTO_ARRAY(entry->reserved_bytes, src + 12);
+	entry->time = load_uint16_little_endian(src + 22);
+	entry->date = load_uint16_little_endian(src + 24);
+	entry->start_cluster = load_uint16_little_endian(src + 26);
+	entry->filesize = load_uint32_little_endian(src + 28);
+
+	if (fat->ops->bits == 32)
+	{
+		entry->start_cluster |= (uint32_t) load_uint16_little_endian(src + 20) << 16;
+	}
 }
 
-uint8_t read_file_allocation_tables(int fd, fat12_t *fat)
+uint8_t read_root_directory(fat12_t *fat)
 {
 	boot_t *boot = &fat->boot;
-	uint16_t tmp[2];
-	//read media descriptor and eof_marker
-	if (!read_twelve_bits_twice(fd, tmp))
+	if (fat->ops->bits == 32)
 	{
-		return 0;
+		return read_root_cluster_chain(fat);
 	}
-	fat->media_descriptor = tmp[0];
-	fat->eof_marker = tmp[1];
 
-	uint32_t bytes_per_fat = boot->sectors_per_fat * boot->bytes_per_sector;
-	//Multiply by the number of entries per byte (2 for every 3 bytes), then
-	//subtract out 2 for the media_descriptor and the eof_marker
-	uint32_t num_fat_entries = bytes_per_fat * 2 / 3 - 2;
-	fat->fat_entries = malloc(num_fat_entries * sizeof *fat->fat_entries);
-	if (fat->fat_entries == NULL)
+	uint64_t root_offset =
+		(boot->reserved_sectors + (uint64_t) boot->sectors_per_fat * boot->fat_copies) * boot->bytes_per_sector;
+	uint16_t max = boot->max_root_dir_entries;
+	if (!image_has(fat, root_offset, max * DIR_ENTRY_MEMBER_SIZE))
 	{
 		return 0;
 	}
 
-	int i;
-	for (i = 0; i < num_fat_entries; i += 2)
+	fat->root_dir_entries = malloc(max * sizeof *fat->root_dir_entries);
+	if (fat->root_dir_entries == NULL)
 	{
-		if (!read_twelve_bits_twice(fd, fat->fat_entries + i))
-		{
-			return 0;
-		}
+		return 0;
 	}
 
-	//Skip any remaining FAT copies
-	return bool_seek(fd, (boot->fat_copies - 1) * bytes_per_fat);
+	read_root_entries(fat, fat->image + root_offset, max);
+	return 1;
 }
 
-uint8_t read_directory_entry(int fd, direntry_t *entry)
+//FAT32 has no fixed root directory; it's a cluster chain like any other
+//directory, starting at the cluster the boot sector names
+uint8_t read_root_cluster_chain(fat12_t *fat)
 {
-	return READ_INTO_ARRAY(fd, entry->filename) &&
-		READ_INTO_ARRAY(fd, entry->extension) &&
-		read_uint8(fd, &entry->attributes) &&
-		READ_INTO_ARRAY(fd, entry->reserved_bytes) &&
-		read_uint16_little_endian(fd, &entry->time) &&
-		read_uint16_little_endian(fd, &entry->date) &&
-		read_uint16_little_endian(fd, &entry->start_cluster) &&
-		read_uint32_little_endian(fd, &entry->filesize);
-}
+	extent_list_t extents = { NULL, 0, 0 };
+	if (!build_extents(fat, fat->boot.root_cluster, &extents))
+	{
+		free_extents(&extents);
+		return 0;
+	}
 
-uint8_t read_root_directory(int fd, fat12_t *fat)
-{
-	fat->root_dir_entries = malloc(fat->boot.max_root_dir_entries *
-		sizeof *fat->root_dir_entries);
+	uint64_t max = 0;
+	size_t e;
+	for (e = 0; e < extents.count; e++)
+	{
+		max += (uint64_t) extents.extents[e].clusters * fat->cluster_size / DIR_ENTRY_MEMBER_SIZE;
+	}
+
+	fat->root_dir_entries = malloc(max * sizeof *fat->root_dir_entries);
 	if (fat->root_dir_entries == NULL)
 	{
+		free_extents(&extents);
 		return 0;
 	}
 
-	direntry_t *root_dir_entries = fat->root_dir_entries;
-	uint16_t max = fat->boot.max_root_dir_entries;
-	int i;
-	for (i = 0; i < max; i++)
+	uint8_t ok = 1;
+	for (e = 0; e < extents.count; e++)
 	{
-		direntry_t *current_entry = root_dir_entries + i;
-		if (!read_directory_entry(fd, current_entry))
+		extent_t *extent = extents.extents + e;
+		uint64_t offset = fat->data_offset + (uint64_t) (extent->start_cluster - 2) * fat->cluster_size;
+		uint64_t size = (uint64_t) extent->clusters * fat->cluster_size;
+		if (!image_has(fat, offset, size))
 		{
-			return 0;
+			ok = 0;
+			break;
 		}
 
-		//If the current entry is free, then all following entries must be as
-		//well
-		if (is_entry_free(current_entry))
+		if (!read_root_entries(fat, fat->image + offset, size / DIR_ENTRY_MEMBER_SIZE))
 		{
 			break;
 		}
+	}
+
+	free_extents(&extents);
+	return ok;
+}
+
+//Reads up to count entries from src onto the end of the root directory.
+//Returns 0 once it reaches a free entry, since all following entries must be
+//free as well.
+uint8_t read_root_entries(fat12_t *fat, const uint8_t *src, uint32_t count)
+{
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		direntry_t *current_entry = fat->root_dir_entries + fat->root_dir_count;
+		read_directory_entry(fat, src + i * DIR_ENTRY_MEMBER_SIZE, current_entry);
+
+		if (is_entry_free(current_entry))
+		{
+			return 0;
+		}
+		fat->root_dir_count++;
 
 		if (is_volume_label(current_entry))
 		{
@@ -270,6 +491,435 @@ uint8_t is_regular_entry(direntry_t *entry)
 	return !is_volume_label(entry) && !is_entry_deleted(entry);
 }
 
+uint8_t is_directory(direntry_t *entry)
+{
+	return entry->attributes & SUBDIRECTORY;
+}
+
+//"." and "..", which every subdirectory starts with
+uint8_t is_dot_entry(direntry_t *entry)
+{
+	return entry->filename[0] == '.';
+}
+
+//Writes the entry's name the way it's shown to the user, "NAME.EXT" with the
+//padding taken off (and no '.' when there's no extension), and returns its
+//length. dst needs room for MAX_FILE_NAME + 1 + MAX_EXTENSION + 1 bytes.
+//A '/' or '\0' can't be part of a host file name, so either becomes '_'.
+size_t format_entry_name(direntry_t *entry, char *dst)
+{
+	const size_t filename_size = sizeof(entry->filename);
+	const size_t extension_size = sizeof(entry->extension);
+
+	size_t name_len = filename_size;
+	while (name_len > 0 && entry->filename[name_len - 1] == ' ')
+	{
+		name_len--;
+	}
+	memcpy(dst, entry->filename, name_len);
+
+	size_t extension_len = extension_size;
+	while (extension_len > 0 && entry->extension[extension_len - 1] == ' ')
+	{
+		extension_len--;
+	}
+
+	size_t len = name_len;
+	if (extension_len > 0)
+	{
+		dst[name_len] = '.';
+		memcpy(dst + name_len + 1, entry->extension, extension_len);
+		len += 1 + extension_len;
+	}
+	dst[len] = '\0';
+
+	size_t i;
+	for (i = 0; i < len; i++)
+	{
+		if (dst[i] == '/' || dst[i] == '\0')
+		{
+			dst[i] = '_';
+		}
+	}
+
+	return len;
+}
+
+//Whether a formatted name can be used as one component of a path: it can't
+//be empty, ".", or "..", which would name the directory it's in or its parent
+uint8_t is_safe_name(const char *name)
+{
+	return name[0] != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+uint8_t add_root_nodes(fat12_t *fat)
+{
+	uint32_t i;
+	for (i = 0; i < fat->root_dir_count; i++)
+	{
+		direntry_t *entry = fat->root_dir_entries + i;
+		if (is_regular_entry(entry) && !is_dot_entry(entry) && !add_node(fat, entry, NO_NODE))
+		{
+			return 0;
+		}
+	}
+	fat->num_root_nodes = fat->num_nodes;
+	return 1;
+}
+
+//Walks every subdirectory's cluster chain once, breadth first, and indexes
+//every path, so nothing has to rescan a directory afterwards
+uint8_t read_directory_tree(fat12_t *fat)
+{
+	if (!add_root_nodes(fat))
+	{
+		return 0;
+	}
+
+	//Reused for every directory
+	extent_list_t extents = { NULL, 0, 0 };
+	uint8_t ok = 1;
+	uint32_t n;
+	//num_nodes grows as subdirectories are read, which is what makes this
+	//breadth first
+	for (n = 0; ok && n < fat->num_nodes; n++)
+	{
+		if (is_directory(&fat->nodes[n].entry))
+		{
+			fat->nodes[n].first_child = fat->num_nodes;
+			ok = read_subdirectory(fat, n, &extents);
+			fat->nodes[n].child_count = fat->num_nodes - fat->nodes[n].first_child;
+		}
+	}
+	free_extents(&extents);
+
+	return ok && build_path_index(fat);
+}
+
+//Adds the entries of the directory at node dir. A directory that can't be
+//read (a broken chain, or one leading back to a directory it's inside of) is
+//left empty rather than failing the whole image; only running out of memory
+//does that.
+uint8_t read_subdirectory(fat12_t *fat, uint32_t dir, extent_list_t *extents)
+{
+	uint32_t cluster = fat->nodes[dir].entry.start_cluster;
+
+	uint32_t ancestor;
+	for (ancestor = fat->nodes[dir].parent; ancestor != NO_NODE; ancestor = fat->nodes[ancestor].parent)
+	{
+		if (fat->nodes[ancestor].entry.start_cluster == cluster)
+		{
+			return 1;
+		}
+	}
+
+	if (!build_extents(fat, cluster, extents))
+	{
+		return 1;
+	}
+
+	size_t e;
+	for (e = 0; e < extents->count; e++)
+	{
+		extent_t *extent = extents->extents + e;
+		uint64_t offset = fat->data_offset + (uint64_t) (extent->start_cluster - 2) * fat->cluster_size;
+		uint64_t size = (uint64_t) extent->clusters * fat->cluster_size;
+		if (!image_has(fat, offset, size))
+		{
+			return 1;
+		}
+
+		uint8_t ended = 0;
+		if (!read_directory_block(fat, fat->image + offset, size, dir, &ended))
+		{
+			return 0;
+		}
+
+		if (ended)
+		{
+			return 1;
+		}
+	}
+
+	return 1;
+}
+
+//Adds the entries in the size bytes at src, part of the directory at node
+//parent (NO_NODE for a FAT32 root directory), as its children. Sets ended on
+//reaching a free entry, since nothing in the directory follows one. Returns 0
+//only if it runs out of memory.
+uint8_t read_directory_block(fat12_t *fat, const uint8_t *src, uint64_t size, uint32_t parent, uint8_t *ended)
+{
+	uint64_t i;
+	for (i = 0; i + DIR_ENTRY_MEMBER_SIZE <= size; i += DIR_ENTRY_MEMBER_SIZE)
+	{
+		direntry_t entry;
+		read_directory_entry(fat, src + i, &entry);
+
+		if (is_entry_free(&entry))
+		{
+			*ended = 1;
+			return 1;
+		}
+
+		//read_fat12_head leaves room for the one entry
+		if (parent == NO_NODE && is_volume_label(&entry) && fat->volume_label == NULL)
+		{
+			fat->root_dir_entries[0] = entry;
+			fat->volume_label = fat->root_dir_entries;
+		}
+
+		if (is_regular_entry(&entry) && !is_dot_entry(&entry) && !add_node(fat, &entry, parent))
+		{
+			return 0;
+		}
+
+		if (parent == NO_NODE)
+		{
+			fat->num_root_nodes = fat->num_nodes;
+		}
+	}
+
+	return 1;
+}
+
+//Puts nodes that were added in whatever order their directories turned up in
+//(parents still before children) into the order read_directory_tree leaves
+//them in: breadth first, with every directory's children together. Then
+//indexes their paths.
+uint8_t order_fat12_tree(fat12_t *fat)
+{
+	uint32_t count = fat->num_nodes;
+	//Nodes grouped by parent: group 0 is the root's children and group n + 1
+	//node n's, each in the order they were added
+	uint32_t *group_start = calloc(count + 2, sizeof *group_start);
+	uint32_t *grouped = malloc(count * sizeof *grouped);
+	//New place to old index, and back
+	uint32_t *order = malloc(count * sizeof *order);
+	uint32_t *new_index = malloc(count * sizeof *new_index);
+	fat_node_t *nodes = malloc(count * sizeof *nodes);
+	if (group_start == NULL ||
+		(count > 0 && (grouped == NULL || order == NULL || new_index == NULL || nodes == NULL)))
+	{
+		free(group_start);
+		free(grouped);
+		free(order);
+		free(new_index);
+		free(nodes);
+		return 0;
+	}
+
+	uint32_t n, i;
+	for (n = 0; n < count; n++)
+	{
+		uint32_t parent = fat->nodes[n].parent;
+		group_start[(parent == NO_NODE ? 0 : parent + 1) + 1]++;
+	}
+	for (n = 1; n < count + 2; n++)
+	{
+		group_start[n] += group_start[n - 1];
+	}
+
+	//Filling a group moves its start up to where the next one starts, so
+	//they're all shifted back down after
+	for (n = 0; n < count; n++)
+	{
+		uint32_t parent = fat->nodes[n].parent;
+		new_index[n] = group_start[parent == NO_NODE ? 0 : parent + 1]++;
+		grouped[new_index[n]] = n;
+	}
+	for (n = count + 1; n > 0; n--)
+	{
+		group_start[n] = group_start[n - 1];
+	}
+	group_start[0] = 0;
+
+	uint32_t placed = 0;
+	for (i = group_start[0]; i < group_start[1]; i++)
+	{
+		order[placed++] = grouped[i];
+	}
+	for (n = 0; n < placed; n++)
+	{
+		uint32_t group = order[n] + 1;
+		for (i = group_start[group]; i < group_start[group + 1]; i++)
+		{
+			order[placed++] = grouped[i];
+		}
+	}
+
+	for (n = 0; n < count; n++)
+	{
+		new_index[order[n]] = n;
+	}
+
+	uint32_t next_child = group_start[1];
+	for (n = 0; n < count; n++)
+	{
+		fat_node_t *node = nodes + n;
+		uint32_t group = order[n] + 1;
+		*node = fat->nodes[order[n]];
+		if (node->parent != NO_NODE)
+		{
+			node->parent = new_index[node->parent];
+		}
+		node->child_count = group_start[group + 1] - group_start[group];
+		node->first_child = is_directory(&node->entry) ? next_child : 0;
+		next_child += node->child_count;
+	}
+
+	free(fat->nodes);
+	fat->nodes = nodes;
+	fat->nodes_capacity = count;
+	fat->num_root_nodes = group_start[1];
+
+	free(group_start);
+	free(grouped);
+	free(order);
+	free(new_index);
+	return build_path_index(fat);
+}
+
+uint8_t add_node(fat12_t *fat, direntry_t *entry, uint32_t parent)
+{
+	char name[MAX_FILE_NAME + 1 + MAX_EXTENSION + 1];
+	size_t name_len = format_entry_name(entry, name);
+
+	//An entry whose name would step out of its directory isn't indexed, so
+	//nothing can be listed or extracted through it
+	if (!is_safe_name(name))
+	{
+		return 1;
+	}
+
+	if (fat->num_nodes == fat->nodes_capacity)
+	{
+		uint32_t new_capacity = fat->nodes_capacity ? fat->nodes_capacity * 2 : 64;
+		fat_node_t *tmp = realloc(fat->nodes, new_capacity * sizeof *tmp);
+		if (tmp == NULL)
+		{
+			return 0;
+		}
+		fat->nodes = tmp;
+		fat->nodes_capacity = new_capacity;
+	}
+
+	//parent's path, '/', name
+	size_t parent_len = parent == NO_NODE ? 0 : strlen(fat->nodes[parent].path) + 1;
+	char *path = malloc(parent_len + name_len + 1);
+	if (path == NULL)
+	{
+		return 0;
+	}
+
+	if (parent != NO_NODE)
+	{
+		memcpy(path, fat->nodes[parent].path, parent_len - 1);
+		path[parent_len - 1] = '/';
+	}
+	memcpy(path + parent_len, name, name_len + 1);
+
+	if (parent_len + name_len > fat->max_path_len)
+	{
+		fat->max_path_len = parent_len + name_len;
+	}
+
+	fat_node_t *node = fat->nodes + fat->num_nodes;
+	node->path = path;
+	node->entry = *entry;
+	node->parent = parent;
+	node->first_child = 0;
+	node->child_count = 0;
+	fat->num_nodes++;
+	return 1;
+}
+
+//32-bit FNV-1a
+uint32_t hash_path(const char *path)
+{
+	uint32_t hash = 2166136261u;
+	for (; *path != '\0'; path++)
+	{
+		hash = (hash ^ (uint8_t) *path) * 16777619u;
+	}
+
+	return hash;
+}
+
+uint8_t build_path_index(fat12_t *fat)
+{
+	//At most half full, and a power of two so a mask picks the slot
+	uint32_t size = 16;
+	while (size < fat->num_nodes * 2)
+	{
+		size *= 2;
+	}
+
+	fat->path_index = calloc(size, sizeof *fat->path_index);
+	if (fat->path_index == NULL)
+	{
+		return 0;
+	}
+	fat->path_index_size = size;
+
+	uint32_t n;
+	for (n = 0; n < fat->num_nodes; n++)
+	{
+		uint32_t slot = hash_path(fat->nodes[n].path) & (size - 1);
+		while (fat->path_index[slot] != 0)
+		{
+			slot = (slot + 1) & (size - 1);
+		}
+		fat->path_index[slot] = n + 1;
+	}
+
+	return 1;
+}
+
+//Returns the node at path, or NO_NODE if there isn't one. Names are matched
+//without regard to case, as DOS does, and leading and trailing slashes are
+//ignored.
+uint32_t find_path(fat12_t *fat, const char *path)
+{
+	while (*path == '/')
+	{
+		path++;
+	}
+
+	size_t len = strlen(path);
+	while (len > 0 && path[len - 1] == '/')
+	{
+		len--;
+	}
+
+	if (len == 0 || len > fat->max_path_len)
+	{
+		return NO_NODE;
+	}
+
+	char key[len + 1];
+	size_t i;
+	for (i = 0; i < len; i++)
+	{
+		key[i] = toupper((unsigned char) path[i]);
+	}
+	key[len] = '\0';
+
+	uint32_t mask = fat->path_index_size - 1;
+	uint32_t slot = hash_path(key) & mask;
+	while (fat->path_index[slot] != 0)
+	{
+		uint32_t n = fat->path_index[slot] - 1;
+		if (strcmp(fat->nodes[n].path, key) == 0)
+		{
+			return n;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return NO_NODE;
+}
+
 void print_fat12(fat12_t *fat)
 {
 	print_volume_data(fat);
@@ -279,6 +929,12 @@ void print_fat12(fat12_t *fat)
 
 void print_volume_data(fat12_t *fat)
 {
+	if (fat->volume_label == NULL)
+	{
+		printf("Volume has no label\n");
+		return;
+	}
+
 	printf("Volume name is ");
 	PRINT_ARRAY(fat->volume_label->filename);
 	PRINT_ARRAY_NL(fat->volume_label->extension);
@@ -286,23 +942,38 @@ void print_volume_data(fat12_t *fat)
 
 void print_file_data(fat12_t *fat)
 {
-	uint32_t total_files = 0, total_size = 0;
-	int i;
-	for (i = 0;
-	     i < fat->boot.max_root_dir_entries &&
-	     !is_entry_free(fat->root_dir_entries + i);
-	     i++)
+	uint32_t total_files = 0;
+	uint64_t total_size = 0;
+	print_directory_listing(fat, 0, fat->num_root_nodes, &total_files, &total_size);
+
+	//Breadth first, so subdirectories come out level by level
+	uint32_t i;
+	for (i = 0; i < fat->num_nodes; i++)
 	{
-		direntry_t *entry = fat->root_dir_entries + i;
-		if (is_regular_entry(entry))
+		fat_node_t *node = fat->nodes + i;
+		if (is_directory(&node->entry) && node->child_count > 0)
 		{
-			print_single_file_data(entry);
-			total_files++;
-			total_size += entry->filesize;
+			printf("\nDirectory of %s\n\n", node->path);
+			print_directory_listing(fat, node->first_child, node->child_count, &total_files, &total_size);
 		}
 	}
 
-	printf("\n%u file(s), %u bytes\n", total_files, total_size);
+	printf("\n%u file(s), %llu bytes\n", total_files, (unsigned long long) total_size);
+}
+
+void print_directory_listing(fat12_t *fat, uint32_t first, uint32_t count, uint32_t *total_files, uint64_t *total_size)
+{
+	uint32_t i;
+	for (i = first; i < first + count; i++)
+	{
+		direntry_t *entry = &fat->nodes[i].entry;
+		print_single_file_data(entry);
+		if (!is_directory(entry))
+		{
+			(*total_files)++;
+			*total_size += entry->filesize;
+		}
+	}
 }
 
 void print_single_file_data(direntry_t *entry)
@@ -311,9 +982,17 @@ void print_single_file_data(direntry_t *entry)
 	printf(".");
 	PRINT_ARRAY(entry->extension);
 
+	if (is_directory(entry))
+	{
+		printf(" %10s", "<DIR>");
+	}
+	else
+	{
+		printf(" %10u", entry->filesize);
+	}
+
 	uint16_t date = entry->date, time = entry->time;
-	printf(" %10u %02u-%02u-%02u %02u:%02u:%02u\n",
-		entry->filesize,
+	printf(" %02u-%02u-%02u %02u:%02u:%02u\n",
 		MASK_AND_SHIFT(date, MONTH),
 		MASK_AND_SHIFT(date, DAY),
 		MASK_AND_SHIFT(date, YEAR) + BASE_YEAR,
@@ -322,118 +1001,470 @@ void print_single_file_data(direntry_t *entry)
 		MASK_AND_SHIFT(time, SECONDS));
 }
 
+uint8_t print_path(fat12_t *fat, const char *path)
+{
+	uint32_t node = find_path(fat, path);
+	if (node == NO_NODE)
+	{
+		return 0;
+	}
+
+	fat_node_t *found = fat->nodes + node;
+	if (!is_directory(&found->entry))
+	{
+		print_single_file_data(&found->entry);
+		return 1;
+	}
+
+	uint32_t total_files = 0;
+	uint64_t total_size = 0;
+	printf("Directory of %s\n\n", found->path);
+	print_directory_listing(fat, found->first_child, found->child_count, &total_files, &total_size);
+	printf("\n%u file(s), %llu bytes\n", total_files, (unsigned long long) total_size);
+	return 1;
+}
+
 void free_fat12(fat12_t *fat)
 {
 	free(fat->fat_entries);
 	free(fat->root_dir_entries);
+	uint32_t i;
+	for (i = 0; i < fat->num_nodes; i++)
+	{
+		free(fat->nodes[i].path);
+	}
+	free(fat->nodes);
+	free(fat->path_index);
+	if (fat->image != NULL && fat->image_mapped)
+	{
+		munmap(fat->image, fat->image_size);
+	}
+	else
+	{
+		free(fat->image);
+	}
 }
 
-void extract_files(int fd, fat12_t *fat, char *out_dir)
+//Returns how many files and directories couldn't be written. Each one has
+//already been reported on stderr.
+uint32_t extract_files(fat12_t *fat, char *out_dir, uint32_t selected, int threads, extract_options_t *options)
+{
+	size_t dir_len;
+	char *full_name = make_output_name(fat, out_dir, &dir_len);
+	if (full_name == NULL)
+	{
+		return 1;
+	}
+
+	uint32_t failures = 0;
+
+	//Directories go first and one at a time, since each one's parent has to
+	//exist before it can be made. Parents always come before their children,
+	//so order is enough. The selected node's parents are made too, so the
+	//output keeps the same layout as the image.
+	uint32_t i;
+	for (i = 0; i < fat->num_nodes; i++)
+	{
+		fat_node_t *node = fat->nodes + i;
+		if (is_directory(&node->entry) &&
+			(is_within(fat, i, selected) || is_within(fat, selected, i)))
+		{
+			strcpy(full_name + dir_len, node->path);
+			if (mkdir(full_name, 0755) < 0 && errno != EEXIST)
+			{
+				fprintf(stderr, "Could not create directory with name %s\n", full_name);
+				failures++;
+			}
+		}
+	}
+
+	//A single file doesn't need the pool
+	if (selected != NO_NODE && !is_directory(&fat->nodes[selected].entry))
+	{
+		extent_list_t extents = { NULL, 0, 0 };
+		failures += !extract_single_file(fat, selected, full_name, dir_len, &extents, options);
+		free_extents(&extents);
+		free(full_name);
+		return failures;
+	}
+	free(full_name);
+
+	extract_job_t job = { fat, out_dir, selected, 0, options, failures };
+
+	if (threads > 0 && (uint32_t) threads > fat->num_nodes)
+	{
+		threads = fat->num_nodes;
+	}
+
+	if (threads <= 1)
+	{
+		extract_worker(&job);
+		return job.failures;
+	}
+
+	pthread_t *workers = malloc((threads - 1) * sizeof *workers);
+	if (workers == NULL)
+	{
+		fprintf(stderr, "Could not allocate memory.\n");
+		return job.failures + 1;
+	}
+
+	//The calling thread works too, so even if no more threads can be started
+	//everything still gets extracted
+	int started;
+	for (started = 0; started < threads - 1; started++)
+	{
+		if (pthread_create(workers + started, NULL, extract_worker, &job) != 0)
+		{
+			break;
+		}
+	}
+
+	extract_worker(&job);
+
+	for (i = 0; i < (uint32_t) started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	free(workers);
+	return job.failures;
+}
+
+//Returns a buffer holding out_dir and a '/', with room after it for the
+//longest path in the image. dir_len is set to where the path goes.
+char *make_output_name(fat12_t *fat, char *out_dir, size_t *dir_len)
 {
 	//plus one for '/'
-	size_t dir_len = strlen(out_dir) + 1;
-	//directory name, file name, '.', extension, '\0'
-	size_t full_len = dir_len + MAX_FILE_NAME + 1 + MAX_EXTENSION + 1;
-	char *full_name = malloc(full_len * sizeof *full_name);
+	*dir_len = strlen(out_dir) + 1;
+	//directory name, path, '\0'
+	char *full_name = malloc((*dir_len + fat->max_path_len + 1) * sizeof *full_name);
 	if (full_name == NULL)
 	{
-		printf("Could not allocate memory.\n");
-		return;
+		fprintf(stderr, "Could not allocate memory.\n");
+		return NULL;
 	}
+
 	strcpy(full_name, out_dir);
-	full_name[dir_len - 1] = '/'; //in case the user forgot to add one
-	full_name[dir_len] = '\0';
+	full_name[*dir_len - 1] = '/'; //in case the user forgot to add one
+	full_name[*dir_len] = '\0';
+	return full_name;
+}
 
-	uint16_t i = 0;
-	while (fat->boot.max_root_dir_entries &&
-	       !is_entry_free(fat->root_dir_entries + i))
+//Takes nodes off the shared job one at a time until there are none left.
+//Every file is written independently from the read-only mapping, and the
+//directories already exist, so the next node index is the only thing the
+//workers share.
+void *extract_worker(void *arg)
+{
+	extract_job_t *job = arg;
+	fat12_t *fat = job->fat;
+
+	size_t dir_len;
+	char *full_name = make_output_name(fat, job->out_dir, &dir_len);
+	if (full_name == NULL)
+	{
+		//The other workers still take every node, but with one worker
+		//nothing gets written
+		__atomic_fetch_add(&job->failures, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	//Reused for every file, so it only grows as far as the most fragmented one
+	extent_list_t extents = { NULL, 0, 0 };
+
+	for (;;)
 	{
-		if (is_regular_entry(fat->root_dir_entries + i))
+		uint32_t i = __atomic_fetch_add(&job->next_node, 1, __ATOMIC_RELAXED);
+		if (i >= fat->num_nodes)
 		{
-			extract_single_file(fd, fat, i, full_name, dir_len);
+			break;
+		}
+
+		fat_node_t *node = fat->nodes + i;
+		if (!is_directory(&node->entry) && is_within(fat, i, job->selected) &&
+			!extract_single_file(fat, i, full_name, dir_len, &extents, job->options))
+		{
+			__atomic_fetch_add(&job->failures, 1, __ATOMIC_RELAXED);
 		}
-		i++;
 	}
 
+	free_extents(&extents);
 	free(full_name);
+	return NULL;
 }
 
-void extract_single_file(int fd, fat12_t *fat, uint16_t i, char *full_name, size_t dirlen)
+//Whether node is ancestor or somewhere under it. Everything is within
+//NO_NODE, the root.
+uint8_t is_within(fat12_t *fat, uint32_t node, uint32_t ancestor)
 {
-	direntry_t *entry = fat->root_dir_entries + i;
+	if (ancestor == NO_NODE)
+	{
+		return 1;
+	}
 
-	unsigned int permissions;
+	for (; node != NO_NODE; node = fat->nodes[node].parent)
+	{
+		if (node == ancestor)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+//The mode an extracted file ends up with: read only files can't be written
+//to by anyone
+unsigned int file_permissions(direntry_t *entry)
+{
 	if (entry->attributes & READ_ONLY)
 	{
-		permissions = 0444;
+		return 0444;
 	}
-	else
+
+	return 0644;
+}
+
+//Returns whether the file was written, or could be left as it was
+uint8_t extract_single_file(fat12_t *fat, uint32_t n, char *full_name, size_t dirlen, extent_list_t *extents, extract_options_t *options)
+{
+	direntry_t *entry = &fat->nodes[n].entry;
+	unsigned int permissions = file_permissions(entry);
+
+	strcpy(full_name + dirlen, fat->nodes[n].path);
+
+	uint8_t has_data = entry->start_cluster != 0 && entry->filesize != 0;
+	uint8_t chain_ok = !has_data || build_extents(fat, entry->start_cluster, extents);
+
+	if (options != NULL)
 	{
-		permissions = 0644;
+		if (options->hashed[n] && chain_ok &&
+			is_unchanged(fat, entry, full_name, extents, options->hashes[n], options->crcs + n))
+		{
+			__atomic_fetch_add(&options->skipped, 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+		options->hashed[n] = 0;
 	}
 
-	const size_t filename_size = sizeof(entry->filename);
-	const size_t extension_size = sizeof(entry->extension);
-	char *file_start = full_name + dirlen;
+	int outFd = open(full_name, O_CREAT | O_TRUNC | O_WRONLY, permissions);
+	if (outFd < 0)
+	{
+		fprintf(stderr, "Could not create file with name %s\n", full_name);
+		return 0;
+	}
 
-	size_t last_nonspace = filename_size - 1;
-	while (last_nonspace >= 0 && entry->filename[last_nonspace] == ' ')
+	if (!chain_ok)
 	{
-		last_nonspace--;
+		fprintf(stderr, "Cluster chain of %s is corrupt\n", full_name);
+		close(outFd);
+		return 0;
 	}
-	size_t nospace_name_size = last_nonspace + 1;
-	memcpy(file_start, entry->filename, nospace_name_size);
 
-	char empty_extension[extension_size];
-	memset(empty_extension, ' ', extension_size);
+	//The checksums are taken on the way out, so they cost no extra pass over
+	//the data
+	file_hash_t hash;
+	file_hash_init(&hash);
 
-	if (memcmp(entry->extension, empty_extension, extension_size) != 0)
+	uint32_t remaining = 0;
+	uint8_t written = 1;
+	if (has_data)
 	{
-		memcpy(file_start + nospace_name_size, ".", 1);
-		memcpy(file_start + nospace_name_size + 1, entry->extension, extension_size);
-		file_start[nospace_name_size + 1 + extension_size] = '\0';
+		written = copy_file_data(fat, entry, extents, outFd, options != NULL ? &hash : NULL, &remaining);
+		if (!written)
+		{
+			fprintf(stderr, "Could not write file with name %s\n", full_name);
+		}
+
+		if (remaining > 0)
+		{
+			fprintf(stderr, "%s is shorter than its directory entry says\n", full_name);
+		}
 	}
-	else
+
+	if (options != NULL && written && remaining == 0)
 	{
-		file_start[nospace_name_size] = '\0';
+		options->hashes[n] = xxh64_digest(&hash.xxh64);
+		options->crcs[n] = hash.crc32;
+		options->hashed[n] = 1;
 	}
 
-	int outFd = open(full_name, O_CREAT | O_TRUNC | O_WRONLY, permissions);
-	if (outFd < 0)
+	close(outFd);
+	return written && remaining == 0;
+}
+
+//Whether the output at full_name is the right size and the file's data in the
+//image still hashes to hash. The output itself isn't read back; only its size
+//is checked, so a file that was edited in place without changing its size
+//isn't noticed. crc is set to the data's CRC32 either way.
+uint8_t is_unchanged(fat12_t *fat, direntry_t *entry, const char *full_name, extent_list_t *extents, uint64_t hash, uint32_t *crc)
+{
+	struct stat file_stat;
+	if (stat(full_name, &file_stat) < 0 || !S_ISREG(file_stat.st_mode) ||
+		(uint64_t) file_stat.st_size != entry->filesize)
 	{
-		printf("Could not create file with name %s\n", full_name);
-		return;
+		return 0;
 	}
 
-	uint16_t cluster = entry->start_cluster;
-	if (cluster != 0)
+	file_hash_t data_hash;
+	file_hash_init(&data_hash);
+
+	uint32_t remaining = 0;
+	if (entry->start_cluster != 0 && entry->filesize != 0)
 	{
-		boot_t *boot = &fat->boot;
-		uint32_t base_address =
-			(boot->reserved_sectors + boot->sectors_per_fat * boot->fat_copies) * boot->bytes_per_sector +
-			boot->max_root_dir_entries * DIR_ENTRY_MEMBER_SIZE;
+		copy_file_data(fat, entry, extents, -1, &data_hash, &remaining);
+	}
 
-		uint32_t cluster_size = boot->bytes_per_sector * boot->sectors_per_cluster;
+	*crc = data_hash.crc32;
+	return remaining == 0 && xxh64_digest(&data_hash.xxh64) == hash;
+}
 
-		uint8_t last_cluster;
-		do
+//Sends the file's data from the mapping to fd (unless it's negative) and to
+//hash (unless it's NULL), one extent at a time. The last extent stops at the
+//file size rather than the end of its cluster. remaining is set to however
+//much of the file the image didn't hold. Fails only if a write does.
+uint8_t copy_file_data(fat12_t *fat, direntry_t *entry, extent_list_t *extents, int fd, file_hash_t *hash, uint32_t *remaining)
+{
+	*remaining = entry->filesize;
+	size_t e;
+	for (e = 0; e < extents->count && *remaining > 0; e++)
+	{
+		extent_t *extent = extents->extents + e;
+		uint64_t offset = fat->data_offset + (uint64_t) (extent->start_cluster - 2) * fat->cluster_size;
+		uint64_t size = (uint64_t) extent->clusters * fat->cluster_size;
+		if (size > *remaining)
 		{
-			uint16_t next_cluster = fat->fat_entries[cluster - 2];
-			last_cluster = next_cluster == fat->eof_marker;
-			uint32_t write_size = last_cluster ? entry->filesize % cluster_size : cluster_size;
+			size = *remaining;
+		}
 
-			write_cluster(fd, outFd, base_address, cluster, cluster_size, write_size);
+		if (!image_has(fat, offset, size))
+		{
+			break;
+		}
 
-			cluster = next_cluster;
-		} while (!last_cluster);
+		if (fd >= 0)
+		{
+			if (!write_hashed(fd, fat->image + offset, size, hash))
+			{
+				return 0;
+			}
+		}
+		else
+		{
+			file_hash_update(hash, fat->image + offset, size);
+		}
+		*remaining -= size;
 	}
+
+	return 1;
 }
 
-void write_cluster(int fatFd, int outFd, uint32_t base_address, uint16_t
-	cluster, uint32_t cluster_size, uint32_t write_size)
+uint8_t is_end_of_chain(fat12_t *fat, uint32_t cluster)
 {
-	lseek(fatFd, base_address + cluster_size * (cluster - 2), SEEK_SET);
-	char *buff = malloc(cluster_size * sizeof *buff);
-	read(fatFd, buff, cluster_size);
-	write(outFd, buff, write_size);
+	//0xff8-0xfff all mark the end of a FAT12 chain, and the same goes for the
+	//other widths
+	return cluster >= fat->ops->end_of_chain || cluster == fat->eof_marker;
+}
+
+//Turns the cluster chain starting at cluster into runs of physically
+//contiguous clusters, reusing list's array. Fails on a chain that leaves the
+//FAT or is longer than the FAT (and so has to loop).
+uint8_t build_extents(fat12_t *fat, uint32_t cluster, extent_list_t *list)
+{
+	list->count = 0;
+
+	uint32_t visited = 0;
+	for (;;)
+	{
+		if (cluster < 2 || cluster - 2 >= fat->num_fat_entries ||
+			visited++ >= fat->num_fat_entries)
+		{
+			return 0;
+		}
+
+		extent_t *last = list->count > 0 ? list->extents + list->count - 1 : NULL;
+		if (last != NULL && last->start_cluster + last->clusters == cluster)
+		{
+			last->clusters++;
+		}
+		else
+		{
+			if (list->count == list->capacity)
+			{
+				size_t new_capacity = list->capacity ? list->capacity * 2 : 16;
+				extent_t *tmp = realloc(list->extents, new_capacity * sizeof *tmp);
+				if (tmp == NULL)
+				{
+					return 0;
+				}
+				list->extents = tmp;
+				list->capacity = new_capacity;
+			}
+
+			list->extents[list->count].start_cluster = cluster;
+			list->extents[list->count].clusters = 1;
+			list->count++;
+		}
+
+		uint32_t next_cluster = fat->ops->get(fat, cluster);
+		if (is_end_of_chain(fat, next_cluster))
+		{
+			return 1;
+		}
+		cluster = next_cluster;
+	}
+}
+
+void free_extents(extent_list_t *list)
+{
+	free(list->extents);
+	list->extents = NULL;
+	list->count = list->capacity = 0;
+}
+
+//Writes buff out, hashing it a piece at a time just before each piece is
+//written so it's still in cache for the write. An unhashed write goes out
+//whole.
+uint8_t write_hashed(int fd, const uint8_t *buff, size_t n, file_hash_t *hash)
+{
+	if (hash == NULL)
+	{
+		return write_all(fd, buff, n);
+	}
+
+	while (n > 0)
+	{
+		size_t piece = n < HASH_PIECE_SIZE ? n : HASH_PIECE_SIZE;
+		file_hash_update(hash, buff, piece);
+		if (!write_all(fd, buff, piece))
+		{
+			return 0;
+		}
+		buff += piece;
+		n -= piece;
+	}
+
+	return 1;
+}
+
+uint8_t write_all(int fd, const uint8_t *buff, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t written = write(fd, buff, n);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (written <= 0)
+		{
+			return 0;
+		}
+		buff += written;
+		n -= written;
+	}
+
+	return 1;
 }
@@ -0,0 +1,99 @@
+#include <stdint.h>
+
+#include "fat12_entries.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+//Entries come in pairs packed into 3 bytes:
+//	byte 0: low 8 bits of entry 0
+//	byte 1: high 4 bits of entry 0 in the low nibble, low 4 bits of entry 1
+//	        in the high nibble
+//	byte 2: high 8 bits of entry 1
+void decode_fat12_entries_scalar(const uint8_t *src, uint16_t *dst, size_t count);
+#ifdef HAVE_X86_SIMD
+void decode_fat12_entries_ssse3(const uint8_t *src, uint16_t *dst, size_t count);
+#endif
+
+void decode_fat12_entries_scalar(const uint8_t *src, uint16_t *dst, size_t count)
+{
+	size_t i;
+	for (i = 0; i + 1 < count; i += 2, src += 3)
+	{
+		dst[i] = (((uint16_t) src[1] & 0x0f) << 8) | src[0];
+		dst[i + 1] = ((uint16_t) src[2] << 4) | ((src[1] & 0xf0) >> 4);
+	}
+
+	if (i < count)
+	{
+		dst[i] = (((uint16_t) src[1] & 0x0f) << 8) | src[0];
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+//Eight entries (12 bytes) per iteration. A shuffle puts the two bytes each
+//entry straddles into its own 16-bit lane; then even lanes only need their top
+//nibble masked off and odd lanes only need shifting down by a nibble.
+__attribute__((target("ssse3")))
+void decode_fat12_entries_ssse3(const uint8_t *src, uint16_t *dst, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i even_lanes = _mm_set1_epi32(0x00000fff);
+	const __m128i odd_lanes = _mm_set1_epi32(0x0fff0000);
+
+	size_t i = 0;
+	//Each load reads 16 bytes but only uses 12, so stop while there are still
+	//16 readable bytes left
+	while (count - i >= 8 && FAT12_PACKED_SIZE(count - i) >= 16)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i *) src);
+		__m128i lanes = _mm_shuffle_epi8(packed, shuffle);
+		__m128i even = _mm_and_si128(lanes, even_lanes);
+		__m128i odd = _mm_and_si128(_mm_srli_epi16(lanes, 4), odd_lanes);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(even, odd));
+
+		src += 12;
+		i += 8;
+	}
+
+	decode_fat12_entries_scalar(src, dst + i, count - i);
+}
+#endif
+
+void decode_fat12_entries(const uint8_t *src, uint16_t *dst, size_t count)
+{
+#ifdef HAVE_X86_SIMD
+	static int has_ssse3 = -1;
+	if (has_ssse3 < 0)
+	{
+		has_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+	}
+
+	if (has_ssse3)
+	{
+		decode_fat12_entries_ssse3(src, dst, count);
+		return;
+	}
+#endif
+
+	decode_fat12_entries_scalar(src, dst, count);
+}
+
+void encode_fat12_entries(const uint16_t *src, uint8_t *dst, size_t count)
+{
+	size_t i;
+	for (i = 0; i + 1 < count; i += 2, dst += 3)
+	{
+		dst[0] = src[i] & 0xff;
+		dst[1] = ((src[i] >> 8) & 0x0f) | ((src[i + 1] & 0x0f) << 4);
+		dst[2] = (src[i + 1] >> 4) & 0xff;
+	}
+
+	if (i < count)
+	{
+		dst[0] = src[i] & 0xff;
+		dst[1] = (dst[1] & 0xf0) | ((src[i] >> 8) & 0x0f);
+	}
+}
@@ -0,0 +1,407 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fat_check.h"
+
+//What stopped a chain walk
+#define CHAIN_OK 0
+#define CHAIN_OUT_OF_RANGE 1
+#define CHAIN_FREE_CLUSTER 2
+#define CHAIN_LOOP 3
+#define CHAIN_CROSS_LINKED 4
+
+//Owner ids are 0 for unclaimed, 1 for the FAT32 root directory, which has no
+//node, and node + 2 for everything else. A cluster more than one chain reaches
+//belongs to the lowest of them.
+#define ROOT_OWNER 1
+#define NODE_OWNER(n) ((n) + 2)
+
+typedef struct
+{
+	uint8_t problem;
+	//Where the walk stopped, and for a cross-link, whose cluster it was
+	uint32_t cluster;
+	uint32_t other;
+	//How many clusters the walk claimed, or for a cross-linked chain, how many
+	//the whole chain has
+	uint32_t length;
+	//Whether a cross-linked chain still ends properly, so its size can be
+	//checked
+	uint8_t whole;
+} chain_result_t;
+
+typedef struct
+{
+	fat12_t *fat;
+	//One per cluster: the lowest owner whose chain reaches it
+	uint32_t *owners;
+	chain_result_t *results;
+	uint32_t next_node;
+} check_job_t;
+
+void run_workers(check_job_t *job, int threads, void *(*worker)(void *));
+void walk_chain(check_job_t *job, uint32_t start, uint32_t owner, chain_result_t *result);
+void resolve_chain(check_job_t *job, uint32_t start, uint32_t owner, chain_result_t *result);
+void *check_worker(void *arg);
+void *resolve_worker(void *arg);
+uint8_t report_chain(fat12_t *fat, const char *path, direntry_t *entry, chain_result_t *result);
+uint32_t report_lost_clusters(check_job_t *job);
+
+//Checks every cluster chain in the image, in parallel across threads, and
+//prints each problem found: chains that loop, leave the FAT or run into a free
+//cluster, chains that share clusters (cross-links), files whose chains don't
+//match their size, and allocated clusters no chain reaches (lost clusters).
+//What's reported doesn't depend on how the work was spread over threads: of
+//two cross-linked chains, the one found later in the tree is reported. Returns
+//the number of problems.
+uint32_t check_fat12(fat12_t *fat, int threads)
+{
+	check_job_t job = { fat, NULL, NULL, 0 };
+	job.owners = calloc(fat->num_fat_entries, sizeof *job.owners);
+	job.results = calloc(fat->num_nodes, sizeof *job.results);
+	if (job.owners == NULL || (job.results == NULL && fat->num_nodes > 0))
+	{
+		printf("Could not allocate memory.\n");
+		free(job.owners);
+		free(job.results);
+		return 1;
+	}
+
+	uint32_t problems = 0;
+	if (fat->ops->bits == 32)
+	{
+		chain_result_t root;
+		//It owns everything it reaches, so it's never the one cross-linked
+		walk_chain(&job, fat->boot.root_cluster, ROOT_OWNER, &root);
+		problems += report_chain(fat, "/", NULL, &root);
+	}
+
+	if (threads > 0 && (uint32_t) threads > fat->num_nodes)
+	{
+		threads = fat->num_nodes;
+	}
+
+	//Which chain owns a shared cluster is only settled once every chain has
+	//been walked, so cross-links are found in a second pass
+	run_workers(&job, threads, check_worker);
+	job.next_node = 0;
+	run_workers(&job, threads, resolve_worker);
+
+	//Reported in tree order, whatever order the workers finished in
+	uint32_t directories = 0, n;
+	for (n = 0; n < fat->num_nodes; n++)
+	{
+		fat_node_t *node = fat->nodes + n;
+		if (is_directory(&node->entry))
+		{
+			directories++;
+		}
+		problems += report_chain(fat, node->path, &node->entry, job.results + n);
+	}
+
+	problems += report_lost_clusters(&job);
+
+	printf("\n%u file(s) and %u directories checked, ", fat->num_nodes - directories, directories);
+	if (problems == 0)
+	{
+		printf("no problems found\n");
+	}
+	else
+	{
+		printf("%u problem(s) found\n", problems);
+	}
+
+	free(job.owners);
+	free(job.results);
+	return problems;
+}
+
+//Runs worker over the job on threads threads. The calling thread works too,
+//so even if no more threads can be started everything still gets done.
+void run_workers(check_job_t *job, int threads, void *(*worker)(void *))
+{
+	pthread_t *workers = NULL;
+	int started = 0;
+	if (threads > 1)
+	{
+		workers = malloc((threads - 1) * sizeof *workers);
+	}
+
+	if (workers != NULL)
+	{
+		for (started = 0; started < threads - 1; started++)
+		{
+			if (pthread_create(workers + started, NULL, worker, job) != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	worker(job);
+
+	int t;
+	for (t = 0; t < started; t++)
+	{
+		pthread_join(workers[t], NULL);
+	}
+	free(workers);
+}
+
+//Takes nodes off the shared job one at a time until there are none left. The
+//FAT is only read, and clusters are claimed with a compare and swap, so chains
+//can be walked in any order on any thread.
+void *check_worker(void *arg)
+{
+	check_job_t *job = arg;
+	fat12_t *fat = job->fat;
+
+	for (;;)
+	{
+		uint32_t n = __atomic_fetch_add(&job->next_node, 1, __ATOMIC_RELAXED);
+		if (n >= fat->num_nodes)
+		{
+			break;
+		}
+
+		direntry_t *entry = &fat->nodes[n].entry;
+		if (entry->start_cluster != 0)
+		{
+			walk_chain(job, entry->start_cluster, NODE_OWNER(n), job->results + n);
+		}
+	}
+
+	return NULL;
+}
+
+//The same, once every chain has been walked
+void *resolve_worker(void *arg)
+{
+	check_job_t *job = arg;
+	fat12_t *fat = job->fat;
+
+	for (;;)
+	{
+		uint32_t n = __atomic_fetch_add(&job->next_node, 1, __ATOMIC_RELAXED);
+		if (n >= fat->num_nodes)
+		{
+			break;
+		}
+
+		direntry_t *entry = &fat->nodes[n].entry;
+		if (entry->start_cluster != 0)
+		{
+			resolve_chain(job, entry->start_cluster, NODE_OWNER(n), job->results + n);
+		}
+	}
+
+	return NULL;
+}
+
+//Claims every cluster in the chain for owner, unless a lower owner already
+//has it, and stops there. Running into a cluster this chain already claimed
+//is a loop; running into one a lower owner claimed is a cross-link, though
+//which one isn't known until every chain has been walked.
+void walk_chain(check_job_t *job, uint32_t start, uint32_t owner, chain_result_t *result)
+{
+	fat12_t *fat = job->fat;
+	uint32_t cluster = start;
+	result->problem = CHAIN_OK;
+	result->length = 0;
+	result->whole = 0;
+
+	for (;;)
+	{
+		if (cluster < 2 || cluster - 2 >= fat->num_fat_entries)
+		{
+			result->problem = CHAIN_OUT_OF_RANGE;
+			break;
+		}
+
+		//A failed swap leaves the owner it found in current, to try again with
+		uint32_t *slot = job->owners + cluster - 2;
+		uint32_t current = __atomic_load_n(slot, __ATOMIC_RELAXED);
+		while ((current == 0 || current > owner) &&
+			!__atomic_compare_exchange_n(slot, &current, owner, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+		}
+
+		if (current == owner)
+		{
+			result->problem = CHAIN_LOOP;
+			break;
+		}
+
+		if (current != 0 && current < owner)
+		{
+			result->problem = CHAIN_CROSS_LINKED;
+			break;
+		}
+		result->length++;
+
+		uint32_t next = fat->ops->get(fat, cluster);
+		if (next == 0)
+		{
+			result->problem = CHAIN_FREE_CLUSTER;
+			break;
+		}
+
+		if (is_end_of_chain(fat, next))
+		{
+			break;
+		}
+		cluster = next;
+	}
+
+	result->cluster = cluster;
+}
+
+//Finds the first cluster of the chain that ended up with a lower owner, if
+//any, which makes it cross-linked with that owner there. A cross-linked chain
+//is then counted to its end, since the size check still applies to it.
+void resolve_chain(check_job_t *job, uint32_t start, uint32_t owner, chain_result_t *result)
+{
+	fat12_t *fat = job->fat;
+	uint32_t cluster = start, i;
+	for (i = 0; i < result->length; i++)
+	{
+		if (job->owners[cluster - 2] != owner)
+		{
+			result->problem = CHAIN_CROSS_LINKED;
+			result->cluster = cluster;
+			break;
+		}
+		cluster = fat->ops->get(fat, cluster);
+	}
+
+	if (result->problem != CHAIN_CROSS_LINKED)
+	{
+		return;
+	}
+	result->other = job->owners[result->cluster - 2];
+
+	//Anything longer than the FAT has to loop, and the chain that owns the
+	//loop reports it
+	uint32_t length = 0;
+	cluster = start;
+	while (length <= fat->num_fat_entries && cluster >= 2 && cluster - 2 < fat->num_fat_entries)
+	{
+		length++;
+		uint32_t next = fat->ops->get(fat, cluster);
+		if (next == 0)
+		{
+			break;
+		}
+
+		if (is_end_of_chain(fat, next))
+		{
+			result->whole = 1;
+			break;
+		}
+		cluster = next;
+	}
+	result->length = length;
+}
+
+//Prints what's wrong with one chain, if anything, and returns how many
+//problems that was. entry is NULL for the FAT32 root directory.
+uint8_t report_chain(fat12_t *fat, const char *path, direntry_t *entry, chain_result_t *result)
+{
+	const char *other;
+	uint8_t problems = 0;
+	switch (result->problem)
+	{
+		case CHAIN_OUT_OF_RANGE:
+			printf("%s: cluster chain leaves the FAT at cluster %u\n", path, result->cluster);
+			return 1;
+		case CHAIN_FREE_CLUSTER:
+			printf("%s: cluster chain runs into free cluster %u\n", path, result->cluster);
+			return 1;
+		case CHAIN_LOOP:
+			printf("%s: cluster chain loops back to cluster %u\n", path, result->cluster);
+			return 1;
+		case CHAIN_CROSS_LINKED:
+			other = result->other == ROOT_OWNER ? "/" : fat->nodes[result->other - 2].path;
+			printf("%s: cross-linked with %s at cluster %u\n", path, other, result->cluster);
+			problems++;
+			if (!result->whole)
+			{
+				return problems;
+			}
+			break;
+	}
+
+	//Only a whole chain says anything about the size, and directories don't
+	//record one
+	if (entry == NULL || is_directory(entry))
+	{
+		return problems;
+	}
+
+	uint32_t expected = ((uint64_t) entry->filesize + fat->cluster_size - 1) / fat->cluster_size;
+	uint32_t length = entry->start_cluster != 0 ? result->length : 0;
+	if (length != expected)
+	{
+		printf("%s: %u cluster(s) allocated for %u bytes, which needs %u\n",
+			path, length, entry->filesize, expected);
+		problems++;
+	}
+
+	return problems;
+}
+
+//Allocated clusters that no chain reached. A lost cluster no other lost
+//cluster points to starts a lost chain.
+uint32_t report_lost_clusters(check_job_t *job)
+{
+	fat12_t *fat = job->fat;
+	//The value just below the end of chain markers marks a bad cluster
+	uint32_t bad_cluster = fat->ops->end_of_chain - 1;
+
+	uint8_t *pointed_to = calloc(fat->num_fat_entries, sizeof *pointed_to);
+	if (pointed_to == NULL)
+	{
+		printf("Could not allocate memory.\n");
+		return 1;
+	}
+
+	uint32_t lost = 0, c;
+	for (c = 0; c < fat->num_fat_entries; c++)
+	{
+		uint32_t value = fat->ops->get(fat, c + 2);
+		if (job->owners[c] == 0 && value != 0 && value != bad_cluster)
+		{
+			lost++;
+			if (value >= 2 && value - 2 < fat->num_fat_entries)
+			{
+				pointed_to[value - 2] = 1;
+			}
+		}
+	}
+
+	uint32_t chains = 0;
+	for (c = 0; c < fat->num_fat_entries; c++)
+	{
+		uint32_t value = fat->ops->get(fat, c + 2);
+		if (job->owners[c] == 0 && value != 0 && value != bad_cluster && !pointed_to[c])
+		{
+			chains++;
+		}
+	}
+	free(pointed_to);
+
+	if (lost == 0)
+	{
+		return 0;
+	}
+
+	//Lost clusters that only loop have no start, but are still a chain
+	if (chains == 0)
+	{
+		chains = 1;
+	}
+
+	printf("%u lost cluster(s) in %u chain(s)\n", lost, chains);
+	return 1;
+}
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fat_file.h"
+
+size_t find_extent(fat_file_t *file, uint64_t offset);
+
+//Fails with errno set: ENOENT when path isn't in the image, EISDIR when it's
+//a directory, EIO when its chain is corrupt, ENOMEM when out of memory
+uint8_t fat_open(fat12_t *fat, const char *path, fat_file_t *file)
+{
+	file->fat = fat;
+	file->node = NULL;
+	file->extents.extents = NULL;
+	file->extents.count = file->extents.capacity = 0;
+	file->extent_offsets = NULL;
+
+	uint32_t node = find_path(fat, path);
+	if (node == NO_NODE)
+	{
+		errno = ENOENT;
+		return 0;
+	}
+
+	file->node = fat->nodes + node;
+	direntry_t *entry = &file->node->entry;
+	if (is_directory(entry))
+	{
+		errno = EISDIR;
+		return 0;
+	}
+
+	if (entry->start_cluster == 0 || entry->filesize == 0)
+	{
+		return 1;
+	}
+
+	if (!build_extents(fat, entry->start_cluster, &file->extents))
+	{
+		free_extents(&file->extents);
+		errno = EIO;
+		return 0;
+	}
+
+	file->extent_offsets = malloc(file->extents.count * sizeof *file->extent_offsets);
+	if (file->extent_offsets == NULL)
+	{
+		free_extents(&file->extents);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	uint64_t offset = 0;
+	size_t e;
+	for (e = 0; e < file->extents.count; e++)
+	{
+		file->extent_offsets[e] = offset;
+		offset += (uint64_t) file->extents.extents[e].clusters * fat->cluster_size;
+	}
+
+	return 1;
+}
+
+//Reads up to count bytes starting at offset, stopping at the end of the file.
+//Returns the number of bytes read (0 at or past the end), or -1 with errno
+//set to EIO if the chain is shorter than the file or leaves the image. A
+//file with a size but no start cluster has no chain at all, so that's EIO
+//too.
+ssize_t fat_pread(fat_file_t *file, void *buf, size_t count, uint64_t offset)
+{
+	fat12_t *fat = file->fat;
+	uint32_t filesize = file->node->entry.filesize;
+	if (count == 0 || offset >= filesize)
+	{
+		return 0;
+	}
+
+	if (count > filesize - offset)
+	{
+		count = filesize - offset;
+	}
+
+	uint8_t *dst = buf;
+	size_t done = 0;
+	size_t e = find_extent(file, offset);
+	while (done < count)
+	{
+		if (e >= file->extents.count)
+		{
+			break;
+		}
+
+		extent_t *extent = file->extents.extents + e;
+		uint64_t into = offset + done - file->extent_offsets[e];
+		uint64_t available = (uint64_t) extent->clusters * fat->cluster_size - into;
+		uint64_t image_offset = fat->data_offset +
+			(uint64_t) (extent->start_cluster - 2) * fat->cluster_size + into;
+		size_t n = count - done < available ? count - done : available;
+		if (!image_has(fat, image_offset, n))
+		{
+			break;
+		}
+
+		memcpy(dst + done, fat->image + image_offset, n);
+		done += n;
+		e++;
+	}
+
+	if (done == 0)
+	{
+		errno = EIO;
+		return -1;
+	}
+
+	return done;
+}
+
+void fat_close(fat_file_t *file)
+{
+	free_extents(&file->extents);
+	free(file->extent_offsets);
+	file->extent_offsets = NULL;
+}
+
+//The last extent starting at or before offset
+size_t find_extent(fat_file_t *file, uint64_t offset)
+{
+	size_t low = 0, high = file->extents.count;
+	while (high - low > 1)
+	{
+		size_t mid = low + (high - low) / 2;
+		if (file->extent_offsets[mid] <= offset)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	return low;
+}
@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "fat12.h"
+#include "fat_hash.h"
+
+//The reference xxh64 (github.com/Cyan4973/xxHash), restated here so the
+//tools don't depend on the library
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTATE_LEFT(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+//Reversed form of the CRC32 polynomial
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+//Slicing-by-8: crc32_tables[k][b] is the CRC of byte b followed by k zero
+//bytes, so eight bytes can be folded in with eight independent lookups
+//rather than eight dependent ones. Built once, by whichever thread gets
+//there first.
+static uint32_t crc32_tables[8][256];
+static pthread_once_t crc32_tables_once = PTHREAD_ONCE_INIT;
+
+uint64_t load_uint64_little_endian(const uint8_t *src);
+uint64_t xxh64_round(uint64_t accumulator, uint64_t input);
+uint64_t xxh64_merge_round(uint64_t hash, uint64_t accumulator);
+void xxh64_stripe(xxh64_state_t *state, const uint8_t *stripe);
+void build_crc32_tables(void);
+
+//Byte at a time, like the rest of the decoding, so it doesn't matter what
+//the host's endianness or alignment rules are; compilers turn it into a
+//single load where they can
+uint64_t load_uint64_little_endian(const uint8_t *src)
+{
+	return (uint64_t) load_uint32_little_endian(src) |
+		((uint64_t) load_uint32_little_endian(src + 4) << 32);
+}
+
+uint64_t xxh64_round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * PRIME64_2;
+	accumulator = ROTATE_LEFT(accumulator, 31);
+	return accumulator * PRIME64_1;
+}
+
+uint64_t xxh64_merge_round(uint64_t hash, uint64_t accumulator)
+{
+	hash ^= xxh64_round(0, accumulator);
+	return hash * PRIME64_1 + PRIME64_4;
+}
+
+void xxh64_stripe(xxh64_state_t *state, const uint8_t *stripe)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+	{
+		state->accumulators[i] = xxh64_round(state->accumulators[i], load_uint64_little_endian(stripe + i * 8));
+	}
+}
+
+void xxh64_init(xxh64_state_t *state, uint64_t seed)
+{
+	state->seed = seed;
+	state->accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+	state->accumulators[1] = seed + PRIME64_2;
+	state->accumulators[2] = seed;
+	state->accumulators[3] = seed - PRIME64_1;
+	state->total_len = 0;
+	state->buffered = 0;
+}
+
+void xxh64_update(xxh64_state_t *state, const uint8_t *data, size_t len)
+{
+	state->total_len += len;
+
+	if (state->buffered > 0)
+	{
+		size_t take = sizeof state->buffer - state->buffered;
+		if (take > len)
+		{
+			take = len;
+		}
+		memcpy(state->buffer + state->buffered, data, take);
+		state->buffered += take;
+		data += take;
+		len -= take;
+
+		if (state->buffered < sizeof state->buffer)
+		{
+			return;
+		}
+		xxh64_stripe(state, state->buffer);
+		state->buffered = 0;
+	}
+
+	while (len >= sizeof state->buffer)
+	{
+		xxh64_stripe(state, data);
+		data += sizeof state->buffer;
+		len -= sizeof state->buffer;
+	}
+
+	memcpy(state->buffer, data, len);
+	state->buffered = len;
+}
+
+uint64_t xxh64_digest(xxh64_state_t *state)
+{
+	uint64_t hash;
+	if (state->total_len >= sizeof state->buffer)
+	{
+		uint64_t *acc = state->accumulators;
+		hash = ROTATE_LEFT(acc[0], 1) + ROTATE_LEFT(acc[1], 7) + ROTATE_LEFT(acc[2], 12) + ROTATE_LEFT(acc[3], 18);
+		int i;
+		for (i = 0; i < 4; i++)
+		{
+			hash = xxh64_merge_round(hash, acc[i]);
+		}
+	}
+	else
+	{
+		hash = state->seed + PRIME64_5;
+	}
+	hash += state->total_len;
+
+	const uint8_t *p = state->buffer;
+	uint32_t left = state->buffered;
+	for (; left >= 8; p += 8, left -= 8)
+	{
+		hash ^= xxh64_round(0, load_uint64_little_endian(p));
+		hash = ROTATE_LEFT(hash, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (left >= 4)
+	{
+		hash ^= (uint64_t) load_uint32_little_endian(p) * PRIME64_1;
+		hash = ROTATE_LEFT(hash, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+		left -= 4;
+	}
+
+	for (; left > 0; p++, left--)
+	{
+		hash ^= *p * PRIME64_5;
+		hash = ROTATE_LEFT(hash, 11) * PRIME64_1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t xxh64(const uint8_t *data, size_t len, uint64_t seed)
+{
+	xxh64_state_t state;
+	xxh64_init(&state, seed);
+	xxh64_update(&state, data, len);
+	return xxh64_digest(&state);
+}
+
+void build_crc32_tables(void)
+{
+	uint32_t b;
+	for (b = 0; b < 256; b++)
+	{
+		uint32_t crc = b;
+		int bit;
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32_POLYNOMIAL : 0);
+		}
+		crc32_tables[0][b] = crc;
+	}
+
+	int k;
+	for (k = 1; k < 8; k++)
+	{
+		for (b = 0; b < 256; b++)
+		{
+			uint32_t prev = crc32_tables[k - 1][b];
+			crc32_tables[k][b] = (prev >> 8) ^ crc32_tables[0][prev & 0xff];
+		}
+	}
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+	pthread_once(&crc32_tables_once, build_crc32_tables);
+	uint32_t (*t)[256] = crc32_tables;
+
+	crc = ~crc;
+	for (; len >= 8; data += 8, len -= 8)
+	{
+		uint32_t low = load_uint32_little_endian(data) ^ crc;
+		uint32_t high = load_uint32_little_endian(data + 4);
+		crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+			t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+			t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^
+			t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+	}
+
+	for (; len > 0; data++, len--)
+	{
+		crc = t[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+void file_hash_init(file_hash_t *hash)
+{
+	xxh64_init(&hash->xxh64, 0);
+	hash->crc32 = 0;
+}
+
+void file_hash_update(file_hash_t *hash, const uint8_t *data, size_t len)
+{
+	xxh64_update(&hash->xxh64, data, len);
+	hash->crc32 = crc32_update(hash->crc32, data, len);
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fat_manifest.h"
+
+#define CSV_HEADER "path,type,size,start_cluster,attributes,modified"
+#define HASH_COLUMNS "crc32,xxh64"
+
+void format_entry_time(direntry_t *entry, char buf[20]);
+char *read_csv_string(char *s, char **end);
+
+//Writes one record per file and directory in the image: its path, whether
+//it's a directory, its size, first cluster, attribute byte and time. CSV has
+//a header line and nothing else; JSON is one object that also names the
+//image, its FAT width and its label. If hashes isn't NULL every record also
+//gets the CRC32 and xxh64 of the file's data, which are left empty (or null)
+//for directories and files that weren't hashed. Returns 0 if anything couldn't
+//be written.
+uint8_t write_manifest(fat12_t *fat, const char *image_name, FILE *out, uint8_t format, const extract_options_t *hashes)
+{
+	if (format == MANIFEST_JSON)
+	{
+		fprintf(out, "{\"image\": ");
+		write_json_string(out, image_name);
+		fprintf(out, ", \"fat\": %u, \"label\": ", fat->ops->bits);
+		if (fat->volume_label != NULL)
+		{
+			char label[MAX_FILE_NAME + MAX_EXTENSION + 1];
+			memcpy(label, fat->volume_label->filename, MAX_FILE_NAME);
+			memcpy(label + MAX_FILE_NAME, fat->volume_label->extension, MAX_EXTENSION);
+			label[MAX_FILE_NAME + MAX_EXTENSION] = '\0';
+			write_json_string(out, label);
+		}
+		else
+		{
+			fprintf(out, "null");
+		}
+		fprintf(out, ", \"entries\": [");
+	}
+	else
+	{
+		fprintf(out, "%s\n", hashes != NULL ? CSV_HEADER "," HASH_COLUMNS : CSV_HEADER);
+	}
+
+	uint32_t i;
+	for (i = 0; i < fat->num_nodes; i++)
+	{
+		fat_node_t *node = fat->nodes + i;
+		const char *type = is_directory(&node->entry) ? "directory" : "file";
+		char modified[20];
+		format_entry_time(&node->entry, modified);
+
+		char crc[9] = "";
+		char hash[17] = "";
+		if (hashes != NULL && hashes->hashed[i])
+		{
+			snprintf(crc, sizeof crc, "%08x", hashes->crcs[i]);
+			snprintf(hash, sizeof hash, "%016llx", (unsigned long long) hashes->hashes[i]);
+		}
+
+		if (format == MANIFEST_JSON)
+		{
+			fprintf(out, "%s\n  {\"path\": ", i == 0 ? "" : ",");
+			write_json_string(out, node->path);
+			fprintf(out, ", \"type\": \"%s\", \"size\": %u, \"start_cluster\": %u, \"attributes\": %u, \"modified\": \"%s\"",
+				type, node->entry.filesize, node->entry.start_cluster, node->entry.attributes, modified);
+			if (hashes != NULL)
+			{
+				if (hash[0] != '\0')
+				{
+					fprintf(out, ", \"crc32\": \"%s\", \"xxh64\": \"%s\"", crc, hash);
+				}
+				else
+				{
+					fprintf(out, ", \"crc32\": null, \"xxh64\": null");
+				}
+			}
+			putc('}', out);
+		}
+		else
+		{
+			write_csv_string(out, node->path);
+			fprintf(out, ",%s,%u,%u,%u,%s",
+				type, node->entry.filesize, node->entry.start_cluster, node->entry.attributes, modified);
+			if (hashes != NULL)
+			{
+				fprintf(out, ",%s,%s", crc, hash);
+			}
+			putc('\n', out);
+		}
+	}
+
+	if (format == MANIFEST_JSON)
+	{
+		fprintf(out, "%s]}\n", fat->num_nodes > 0 ? "\n" : "");
+	}
+
+	return !ferror(out);
+}
+
+//Reads the hashes back out of a CSV manifest written with them, for an
+//incremental extraction. A file's hash is only taken if its record still
+//matches its directory entry: same path, size, first cluster and time.
+//Everything else stays unhashed, and so gets written again. Returns 0 if in
+//isn't a CSV manifest with hashes.
+uint8_t read_manifest_hashes(fat12_t *fat, FILE *in, extract_options_t *hashes)
+{
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t len = getline(&line, &capacity, in);
+	if (len >= 0)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+	}
+
+	if (len < 0 || strcmp(line, CSV_HEADER "," HASH_COLUMNS) != 0)
+	{
+		free(line);
+		return 0;
+	}
+
+	while ((len = getline(&line, &capacity, in)) >= 0)
+	{
+		char *rest;
+		char *path = read_csv_string(line, &rest);
+		if (path == NULL)
+		{
+			continue;
+		}
+
+		char type[10];
+		char modified[20];
+		unsigned int size, start_cluster, attributes, crc;
+		unsigned long long hash;
+		if (sscanf(rest, "%9[^,],%u,%u,%u,%19[^,],%8x,%16llx",
+			type, &size, &start_cluster, &attributes, modified, &crc, &hash) != 7)
+		{
+			continue;
+		}
+
+		uint32_t n = find_path(fat, path);
+		if (n == NO_NODE || is_directory(&fat->nodes[n].entry))
+		{
+			continue;
+		}
+
+		direntry_t *entry = &fat->nodes[n].entry;
+		char now[20];
+		format_entry_time(entry, now);
+		if (size == entry->filesize && start_cluster == entry->start_cluster &&
+			strcmp(modified, now) == 0)
+		{
+			hashes->hashes[n] = hash;
+			hashes->crcs[n] = crc;
+			hashes->hashed[n] = 1;
+		}
+	}
+
+	free(line);
+	return !ferror(in);
+}
+
+//Undoes write_csv_string in place, for a field that has more after it.
+//Returns the field and sets end to just past its comma, or returns NULL if
+//there's no comma after it.
+char *read_csv_string(char *s, char **end)
+{
+	char *field = s;
+	if (*s != '"')
+	{
+		s += strcspn(s, ",\r\n");
+	}
+	else
+	{
+		field = ++s;
+		char *out = s;
+		for (;;)
+		{
+			if (*s == '\0')
+			{
+				return NULL;
+			}
+
+			if (*s == '"')
+			{
+				s++;
+				if (*s != '"')
+				{
+					break;
+				}
+			}
+			*out++ = *s++;
+		}
+		*out = '\0';
+	}
+
+	if (*s != ',')
+	{
+		return NULL;
+	}
+	*s = '\0';
+	*end = s + 1;
+	return field;
+}
+
+//As "YYYY-MM-DD HH:MM:SS"
+void format_entry_time(direntry_t *entry, char buf[20])
+{
+	snprintf(buf, 20, "%04u-%02u-%02u %02u:%02u:%02u",
+		1980 + (entry->date >> 9), (entry->date >> 5) & 0xf, entry->date & 0x1f,
+		entry->time >> 11, (entry->time >> 5) & 0x3f, (entry->time & 0x1f) * 2);
+}
+
+//Quoted only when it has to be, with quotes doubled
+void write_csv_string(FILE *out, const char *s)
+{
+	if (strpbrk(s, ",\"\r\n") == NULL)
+	{
+		fputs(s, out);
+		return;
+	}
+
+	putc('"', out);
+	for (; *s != '\0'; s++)
+	{
+		if (*s == '"')
+		{
+			putc('"', out);
+		}
+		putc(*s, out);
+	}
+	putc('"', out);
+}
+
+//Names in an image are bytes in some DOS code page, not UTF-8, so anything
+//outside ASCII is escaped as the Latin-1 character with that value
+void write_json_string(FILE *out, const char *s)
+{
+	putc('"', out);
+	for (; *s != '\0'; s++)
+	{
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+		{
+			putc('\\', out);
+			putc(c, out);
+		}
+		else if (c < 0x20 || c >= 0x7f)
+		{
+			fprintf(out, "\\u%04x", c);
+		}
+		else
+		{
+			putc(c, out);
+		}
+	}
+	putc('"', out);
+}
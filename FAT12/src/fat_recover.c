@@ -0,0 +1,878 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fat_recover.h"
+
+//What the pass over the FAT, and then the directory scan, make of each
+//cluster
+#define CLUSTER_FREE 0
+//In a live file's or directory's chain, or marked bad
+#define CLUSTER_IN_USE 1
+//Free, but holding a deleted directory that's been scanned, or data a deleted
+//file is recovered from, so not an orphan
+#define CLUSTER_CLAIMED 2
+//Allocated, but in no live chain
+#define CLUSTER_LOST 3
+
+//Long file name entries have all of these attribute bits set, and the top two
+//are never set in a real entry
+#define LONG_NAME (READ_ONLY | HIDDEN | SYSTEM_FILE | VOLUME_LABEL)
+#define UNUSED_ATTRIBUTES 0xc0
+
+#define DELETED_DIR "deleted"
+#define ORPHANS_DIR "orphans"
+
+typedef struct
+{
+	uint32_t cluster;
+	char *path;
+} deleted_dir_t;
+
+typedef struct
+{
+	fat12_t *fat;
+	recovery_t *recovery;
+	//One of the CLUSTER_ values per cluster
+	uint8_t *clusters;
+	//Deleted directories found so far, scanned after the live ones
+	deleted_dir_t *dirs;
+	uint32_t num_dirs;
+	uint32_t dirs_capacity;
+	//Copies of every path given to a file or directory so far, open
+	//addressed, so no two recovered items share a path or a prefix
+	char **paths;
+	uint32_t num_paths;
+	uint32_t paths_size;
+} scan_t;
+
+typedef struct
+{
+	fat12_t *fat;
+	recovery_t *recovery;
+	const char *out_dir;
+	size_t max_path_len;
+	//Index of the next item to hand out
+	uint32_t next_item;
+	uint32_t written;
+} recover_job_t;
+
+void mark_live_chain(scan_t *s, uint32_t cluster);
+uint8_t scan_live_directory(scan_t *s, uint32_t cluster, const char *path, extent_list_t *extents);
+uint8_t scan_deleted_directory(scan_t *s, deleted_dir_t *dir);
+uint8_t scan_region(scan_t *s, const uint8_t *src, uint64_t size, const char *dir_path, uint8_t inside_deleted, uint8_t *ended);
+uint8_t starts_directory(const uint8_t *src);
+uint8_t looks_like_directory(const uint8_t *src, uint32_t size);
+uint8_t add_deleted_file(scan_t *s, direntry_t *entry, char *path);
+uint8_t add_deleted_dir(scan_t *s, uint32_t cluster, char *path);
+uint8_t find_orphans(scan_t *s);
+recovered_t *add_item(recovery_t *recovery, char *path);
+char *join_path(const char *dir, const char *name);
+char *claim_path(scan_t *s, const char *dir_path, const char *name);
+uint8_t has_path(scan_t *s, const char *path);
+uint8_t add_path(scan_t *s, const char *path);
+uint8_t is_safe_path(const char *path);
+const uint8_t *cluster_data(fat12_t *fat, uint32_t cluster);
+uint8_t is_zeroed(const uint8_t *src, uint32_t size);
+void make_parent_directories(char *full_name, size_t dir_len);
+void *recover_worker(void *arg);
+uint8_t write_recovered_item(fat12_t *fat, recovered_t *item, const char *full_name);
+
+//Finds everything in the image that could be recovered, in one pass over the
+//FAT and one over the directories: the 0xe5 entries of deleted files, in live
+//directories and in deleted directories whose clusters haven't been reused,
+//and runs of free clusters that still hold data no deleted entry accounts for.
+//
+//A deleted file's FAT chain is gone, so it's taken to be contiguous from its
+//first cluster for as many clusters as its size needs; that's how DOS
+//allocates on a volume that isn't fragmented, and it's what UNDELETE assumes
+//too.
+//
+//Deleting FOO.TXT and BOO.TXT from the same directory leaves two _OO.TXTs, and
+//a deleted file can come back with the same name as a deleted directory, or a
+//live one. Every path is checked against all of those handed out before it,
+//and one that's taken gets ~2, ~3 and so on added, in the order they were
+//found. Returns 0 if it runs out of memory.
+uint8_t scan_recoverable(fat12_t *fat, recovery_t *recovery)
+{
+	recovery->items = NULL;
+	recovery->count = recovery->capacity = 0;
+
+	scan_t s = { fat, recovery, NULL, NULL, 0, 0, NULL, 0, 0 };
+	s.clusters = malloc(fat->num_fat_entries);
+	if (s.clusters == NULL && fat->num_fat_entries > 0)
+	{
+		return 0;
+	}
+
+	//The live directories are taken before anything is found, since deleted
+	//files from them go under the same paths
+	uint8_t ok = 1;
+	uint32_t n;
+	for (n = 0; ok && n < fat->num_nodes; n++)
+	{
+		if (is_directory(&fat->nodes[n].entry))
+		{
+			char *dir_path = join_path(DELETED_DIR, fat->nodes[n].path);
+			ok = dir_path != NULL && add_path(&s, dir_path);
+			free(dir_path);
+		}
+	}
+
+	//Allocated clusters only count as in use once a live chain is found
+	//through them, so a deleted file whose clusters were never freed can be
+	//told apart from one whose clusters went to another file
+	uint32_t bad_cluster = fat->ops->end_of_chain - 1;
+	uint32_t c;
+	for (c = 0; c < fat->num_fat_entries; c++)
+	{
+		uint32_t next = fat->ops->get(fat, c + 2);
+		s.clusters[c] = next == 0 ? CLUSTER_FREE : next == bad_cluster ? CLUSTER_IN_USE : CLUSTER_LOST;
+	}
+
+	if (fat->ops->bits == 32)
+	{
+		mark_live_chain(&s, fat->boot.root_cluster);
+	}
+	for (n = 0; n < fat->num_nodes; n++)
+	{
+		mark_live_chain(&s, fat->nodes[n].entry.start_cluster);
+	}
+
+	//Reused for every live directory
+	extent_list_t extents = { NULL, 0, 0 };
+	if (ok && fat->ops->bits == 32)
+	{
+		ok = scan_live_directory(&s, fat->boot.root_cluster, "", &extents);
+	}
+	else if (ok)
+	{
+		boot_t *boot = &fat->boot;
+		uint64_t root_offset =
+			(boot->reserved_sectors + (uint64_t) boot->sectors_per_fat * boot->fat_copies) * boot->bytes_per_sector;
+		uint64_t root_size = (uint64_t) boot->max_root_dir_entries * DIR_ENTRY_MEMBER_SIZE;
+		uint8_t ended = 0;
+		ok = !image_has(fat, root_offset, root_size) ||
+			scan_region(&s, fat->image + root_offset, root_size, DELETED_DIR, 0, &ended);
+	}
+
+	for (n = 0; ok && n < fat->num_nodes; n++)
+	{
+		fat_node_t *node = fat->nodes + n;
+		if (is_directory(&node->entry))
+		{
+			ok = scan_live_directory(&s, node->entry.start_cluster, node->path, &extents);
+		}
+	}
+	free_extents(&extents);
+
+	//num_dirs grows as deleted directories turn up inside deleted directories
+	uint32_t d;
+	for (d = 0; ok && d < s.num_dirs; d++)
+	{
+		deleted_dir_t dir = s.dirs[d];
+		ok = scan_deleted_directory(&s, &dir);
+	}
+
+	ok = ok && find_orphans(&s);
+
+	for (d = 0; d < s.num_dirs; d++)
+	{
+		free(s.dirs[d].path);
+	}
+	free(s.dirs);
+
+	uint32_t p;
+	for (p = 0; p < s.paths_size; p++)
+	{
+		free(s.paths[p]);
+	}
+	free(s.paths);
+	free(s.clusters);
+	return ok;
+}
+
+//Marks every cluster in the chain starting at cluster as in use. It stops at
+//one that already is, which a chain that loops or runs into another always
+//does, so each cluster is only followed once however the chains cross.
+void mark_live_chain(scan_t *s, uint32_t cluster)
+{
+	fat12_t *fat = s->fat;
+	while (cluster >= 2 && cluster - 2 < fat->num_fat_entries &&
+		s->clusters[cluster - 2] != CLUSTER_IN_USE)
+	{
+		s->clusters[cluster - 2] = CLUSTER_IN_USE;
+		cluster = fat->ops->get(fat, cluster);
+		if (is_end_of_chain(fat, cluster))
+		{
+			break;
+		}
+	}
+}
+
+//Scans the directory whose chain starts at cluster, found at path in the
+//image, for deleted entries. One that can't be read is skipped, as
+//read_subdirectory skips it.
+uint8_t scan_live_directory(scan_t *s, uint32_t cluster, const char *path, extent_list_t *extents)
+{
+	fat12_t *fat = s->fat;
+	if (!build_extents(fat, cluster, extents))
+	{
+		return 1;
+	}
+
+	char *dir_path = join_path(DELETED_DIR, path);
+	if (dir_path == NULL)
+	{
+		return 0;
+	}
+
+	uint8_t ok = 1, ended = 0;
+	size_t e;
+	for (e = 0; ok && !ended && e < extents->count; e++)
+	{
+		extent_t *extent = extents->extents + e;
+		uint64_t offset = fat->data_offset + (uint64_t) (extent->start_cluster - 2) * fat->cluster_size;
+		uint64_t size = (uint64_t) extent->clusters * fat->cluster_size;
+		if (!image_has(fat, offset, size))
+		{
+			break;
+		}
+		ok = scan_region(s, fat->image + offset, size, dir_path, 0, &ended);
+	}
+
+	free(dir_path);
+	return ok;
+}
+
+//A deleted directory's chain is gone too, so it's followed through
+//contiguous free clusters for as long as they look like directory entries and
+//the directory hasn't ended. Its first cluster has to start with ".", or it's
+//been overwritten.
+uint8_t scan_deleted_directory(scan_t *s, deleted_dir_t *dir)
+{
+	fat12_t *fat = s->fat;
+	uint32_t c;
+	uint8_t ended = 0;
+	for (c = dir->cluster; !ended && c >= 2 && c - 2 < fat->num_fat_entries; c++)
+	{
+		const uint8_t *src = cluster_data(fat, c);
+		if (s->clusters[c - 2] != CLUSTER_FREE || src == NULL ||
+			!(c == dir->cluster ? starts_directory(src) : looks_like_directory(src, fat->cluster_size)))
+		{
+			break;
+		}
+
+		//Claimed before it's scanned, so a deleted directory leading back to
+		//this one stops here
+		s->clusters[c - 2] = CLUSTER_CLAIMED;
+		if (!scan_region(s, src, fat->cluster_size, dir->path, 1, &ended))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//Adds the deleted entries in the size bytes at src, part of the directory
+//that recovered files from it go under at dir_path. In a deleted directory
+//every entry counts, deleted or not, since none of them can be reached. Sets
+//ended on reaching a free entry. Returns 0 only if it runs out of memory.
+uint8_t scan_region(scan_t *s, const uint8_t *src, uint64_t size, const char *dir_path, uint8_t inside_deleted, uint8_t *ended)
+{
+	uint64_t i;
+	for (i = 0; i + DIR_ENTRY_MEMBER_SIZE <= size; i += DIR_ENTRY_MEMBER_SIZE)
+	{
+		direntry_t entry;
+		read_directory_entry(s->fat, src + i, &entry);
+
+		if (is_entry_free(&entry))
+		{
+			*ended = 1;
+			return 1;
+		}
+
+		//Long name entries have the volume label bit set as well
+		if (is_volume_label(&entry) || is_dot_entry(&entry) ||
+			(!inside_deleted && !is_entry_deleted(&entry)))
+		{
+			continue;
+		}
+
+		char name[MAX_FILE_NAME + 1 + MAX_EXTENSION + 1];
+		format_entry_name(&entry, name);
+		if (is_entry_deleted(&entry))
+		{
+			name[0] = '_';
+		}
+
+		//"." or "..", which would put it outside dir_path
+		if (!is_safe_name(name))
+		{
+			continue;
+		}
+
+		char *path = claim_path(s, dir_path, name);
+		if (path == NULL)
+		{
+			return 0;
+		}
+
+		uint8_t ok = is_directory(&entry) ?
+			add_deleted_dir(s, entry.start_cluster, path) : add_deleted_file(s, &entry, path);
+		if (!ok)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//A directory's first entry is always "."
+uint8_t starts_directory(const uint8_t *src)
+{
+	return src[0] == '.' && src[1] == ' ' && (src[11] & SUBDIRECTORY);
+}
+
+//Whether every entry up to the first free one could be a real entry. File
+//data rarely gets through this, since names can't hold control characters
+//and the top attribute bits are never set.
+uint8_t looks_like_directory(const uint8_t *src, uint32_t size)
+{
+	uint32_t i;
+	for (i = 0; i + DIR_ENTRY_MEMBER_SIZE <= size; i += DIR_ENTRY_MEMBER_SIZE)
+	{
+		const uint8_t *entry = src + i;
+		if (entry[0] == 0)
+		{
+			return 1;
+		}
+
+		if (entry[11] & UNUSED_ATTRIBUTES)
+		{
+			return 0;
+		}
+
+		//Long name entries hold UTF-16, so there's nothing to check
+		if ((entry[11] & LONG_NAME) == LONG_NAME)
+		{
+			continue;
+		}
+
+		int b;
+		for (b = 1; b < MAX_FILE_NAME + MAX_EXTENSION; b++)
+		{
+			if (entry[b] < 0x20)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+//Takes ownership of path
+uint8_t add_deleted_file(scan_t *s, direntry_t *entry, char *path)
+{
+	fat12_t *fat = s->fat;
+	recovered_t *item = add_item(s->recovery, path);
+	if (item == NULL)
+	{
+		return 0;
+	}
+
+	item->kind = RECOVERED_FILE;
+	item->entry = *entry;
+	item->start_cluster = entry->start_cluster;
+	item->size = entry->filesize;
+	item->clusters = (uint32_t) (((uint64_t) entry->filesize + fat->cluster_size - 1) / fat->cluster_size);
+	item->status = RECOVERABLE;
+	if (item->clusters == 0)
+	{
+		return 1;
+	}
+
+	uint32_t first = item->start_cluster;
+	if (first < 2 || (uint64_t) first - 2 + item->clusters > fat->num_fat_entries)
+	{
+		item->status = RECOVER_OUT_OF_RANGE;
+		return 1;
+	}
+
+	//Clusters another deleted file claimed are still free, so both get them.
+	//A live file anywhere in the run outweighs a lost chain.
+	uint32_t c;
+	for (c = first - 2; c < first - 2 + item->clusters; c++)
+	{
+		if (s->clusters[c] == CLUSTER_IN_USE)
+		{
+			item->status = RECOVER_OVERWRITTEN;
+			return 1;
+		}
+		if (s->clusters[c] == CLUSTER_LOST)
+		{
+			item->status = RECOVER_LOST_CHAIN;
+		}
+	}
+
+	if (item->status == RECOVER_LOST_CHAIN)
+	{
+		return 1;
+	}
+
+	memset(s->clusters + first - 2, CLUSTER_CLAIMED, item->clusters);
+	return 1;
+}
+
+//Takes ownership of path
+uint8_t add_deleted_dir(scan_t *s, uint32_t cluster, char *path)
+{
+	if (s->num_dirs == s->dirs_capacity)
+	{
+		uint32_t new_capacity = s->dirs_capacity ? s->dirs_capacity * 2 : 64;
+		deleted_dir_t *tmp = realloc(s->dirs, new_capacity * sizeof *tmp);
+		if (tmp == NULL)
+		{
+			free(path);
+			return 0;
+		}
+		s->dirs = tmp;
+		s->dirs_capacity = new_capacity;
+	}
+
+	s->dirs[s->num_dirs].cluster = cluster;
+	s->dirs[s->num_dirs].path = path;
+	s->num_dirs++;
+	return 1;
+}
+
+//Runs of free clusters nothing claimed that aren't all zeroes, in one pass
+//from the start of the data area. A run ends at the first cluster that's in
+//use, claimed or empty, or once it would be too big to describe.
+uint8_t find_orphans(scan_t *s)
+{
+	fat12_t *fat = s->fat;
+	uint32_t max_clusters = UINT32_MAX / fat->cluster_size;
+	uint32_t c = 0;
+	while (c < fat->num_fat_entries)
+	{
+		uint32_t start = c;
+		while (c < fat->num_fat_entries && c - start < max_clusters && s->clusters[c] == CLUSTER_FREE)
+		{
+			const uint8_t *src = cluster_data(fat, c + 2);
+			if (src == NULL || is_zeroed(src, fat->cluster_size))
+			{
+				break;
+			}
+			c++;
+		}
+
+		if (c == start)
+		{
+			c++;
+			continue;
+		}
+
+		//"orphans/" and a cluster number
+		char *path = malloc(sizeof ORPHANS_DIR + 11);
+		if (path == NULL)
+		{
+			return 0;
+		}
+		sprintf(path, ORPHANS_DIR "/%u", start + 2);
+
+		recovered_t *item = add_item(s->recovery, path);
+		if (item == NULL)
+		{
+			return 0;
+		}
+		memset(&item->entry, 0, sizeof item->entry);
+		item->kind = RECOVERED_ORPHAN;
+		item->status = RECOVERABLE;
+		item->start_cluster = start + 2;
+		item->clusters = c - start;
+		item->size = item->clusters * fat->cluster_size;
+	}
+
+	return 1;
+}
+
+//Takes ownership of path, and frees it if there's no room for the item
+recovered_t *add_item(recovery_t *recovery, char *path)
+{
+	if (recovery->count == recovery->capacity)
+	{
+		uint32_t new_capacity = recovery->capacity ? recovery->capacity * 2 : 64;
+		recovered_t *tmp = realloc(recovery->items, new_capacity * sizeof *tmp);
+		if (tmp == NULL)
+		{
+			free(path);
+			return NULL;
+		}
+		recovery->items = tmp;
+		recovery->capacity = new_capacity;
+	}
+
+	recovered_t *item = recovery->items + recovery->count++;
+	item->path = path;
+	return item;
+}
+
+//dir and name with a '/' between them, or just dir if name is empty
+char *join_path(const char *dir, const char *name)
+{
+	size_t dir_len = strlen(dir);
+	size_t name_len = strlen(name);
+	char *path = malloc(dir_len + 1 + name_len + 1);
+	if (path == NULL)
+	{
+		return NULL;
+	}
+
+	memcpy(path, dir, dir_len);
+	if (name_len == 0)
+	{
+		path[dir_len] = '\0';
+		return path;
+	}
+
+	path[dir_len] = '/';
+	memcpy(path + dir_len + 1, name, name_len + 1);
+	return path;
+}
+
+//dir_path and name with a '/' between them, and ~2, ~3 and so on after that
+//if it's already been handed out, recorded as taken. Returns NULL if it runs
+//out of memory.
+char *claim_path(scan_t *s, const char *dir_path, const char *name)
+{
+	//Room for "~" and any uint32_t
+	char *path = malloc(strlen(dir_path) + 1 + strlen(name) + 12);
+	if (path == NULL)
+	{
+		return NULL;
+	}
+
+	int len = sprintf(path, "%s/%s", dir_path, name);
+	uint32_t copies = 1;
+	while (has_path(s, path))
+	{
+		sprintf(path + len, "~%u", ++copies);
+	}
+
+	if (!add_path(s, path))
+	{
+		free(path);
+		return NULL;
+	}
+
+	return path;
+}
+
+uint8_t has_path(scan_t *s, const char *path)
+{
+	if (s->paths_size == 0)
+	{
+		return 0;
+	}
+
+	uint32_t slot = hash_path(path) & (s->paths_size - 1);
+	while (s->paths[slot] != NULL)
+	{
+		if (strcmp(s->paths[slot], path) == 0)
+		{
+			return 1;
+		}
+		slot = (slot + 1) & (s->paths_size - 1);
+	}
+
+	return 0;
+}
+
+//Adds a copy of path, which mustn't be there already. The set is kept at most
+//half full, and a power of two in size so a mask picks the slot.
+uint8_t add_path(scan_t *s, const char *path)
+{
+	if (2 * (s->num_paths + 1) > s->paths_size)
+	{
+		uint32_t size = s->paths_size ? s->paths_size * 2 : 64;
+		char **paths = calloc(size, sizeof *paths);
+		if (paths == NULL)
+		{
+			return 0;
+		}
+
+		uint32_t i;
+		for (i = 0; i < s->paths_size; i++)
+		{
+			if (s->paths[i] != NULL)
+			{
+				uint32_t slot = hash_path(s->paths[i]) & (size - 1);
+				while (paths[slot] != NULL)
+				{
+					slot = (slot + 1) & (size - 1);
+				}
+				paths[slot] = s->paths[i];
+			}
+		}
+
+		free(s->paths);
+		s->paths = paths;
+		s->paths_size = size;
+	}
+
+	char *copy = strdup(path);
+	if (copy == NULL)
+	{
+		return 0;
+	}
+
+	uint32_t slot = hash_path(copy) & (s->paths_size - 1);
+	while (s->paths[slot] != NULL)
+	{
+		slot = (slot + 1) & (s->paths_size - 1);
+	}
+	s->paths[slot] = copy;
+	s->num_paths++;
+	return 1;
+}
+
+//Whether every component of path is one is_safe_name allows, so nothing made
+//from it can land outside the output directory
+uint8_t is_safe_path(const char *path)
+{
+	for (;;)
+	{
+		const char *slash = strchr(path, '/');
+		size_t len = slash != NULL ? (size_t) (slash - path) : strlen(path);
+		if (len == 0 || (path[0] == '.' && (len == 1 || (len == 2 && path[1] == '.'))))
+		{
+			return 0;
+		}
+
+		if (slash == NULL)
+		{
+			return 1;
+		}
+		path = slash + 1;
+	}
+}
+
+//The cluster's bytes in the mapping, or NULL if the image is cut short
+//before it
+const uint8_t *cluster_data(fat12_t *fat, uint32_t cluster)
+{
+	uint64_t offset = fat->data_offset + (uint64_t) (cluster - 2) * fat->cluster_size;
+	return image_has(fat, offset, fat->cluster_size) ? fat->image + offset : NULL;
+}
+
+uint8_t is_zeroed(const uint8_t *src, uint32_t size)
+{
+	uint32_t i;
+	for (i = 0; i < size; i++)
+	{
+		if (src[i] != 0)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//Writes every recoverable item under out_dir, at its path, spread over
+//threads. The directories are made first, on this thread, since each needs
+//its parent. Returns how many were written.
+uint32_t write_recovered(fat12_t *fat, recovery_t *recovery, const char *out_dir, int threads)
+{
+	recover_job_t job = { fat, recovery, out_dir, 0, 0, 0 };
+	uint32_t i;
+	for (i = 0; i < recovery->count; i++)
+	{
+		size_t len = strlen(recovery->items[i].path);
+		if (len > job.max_path_len)
+		{
+			job.max_path_len = len;
+		}
+	}
+
+	size_t dir_len = strlen(out_dir) + 1;
+	char *full_name = malloc(dir_len + job.max_path_len + 1);
+	if (full_name == NULL)
+	{
+		printf("Could not allocate memory.\n");
+		return 0;
+	}
+	sprintf(full_name, "%s/", out_dir);
+
+	//Items from the same directory were found together, so most of them
+	//have the same parent as the one before
+	const char *last_path = NULL;
+	size_t last_parent_len = 0;
+	for (i = 0; i < recovery->count; i++)
+	{
+		recovered_t *item = recovery->items + i;
+		if (item->status != RECOVERABLE || !is_safe_path(item->path))
+		{
+			continue;
+		}
+
+		size_t parent_len = strrchr(item->path, '/') - item->path;
+		if (last_path == NULL || parent_len != last_parent_len ||
+			strncmp(item->path, last_path, parent_len) != 0)
+		{
+			strcpy(full_name + dir_len, item->path);
+			make_parent_directories(full_name, dir_len);
+			last_path = item->path;
+			last_parent_len = parent_len;
+		}
+	}
+	free(full_name);
+
+	if (threads > 0 && (uint32_t) threads > recovery->count)
+	{
+		threads = recovery->count;
+	}
+
+	pthread_t *workers = NULL;
+	int started = 0;
+	if (threads > 1)
+	{
+		workers = malloc((threads - 1) * sizeof *workers);
+	}
+
+	//The calling thread works too, so even if no more threads can be started
+	//everything still gets written
+	if (workers != NULL)
+	{
+		for (started = 0; started < threads - 1; started++)
+		{
+			if (pthread_create(workers + started, NULL, recover_worker, &job) != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	recover_worker(&job);
+
+	int t;
+	for (t = 0; t < started; t++)
+	{
+		pthread_join(workers[t], NULL);
+	}
+	free(workers);
+
+	return job.written;
+}
+
+//Makes every directory in full_name after the first dir_len bytes, leaving
+//out the last component
+void make_parent_directories(char *full_name, size_t dir_len)
+{
+	char *slash;
+	for (slash = strchr(full_name + dir_len, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		if (mkdir(full_name, 0755) < 0 && errno != EEXIST)
+		{
+			printf("Could not create directory with name %s\n", full_name);
+		}
+		*slash = '/';
+	}
+}
+
+//Takes items off the shared job one at a time until there are none left
+void *recover_worker(void *arg)
+{
+	recover_job_t *job = arg;
+	size_t dir_len = strlen(job->out_dir) + 1;
+	char *full_name = malloc(dir_len + job->max_path_len + 1);
+	if (full_name == NULL)
+	{
+		return NULL;
+	}
+	sprintf(full_name, "%s/", job->out_dir);
+
+	for (;;)
+	{
+		uint32_t i = __atomic_fetch_add(&job->next_item, 1, __ATOMIC_RELAXED);
+		if (i >= job->recovery->count)
+		{
+			break;
+		}
+
+		recovered_t *item = job->recovery->items + i;
+		if (item->status != RECOVERABLE)
+		{
+			continue;
+		}
+
+		//The names were all made safe when they were found, but nothing
+		//outside out_dir is ever written, whatever the image holds
+		if (!is_safe_path(item->path))
+		{
+			printf("Skipping %s, which would be written outside %s\n", item->path, job->out_dir);
+			continue;
+		}
+
+		strcpy(full_name + dir_len, item->path);
+		if (write_recovered_item(job->fat, item, full_name))
+		{
+			__atomic_fetch_add(&job->written, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	free(full_name);
+	return NULL;
+}
+
+//One write straight from the mapping, since the clusters are contiguous
+uint8_t write_recovered_item(fat12_t *fat, recovered_t *item, const char *full_name)
+{
+	int fd = open(full_name, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+	{
+		printf("Could not create file with name %s\n", full_name);
+		return 0;
+	}
+
+	uint8_t ok = 1;
+	if (item->size > 0)
+	{
+		uint64_t offset = fat->data_offset + (uint64_t) (item->start_cluster - 2) * fat->cluster_size;
+		if (!image_has(fat, offset, item->size))
+		{
+			printf("%s runs past the end of the image\n", full_name);
+			ok = 0;
+		}
+		else if (!write_all(fd, fat->image + offset, item->size))
+		{
+			printf("Could not write file with name %s\n", full_name);
+			ok = 0;
+		}
+	}
+
+	close(fd);
+	return ok;
+}
+
+void free_recovery(recovery_t *recovery)
+{
+	uint32_t i;
+	for (i = 0; i < recovery->count; i++)
+	{
+		free(recovery->items[i].path);
+	}
+	free(recovery->items);
+	recovery->items = NULL;
+	recovery->count = recovery->capacity = 0;
+}
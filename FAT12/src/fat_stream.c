@@ -0,0 +1,647 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "fat_stream.h"
+
+//Reads an image that can only be read once, front to back: stdin, a pipe, or
+//a gzip file through zlib (which passes anything that isn't gzip through
+//as is). Everything before the data area is read whole, which is all
+//read_fat12_head needs. After that the data area goes by a cluster at a time.
+//Most clusters already have an owner by the time they arrive, since
+//directories tend to come before what's in them, and are written out or
+//parsed on the spot. The rest are kept until a directory claims them, so
+//only those are ever buffered.
+#define STREAM_CHUNK_SIZE (256 * 1024)
+
+//Owners of clusters: 0 for none yet, node + 1 for a file, and stream
+//directory + 1 with DIRECTORY_OWNER set for a directory. Files that aren't
+//being extracted get SKIPPED_OWNER, so their clusters can just be dropped.
+#define DIRECTORY_OWNER 0x80000000u
+#define SKIPPED_OWNER (DIRECTORY_OWNER - 1)
+
+typedef struct
+{
+	//NO_NODE for a FAT32 root directory
+	uint32_t node;
+	//A directory's clusters are read in chain order, whatever order they're
+	//in the image, since the first free entry ends it; 0 once it's all read
+	uint32_t next_cluster;
+	uint8_t ended;
+} stream_dir_t;
+
+typedef struct
+{
+	fat12_t *fat;
+	gzFile gz;
+	//NULL when only reading the tree
+	const char *out_dir;
+	//Upper case with no slashes at either end, or NULL for everything
+	char *selected;
+	size_t selected_len;
+
+	//Per cluster, indexed by cluster number
+	uint32_t *owners;
+	uint32_t *chain_index;
+	uint8_t **pending;
+
+	stream_dir_t *dirs;
+	uint32_t num_dirs;
+	uint32_t dirs_capacity;
+	//Nodes are claimed in the order they're added
+	uint32_t claimed;
+
+	//The file last written to, kept open since its clusters usually come one
+	//after another
+	uint32_t open_node;
+	int open_fd;
+	//Files created that end up read only. They stay writable until every
+	//cluster has gone by, since their clusters can come in any order.
+	uint32_t *read_only;
+	uint32_t num_read_only;
+	uint32_t read_only_capacity;
+	//Cleared on running out of memory
+	uint8_t ok;
+} stream_t;
+
+uint8_t read_stream(gzFile gz, uint8_t *dst, uint64_t n);
+uint8_t read_stream_head(stream_t *s);
+uint8_t read_data_area(stream_t *s);
+void claim_nodes(stream_t *s);
+void claim_node(stream_t *s, uint32_t n);
+uint8_t add_stream_dir(stream_t *s, uint32_t node, uint32_t start);
+uint8_t claim_chain(stream_t *s, uint32_t start, uint32_t owner, uint32_t *length);
+void release_pending(stream_t *s, uint32_t start, uint32_t length);
+void process_cluster(stream_t *s, uint32_t cluster, const uint8_t *data);
+void parse_directory_cluster(stream_t *s, uint32_t d, uint32_t cluster, const uint8_t *data);
+void write_file_cluster(stream_t *s, uint32_t n, uint32_t cluster, const uint8_t *data);
+char *output_path(stream_t *s, const char *path);
+uint8_t add_read_only(stream_t *s, uint32_t n);
+void set_file_modes(stream_t *s);
+uint8_t is_selected(stream_t *s, const char *path, uint8_t or_parent);
+
+//Whether read_fat12_stream should be used for name instead of read_fat12: -
+//for stdin, or anything ending in .gz
+uint8_t is_stream_name(const char *name)
+{
+	size_t len = strlen(name);
+	return strcmp(name, "-") == 0 || (len > 3 && strcmp(name + len - 3, ".gz") == 0);
+}
+
+//Reads the image in fd, which it closes, in one pass, leaving fat just as
+//read_fat12 would, except that there's no image to read file data from
+//afterwards. With out_dir, files are extracted there as their clusters go by
+//instead: all of them, or with selected, that file or directory and
+//everything under it.
+uint8_t read_fat12_stream(int fd, fat12_t *fat, const char *out_dir, const char *selected)
+{
+	stream_t s;
+	memset(&s, 0, sizeof s);
+	s.fat = fat;
+	s.out_dir = out_dir;
+	s.open_node = NO_NODE;
+	s.open_fd = -1;
+	s.ok = 1;
+
+	//So free_fat12 is safe whatever happens
+	init_fat12(fat);
+
+	s.gz = gzdopen(fd, "rb");
+	if (s.gz == NULL)
+	{
+		close(fd);
+		return 0;
+	}
+	gzbuffer(s.gz, STREAM_CHUNK_SIZE);
+
+	if (selected != NULL)
+	{
+		while (*selected == '/')
+		{
+			selected++;
+		}
+
+		s.selected_len = strlen(selected);
+		while (s.selected_len > 0 && selected[s.selected_len - 1] == '/')
+		{
+			s.selected_len--;
+		}
+
+		s.selected = malloc(s.selected_len + 1);
+		if (s.selected == NULL)
+		{
+			gzclose(s.gz);
+			return 0;
+		}
+
+		size_t i;
+		for (i = 0; i < s.selected_len; i++)
+		{
+			s.selected[i] = toupper((unsigned char) selected[i]);
+		}
+		s.selected[s.selected_len] = '\0';
+	}
+
+	uint8_t ok = read_stream_head(&s) && read_data_area(&s) && s.ok;
+
+	if (s.open_fd >= 0)
+	{
+		close(s.open_fd);
+	}
+
+	//Before the nodes are put in tree order, which renumbers them
+	set_file_modes(&s);
+	ok = ok && order_fat12_tree(fat);
+
+	if (s.pending != NULL)
+	{
+		uint32_t c;
+		for (c = 0; c < fat->num_fat_entries + 2; c++)
+		{
+			free(s.pending[c]);
+		}
+	}
+	free(s.pending);
+	free(s.owners);
+	free(s.chain_index);
+	free(s.dirs);
+	free(s.read_only);
+	free(s.selected);
+	gzclose(s.gz);
+	return ok;
+}
+
+//Reads exactly n bytes, or fails
+uint8_t read_stream(gzFile gz, uint8_t *dst, uint64_t n)
+{
+	while (n > 0)
+	{
+		unsigned int want = n < STREAM_CHUNK_SIZE ? n : STREAM_CHUNK_SIZE;
+		int got = gzread(gz, dst, want);
+		if (got <= 0)
+		{
+			return 0;
+		}
+		dst += got;
+		n -= got;
+	}
+
+	return 1;
+}
+
+//The boot sector says how much more there is before the data area
+uint8_t read_stream_head(stream_t *s)
+{
+	fat12_t *fat = s->fat;
+	uint8_t *head = malloc(BOOT_MEMBER_SIZE);
+	if (head == NULL || !read_stream(s->gz, head, BOOT_MEMBER_SIZE))
+	{
+		free(head);
+		return 0;
+	}
+
+	uint64_t size = fat12_head_size(head);
+	if (size < BOOT_MEMBER_SIZE || size > SIZE_MAX)
+	{
+		free(head);
+		return 0;
+	}
+
+	uint8_t *grown = realloc(head, size);
+	if (grown == NULL)
+	{
+		free(head);
+		return 0;
+	}
+	head = grown;
+
+	if (!read_stream(s->gz, head + BOOT_MEMBER_SIZE, size - BOOT_MEMBER_SIZE))
+	{
+		free(head);
+		return 0;
+	}
+
+	//From here on head is fat's, so free_fat12 takes care of it
+	if (!read_fat12_head(head, size, fat))
+	{
+		return 0;
+	}
+
+	uint32_t clusters = fat->num_fat_entries + 2;
+	s->owners = calloc(clusters, sizeof *s->owners);
+	s->chain_index = calloc(clusters, sizeof *s->chain_index);
+	s->pending = calloc(clusters, sizeof *s->pending);
+	if (s->owners == NULL || s->chain_index == NULL || s->pending == NULL)
+	{
+		return 0;
+	}
+
+	if (fat->ops->bits == 32 && !add_stream_dir(s, NO_NODE, fat->boot.root_cluster))
+	{
+		return 0;
+	}
+
+	claim_nodes(s);
+	return s->ok;
+}
+
+//Goes through the data area in chunks of whole clusters, stopping after the
+//last cluster the FAT has in use
+uint8_t read_data_area(stream_t *s)
+{
+	fat12_t *fat = s->fat;
+	uint32_t bad_cluster = fat->ops->end_of_chain - 1;
+
+	uint32_t last = fat->num_fat_entries + 1;
+	while (last >= 2 && fat->ops->get(fat, last) == 0)
+	{
+		last--;
+	}
+
+	uint32_t per_chunk = STREAM_CHUNK_SIZE / fat->cluster_size;
+	if (per_chunk == 0)
+	{
+		per_chunk = 1;
+	}
+
+	uint8_t *chunk = malloc((size_t) per_chunk * fat->cluster_size);
+	if (chunk == NULL)
+	{
+		return 0;
+	}
+
+	uint32_t cluster = 2;
+	while (s->ok && cluster <= last)
+	{
+		uint32_t count = last - cluster + 1 < per_chunk ? last - cluster + 1 : per_chunk;
+		if (!read_stream(s->gz, chunk, (uint64_t) count * fat->cluster_size))
+		{
+			printf("The image ends before cluster %u, its last one in use\n", last);
+			break;
+		}
+
+		uint32_t i;
+		for (i = 0; i < count; i++, cluster++)
+		{
+			uint32_t value = fat->ops->get(fat, cluster);
+			if (value != 0 && value != bad_cluster)
+			{
+				process_cluster(s, cluster, chunk + (size_t) i * fat->cluster_size);
+			}
+		}
+	}
+
+	free(chunk);
+	return s->ok;
+}
+
+void claim_nodes(stream_t *s)
+{
+	while (s->ok && s->claimed < s->fat->num_nodes)
+	{
+		claim_node(s, s->claimed++);
+	}
+}
+
+//Makes the node's directory or file in the output (if it's being extracted)
+//and takes ownership of its clusters, handling any that already went by
+void claim_node(stream_t *s, uint32_t n)
+{
+	fat_node_t *node = s->fat->nodes + n;
+	uint32_t start = node->entry.start_cluster;
+
+	if (is_directory(&node->entry))
+	{
+		if (s->out_dir != NULL && is_selected(s, node->path, 1))
+		{
+			char *path = output_path(s, node->path);
+			if (path != NULL && mkdir(path, 0755) < 0 && errno != EEXIST)
+			{
+				fprintf(stderr, "Could not create directory with name %s\n", path);
+			}
+			free(path);
+		}
+
+		if (start != 0)
+		{
+			add_stream_dir(s, n, start);
+		}
+		return;
+	}
+
+	uint32_t owner = SKIPPED_OWNER;
+	char *path = NULL;
+	if (s->out_dir != NULL && is_selected(s, node->path, 0) && (path = output_path(s, node->path)) != NULL)
+	{
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || ftruncate(fd, node->entry.filesize) < 0)
+		{
+			fprintf(stderr, "Could not create file with name %s\n", path);
+		}
+		else if (!(node->entry.attributes & READ_ONLY) || add_read_only(s, n))
+		{
+			owner = n + 1;
+		}
+
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+
+	uint32_t length = 0;
+	uint8_t ended = start == 0 || claim_chain(s, start, owner, &length);
+	if (owner != SKIPPED_OWNER && (!ended || (uint64_t) length * s->fat->cluster_size < node->entry.filesize))
+	{
+		fprintf(stderr, "Cluster chain of %s is corrupt\n", path);
+	}
+	free(path);
+}
+
+uint8_t add_read_only(stream_t *s, uint32_t n)
+{
+	if (s->num_read_only == s->read_only_capacity)
+	{
+		uint32_t capacity = s->read_only_capacity ? s->read_only_capacity * 2 : 64;
+		uint32_t *read_only = realloc(s->read_only, capacity * sizeof *read_only);
+		if (read_only == NULL)
+		{
+			s->ok = 0;
+			return 0;
+		}
+		s->read_only = read_only;
+		s->read_only_capacity = capacity;
+	}
+
+	s->read_only[s->num_read_only++] = n;
+	return 1;
+}
+
+//Gives the read only files the mode extract_fat12 would have made them with
+void set_file_modes(stream_t *s)
+{
+	uint32_t i;
+	for (i = 0; i < s->num_read_only; i++)
+	{
+		direntry_t *entry = &s->fat->nodes[s->read_only[i]].entry;
+		char *path = output_path(s, s->fat->nodes[s->read_only[i]].path);
+		if (path != NULL && chmod(path, file_permissions(entry)) < 0)
+		{
+			fprintf(stderr, "Could not set the mode of file with name %s\n", path);
+		}
+		free(path);
+	}
+}
+
+uint8_t add_stream_dir(stream_t *s, uint32_t node, uint32_t start)
+{
+	if (s->num_dirs == s->dirs_capacity)
+	{
+		uint32_t capacity = s->dirs_capacity ? s->dirs_capacity * 2 : 64;
+		stream_dir_t *dirs = realloc(s->dirs, capacity * sizeof *dirs);
+		if (dirs == NULL)
+		{
+			s->ok = 0;
+			return 0;
+		}
+		s->dirs = dirs;
+		s->dirs_capacity = capacity;
+	}
+
+	uint32_t d = s->num_dirs++;
+	s->dirs[d].node = node;
+	s->dirs[d].next_cluster = start;
+	s->dirs[d].ended = 0;
+
+	//A directory whose chain is already someone else's (one leading back to
+	//a directory it's inside of, say) is left empty
+	uint32_t length;
+	claim_chain(s, start, (d + 1) | DIRECTORY_OWNER, &length);
+	if (length == 0)
+	{
+		s->dirs[d].next_cluster = 0;
+		return 1;
+	}
+
+	if (s->pending[start] != NULL)
+	{
+		uint8_t *data = s->pending[start];
+		s->pending[start] = NULL;
+		process_cluster(s, start, data);
+		free(data);
+	}
+	return 1;
+}
+
+//Takes every cluster in the chain for owner, stopping at the first that's out
+//of range, free or already someone else's, and hands any that already went by
+//to process_cluster. Sets length to how many clusters were taken, and returns
+//0 if the chain didn't end properly. Clusters shared with an earlier chain (a
+//cross-link) stay with that one, since by now they may be long gone.
+uint8_t claim_chain(stream_t *s, uint32_t start, uint32_t owner, uint32_t *length)
+{
+	fat12_t *fat = s->fat;
+	uint32_t cluster = start;
+	uint8_t ended = 0;
+	*length = 0;
+	while (cluster >= 2 && cluster - 2 < fat->num_fat_entries && s->owners[cluster] == 0)
+	{
+		s->owners[cluster] = owner;
+		s->chain_index[cluster] = (*length)++;
+
+		uint32_t next = fat->ops->get(fat, cluster);
+		if (next == 0 || is_end_of_chain(fat, next))
+		{
+			ended = next != 0;
+			break;
+		}
+		cluster = next;
+	}
+
+	//Directories are read in chain order, starting from their first cluster,
+	//so add_stream_dir takes care of theirs
+	if (!(owner & DIRECTORY_OWNER))
+	{
+		release_pending(s, start, *length);
+	}
+	return ended;
+}
+
+void release_pending(stream_t *s, uint32_t start, uint32_t length)
+{
+	uint32_t cluster = start, i;
+	for (i = 0; i < length; i++)
+	{
+		if (s->pending[cluster] != NULL)
+		{
+			uint8_t *data = s->pending[cluster];
+			s->pending[cluster] = NULL;
+			process_cluster(s, cluster, data);
+			free(data);
+		}
+		cluster = s->fat->ops->get(s->fat, cluster);
+	}
+}
+
+//Handles one cluster in use, whether it's just gone by or was kept back
+void process_cluster(stream_t *s, uint32_t cluster, const uint8_t *data)
+{
+	uint32_t owner = s->owners[cluster];
+	if (owner == SKIPPED_OWNER)
+	{
+		return;
+	}
+
+	if (owner & DIRECTORY_OWNER)
+	{
+		uint32_t d = (owner & ~DIRECTORY_OWNER) - 1;
+		if (s->dirs[d].next_cluster == cluster)
+		{
+			parse_directory_cluster(s, d, cluster, data);
+			return;
+		}
+	}
+	else if (owner != 0)
+	{
+		write_file_cluster(s, owner - 1, cluster, data);
+		return;
+	}
+
+	//Nobody's, or a directory's but out of order, so it has to wait
+	if (s->pending[cluster] == NULL)
+	{
+		s->pending[cluster] = malloc(s->fat->cluster_size);
+		if (s->pending[cluster] == NULL)
+		{
+			s->ok = 0;
+			return;
+		}
+		memcpy(s->pending[cluster], data, s->fat->cluster_size);
+	}
+}
+
+//Adds the entries in this cluster, claims the new nodes, and carries on with
+//the directory's next cluster if that already went by
+void parse_directory_cluster(stream_t *s, uint32_t d, uint32_t cluster, const uint8_t *data)
+{
+	fat12_t *fat = s->fat;
+	uint32_t owner = (d + 1) | DIRECTORY_OWNER;
+	uint8_t *pending = NULL;
+	for (;;)
+	{
+		uint8_t ok = s->dirs[d].ended ||
+			read_directory_block(fat, data, fat->cluster_size, s->dirs[d].node, &s->dirs[d].ended);
+		free(pending);
+		if (!ok)
+		{
+			s->ok = 0;
+			return;
+		}
+
+		uint32_t next = fat->ops->get(fat, cluster);
+		s->dirs[d].next_cluster =
+			next >= 2 && next - 2 < fat->num_fat_entries && s->owners[next] == owner ? next : 0;
+		claim_nodes(s);
+
+		cluster = s->dirs[d].next_cluster;
+		if (cluster == 0 || s->pending[cluster] == NULL)
+		{
+			return;
+		}
+		pending = s->pending[cluster];
+		s->pending[cluster] = NULL;
+		data = pending;
+	}
+}
+
+void write_file_cluster(stream_t *s, uint32_t n, uint32_t cluster, const uint8_t *data)
+{
+	fat12_t *fat = s->fat;
+	fat_node_t *node = fat->nodes + n;
+	uint64_t offset = (uint64_t) s->chain_index[cluster] * fat->cluster_size;
+	if (offset >= node->entry.filesize)
+	{
+		return;
+	}
+
+	if (s->open_node != n)
+	{
+		if (s->open_fd >= 0)
+		{
+			close(s->open_fd);
+		}
+
+		char *path = output_path(s, node->path);
+		s->open_fd = path != NULL ? open(path, O_WRONLY) : -1;
+		s->open_node = s->open_fd >= 0 ? n : NO_NODE;
+		if (s->open_fd < 0 && path != NULL)
+		{
+			fprintf(stderr, "Could not write file with name %s\n", path);
+		}
+		free(path);
+		if (s->open_fd < 0)
+		{
+			return;
+		}
+	}
+
+	size_t n_bytes = node->entry.filesize - offset < fat->cluster_size ?
+		node->entry.filesize - offset : fat->cluster_size;
+	while (n_bytes > 0)
+	{
+		ssize_t written = pwrite(s->open_fd, data, n_bytes, offset);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (written <= 0)
+		{
+			fprintf(stderr, "Could not write file with name %s/%s\n", s->out_dir, node->path);
+			return;
+		}
+		data += written;
+		offset += written;
+		n_bytes -= written;
+	}
+}
+
+char *output_path(stream_t *s, const char *path)
+{
+	size_t len = strlen(s->out_dir) + 1 + strlen(path) + 1;
+	char *full_name = malloc(len);
+	if (full_name == NULL)
+	{
+		s->ok = 0;
+		return NULL;
+	}
+
+	snprintf(full_name, len, "%s/%s", s->out_dir, path);
+	return full_name;
+}
+
+//Whether path is the selected node or under it, or with or_parent, one of
+//the directories above it (which have to be made for it)
+uint8_t is_selected(stream_t *s, const char *path, uint8_t or_parent)
+{
+	if (s->selected == NULL)
+	{
+		return 1;
+	}
+
+	size_t len = strlen(path);
+	if (len >= s->selected_len && strncmp(path, s->selected, s->selected_len) == 0 &&
+		(path[s->selected_len] == '\0' || path[s->selected_len] == '/'))
+	{
+		return 1;
+	}
+
+	return or_parent && len < s->selected_len && strncmp(path, s->selected, len) == 0 &&
+		s->selected[len] == '/';
+}
@@ -0,0 +1,419 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fat_writer.h"
+#include "fat12_entries.h"
+
+#define SECTOR_SIZE 512
+#define RESERVED_SECTORS 1
+#define FAT_COPIES 2
+#define MEDIA_DESCRIPTOR 0xf8
+#define MAX_SECTORS_PER_CLUSTER 128
+
+//Must stay in step with how read_file_allocation_tables picks the width
+#define FAT12_MAX_CLUSTERS 4085
+#define FAT16_MAX_CLUSTERS 65525
+
+void store_uint16_little_endian(uint8_t *dst, uint16_t value);
+void store_uint32_little_endian(uint8_t *dst, uint32_t value);
+uint8_t size_table(uint64_t total_sectors, uint8_t bits, uint32_t sectors_per_cluster,
+	uint32_t root_sectors, uint32_t *sectors_per_fat, uint32_t *clusters);
+void write_boot_sector(fat_writer_t *w, uint64_t total_sectors, uint32_t sectors_per_cluster,
+	uint32_t sectors_per_fat, const char *label);
+void write_entry(uint8_t *dst, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint8_t attributes, uint32_t start_cluster, uint32_t size, time_t mtime);
+uint8_t copy_short_name_part(const char *src, size_t len, unsigned char *dst, size_t max);
+
+void store_uint16_little_endian(uint8_t *dst, uint16_t value)
+{
+	dst[0] = value & 0xff;
+	dst[1] = value >> 8;
+}
+
+void store_uint32_little_endian(uint8_t *dst, uint32_t value)
+{
+	store_uint16_little_endian(dst, value & 0xffff);
+	store_uint16_little_endian(dst + 2, value >> 16);
+}
+
+//The table's size depends on the number of clusters, which depends on how much
+//room the table takes, so go back and forth until they agree
+uint8_t size_table(uint64_t total_sectors, uint8_t bits, uint32_t sectors_per_cluster,
+	uint32_t root_sectors, uint32_t *sectors_per_fat, uint32_t *clusters)
+{
+	uint32_t fat_sectors = 1;
+	for (;;)
+	{
+		uint64_t overhead = RESERVED_SECTORS + FAT_COPIES * (uint64_t) fat_sectors + root_sectors;
+		if (overhead >= total_sectors)
+		{
+			return 0;
+		}
+
+		uint32_t count = (total_sectors - overhead) / sectors_per_cluster;
+		uint32_t needed = ((uint64_t) (count + 2) * bits + SECTOR_SIZE * 8 - 1) / (SECTOR_SIZE * 8);
+		if (needed <= fat_sectors)
+		{
+			*sectors_per_fat = fat_sectors;
+			*clusters = count;
+			return 1;
+		}
+		fat_sectors = needed;
+	}
+}
+
+//Truncates fd to size (rounded down to a whole sector) and lays out an empty
+//file system of the given width on it, with the smallest clusters that fit.
+//Fails if the size can't hold that width.
+uint8_t fat_writer_create(fat_writer_t *w, int fd, uint64_t size, uint8_t bits, const char *label)
+{
+	w->fd = fd;
+	w->image = NULL;
+	w->entries = NULL;
+
+	uint64_t total_sectors = size / SECTOR_SIZE;
+	if ((bits != 12 && bits != 16) || total_sectors > UINT32_MAX)
+	{
+		return 0;
+	}
+
+	uint32_t max_clusters = bits == 12 ? FAT12_MAX_CLUSTERS : FAT16_MAX_CLUSTERS;
+	w->max_root_dir_entries = bits == 12 ? 224 : 512;
+	uint32_t root_sectors = w->max_root_dir_entries * DIR_ENTRY_MEMBER_SIZE / SECTOR_SIZE;
+
+	uint32_t sectors_per_cluster, sectors_per_fat = 0, clusters = 0;
+	for (sectors_per_cluster = 1; sectors_per_cluster <= MAX_SECTORS_PER_CLUSTER; sectors_per_cluster *= 2)
+	{
+		if (size_table(total_sectors, bits, sectors_per_cluster, root_sectors, &sectors_per_fat, &clusters) &&
+			clusters < max_clusters)
+		{
+			break;
+		}
+	}
+
+	//Anything smaller would be read back as FAT12
+	if (sectors_per_cluster > MAX_SECTORS_PER_CLUSTER || (bits == 16 && clusters < FAT12_MAX_CLUSTERS))
+	{
+		return 0;
+	}
+
+	w->bits = bits;
+	w->image_size = total_sectors * SECTOR_SIZE;
+	w->cluster_size = sectors_per_cluster * SECTOR_SIZE;
+	w->num_clusters = clusters;
+	w->fat_copies = FAT_COPIES;
+	w->bytes_per_fat = sectors_per_fat * SECTOR_SIZE;
+	w->fat_offset = RESERVED_SECTORS * SECTOR_SIZE;
+	w->root_offset = w->fat_offset + (uint64_t) FAT_COPIES * w->bytes_per_fat;
+	w->data_offset = w->root_offset + root_sectors * SECTOR_SIZE;
+
+	w->entries = calloc(clusters + 2, sizeof *w->entries);
+	if (w->entries == NULL)
+	{
+		return 0;
+	}
+	uint32_t end_of_chain = bits == 12 ? 0xfff : 0xffff;
+	w->entries[0] = (end_of_chain & ~0xff) | MEDIA_DESCRIPTOR;
+	w->entries[1] = end_of_chain;
+	w->next_free = 2;
+
+	//Truncating first makes sure everything not written below reads as zero
+	if (ftruncate(fd, 0) < 0 || ftruncate(fd, w->image_size) < 0)
+	{
+		return 0;
+	}
+
+	void *image = mmap(NULL, w->image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED)
+	{
+		return 0;
+	}
+	w->image = image;
+
+	write_boot_sector(w, total_sectors, sectors_per_cluster, sectors_per_fat, label);
+	return 1;
+}
+
+void write_boot_sector(fat_writer_t *w, uint64_t total_sectors, uint32_t sectors_per_cluster,
+	uint32_t sectors_per_fat, const char *label)
+{
+	uint8_t *boot = w->image;
+	boot[0] = 0xeb;
+	boot[1] = 0x3c;
+	boot[2] = 0x90;
+	memcpy(boot + 3, "MSWIN4.1", 8);
+	store_uint16_little_endian(boot + 11, SECTOR_SIZE);
+	boot[13] = sectors_per_cluster;
+	store_uint16_little_endian(boot + 14, RESERVED_SECTORS);
+	boot[16] = FAT_COPIES;
+	store_uint16_little_endian(boot + 17, w->max_root_dir_entries);
+	store_uint16_little_endian(boot + 19, total_sectors <= UINT16_MAX ? total_sectors : 0);
+	boot[21] = MEDIA_DESCRIPTOR;
+	store_uint16_little_endian(boot + 22, sectors_per_fat);
+	store_uint16_little_endian(boot + 24, 63);
+	store_uint16_little_endian(boot + 26, 255);
+	store_uint32_little_endian(boot + 32, total_sectors > UINT16_MAX ? total_sectors : 0);
+
+	//Extended boot record
+	boot[36] = 0x80;
+	boot[38] = 0x29;
+	store_uint32_little_endian(boot + 39, (uint32_t) time(NULL));
+	memset(boot + 43, ' ', 11);
+	if (label != NULL)
+	{
+		size_t len = strlen(label);
+		memcpy(boot + 43, label, len < 11 ? len : 11);
+	}
+	else
+	{
+		memcpy(boot + 43, "NO NAME", 7);
+	}
+	memcpy(boot + 54, w->bits == 12 ? "FAT12   " : "FAT16   ", 8);
+
+	boot[510] = 0x55;
+	boot[511] = 0xaa;
+
+	w->root_entries_used = 0;
+	if (label != NULL)
+	{
+		write_entry(w->image + w->root_offset, boot + 43, VOLUME_LABEL, 0, 0, time(NULL));
+		w->root_entries_used = 1;
+	}
+}
+
+//Encodes the table into every copy and unmaps the image. The file is left
+//open; closing it is up to the caller.
+uint8_t fat_writer_finish(fat_writer_t *w)
+{
+	uint8_t *table = w->image + w->fat_offset;
+	uint32_t count = w->num_clusters + 2;
+	if (w->bits == 12)
+	{
+		uint16_t *packed = malloc(count * sizeof *packed);
+		if (packed == NULL)
+		{
+			return 0;
+		}
+
+		uint32_t i;
+		for (i = 0; i < count; i++)
+		{
+			packed[i] = w->entries[i];
+		}
+		encode_fat12_entries(packed, table, count);
+		free(packed);
+	}
+	else
+	{
+		uint32_t i;
+		for (i = 0; i < count; i++)
+		{
+			store_uint16_little_endian(table + i * 2, w->entries[i]);
+		}
+	}
+
+	uint8_t copy;
+	for (copy = 1; copy < w->fat_copies; copy++)
+	{
+		memcpy(table + (uint64_t) copy * w->bytes_per_fat, table, w->bytes_per_fat);
+	}
+
+	uint8_t ok = msync(w->image, w->image_size, MS_SYNC) == 0;
+	munmap(w->image, w->image_size);
+	w->image = NULL;
+	return ok;
+}
+
+void fat_writer_free(fat_writer_t *w)
+{
+	if (w->image != NULL)
+	{
+		munmap(w->image, w->image_size);
+		w->image = NULL;
+	}
+	free(w->entries);
+	w->entries = NULL;
+}
+
+uint32_t fat_writer_clusters_for(fat_writer_t *w, uint64_t bytes)
+{
+	return (bytes + w->cluster_size - 1) / w->cluster_size;
+}
+
+//Appends the next clusters free clusters, which are always contiguous, to
+//chain. Start chain out as { 0, 0 }.
+uint8_t fat_writer_extend(fat_writer_t *w, fat_chain_t *chain, uint32_t clusters)
+{
+	if (clusters == 0)
+	{
+		return 1;
+	}
+
+	if (clusters > w->num_clusters + 2 - w->next_free)
+	{
+		return 0;
+	}
+
+	uint32_t first = w->next_free;
+	uint32_t last = first + clusters - 1;
+	uint32_t c;
+	for (c = first; c < last; c++)
+	{
+		w->entries[c] = c + 1;
+	}
+	w->entries[last] = w->bits == 12 ? 0xfff : 0xffff;
+
+	if (chain->first == 0)
+	{
+		chain->first = first;
+	}
+	else
+	{
+		w->entries[chain->last] = first;
+	}
+	chain->last = last;
+
+	w->next_free = last + 1;
+	return 1;
+}
+
+//Leaves the next clusters free clusters unused
+void fat_writer_skip(fat_writer_t *w, uint32_t clusters)
+{
+	uint32_t left = w->num_clusters + 2 - w->next_free;
+	w->next_free += clusters < left ? clusters : left;
+}
+
+uint8_t *fat_writer_cluster_data(fat_writer_t *w, uint32_t cluster)
+{
+	return w->image + w->data_offset + (uint64_t) (cluster - 2) * w->cluster_size;
+}
+
+//Copies up to max characters of src into dst as upper case, with anything
+//DOS doesn't allow in a name replaced by '_'. Returns 0 if that changed
+//anything or cut anything off.
+uint8_t copy_short_name_part(const char *src, size_t len, unsigned char *dst, size_t max)
+{
+	static const char *allowed = "!#$%&'()-@^_`{}~";
+	uint8_t exact = len <= max;
+
+	size_t i;
+	for (i = 0; i < len && i < max; i++)
+	{
+		//Names are looked up without regard to case, so that loses nothing
+		unsigned char c = toupper((unsigned char) src[i]);
+		if (!isalnum(c) && strchr(allowed, c) == NULL)
+		{
+			exact = 0;
+			c = '_';
+		}
+		dst[i] = c;
+	}
+
+	return exact;
+}
+
+//Makes an 8.3 name out of a host file name: the last '.' starts the
+//extension, and copy_short_name_part does the rest. Returns 0 if the name had
+//to be changed, in which case the caller should make it unique itself (with a
+//~N suffix, say).
+uint8_t fat_writer_short_name(const char *host_name, unsigned char name[MAX_FILE_NAME + MAX_EXTENSION])
+{
+	uint8_t exact = 1;
+
+	//Leading dots would read as "." or ".."
+	while (*host_name == '.')
+	{
+		host_name++;
+		exact = 0;
+	}
+
+	const char *dot = strrchr(host_name, '.');
+	size_t base_len = dot != NULL ? (size_t) (dot - host_name) : strlen(host_name);
+
+	memset(name, ' ', MAX_FILE_NAME + MAX_EXTENSION);
+	if (base_len == 0)
+	{
+		name[0] = '_';
+		exact = 0;
+	}
+
+	exact &= copy_short_name_part(host_name, base_len, name, MAX_FILE_NAME);
+	if (dot != NULL)
+	{
+		exact &= copy_short_name_part(dot + 1, strlen(dot + 1), name + MAX_FILE_NAME, MAX_EXTENSION);
+	}
+
+	return exact;
+}
+
+void fat_writer_root(fat_writer_t *w, fat_dir_t *root)
+{
+	root->cluster = 0;
+	root->offset = w->root_offset + w->root_entries_used * DIR_ENTRY_MEMBER_SIZE;
+	root->free_entries = w->max_root_dir_entries - w->root_entries_used;
+}
+
+void write_entry(uint8_t *dst, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint8_t attributes, uint32_t start_cluster, uint32_t size, time_t mtime)
+{
+	memset(dst, 0, DIR_ENTRY_MEMBER_SIZE);
+	memcpy(dst, name, MAX_FILE_NAME + MAX_EXTENSION);
+	dst[11] = attributes;
+
+	//DOS times start in 1980 and only have two second resolution
+	struct tm tm;
+	localtime_r(&mtime, &tm);
+	if (tm.tm_year < 80)
+	{
+		memset(&tm, 0, sizeof tm);
+		tm.tm_year = 80;
+		tm.tm_mday = 1;
+	}
+	store_uint16_little_endian(dst + 22, (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+	store_uint16_little_endian(dst + 24, ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+
+	store_uint16_little_endian(dst + 26, start_cluster);
+	store_uint32_little_endian(dst + 28, size);
+}
+
+uint8_t fat_writer_add_entry(fat_writer_t *w, fat_dir_t *dir, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint8_t attributes, uint32_t start_cluster, uint32_t size, time_t mtime)
+{
+	if (dir->free_entries == 0)
+	{
+		return 0;
+	}
+
+	write_entry(w->image + dir->offset, name, attributes, start_cluster, size, mtime);
+	dir->offset += DIR_ENTRY_MEMBER_SIZE;
+	dir->free_entries--;
+	return 1;
+}
+
+//Makes a directory in parent with room for entries entries (besides "." and
+//"..") in one contiguous run, and sets child up to fill it
+uint8_t fat_writer_mkdir(fat_writer_t *w, fat_dir_t *parent, const unsigned char name[MAX_FILE_NAME + MAX_EXTENSION],
+	uint32_t entries, time_t mtime, fat_dir_t *child)
+{
+	fat_chain_t chain = { 0, 0 };
+	uint32_t clusters = fat_writer_clusters_for(w, (uint64_t) (entries + 2) * DIR_ENTRY_MEMBER_SIZE);
+	if (parent->free_entries == 0 || !fat_writer_extend(w, &chain, clusters))
+	{
+		return 0;
+	}
+
+	uint8_t *data = fat_writer_cluster_data(w, chain.first);
+	memset(data, 0, (uint64_t) clusters * w->cluster_size);
+	write_entry(data, (const unsigned char *) ".          ", SUBDIRECTORY, chain.first, 0, mtime);
+	write_entry(data + DIR_ENTRY_MEMBER_SIZE, (const unsigned char *) "..         ", SUBDIRECTORY, parent->cluster, 0, mtime);
+
+	child->cluster = chain.first;
+	child->offset = data + 2 * DIR_ENTRY_MEMBER_SIZE - w->image;
+	child->free_entries = (uint64_t) clusters * w->cluster_size / DIR_ENTRY_MEMBER_SIZE - 2;
+
+	return fat_writer_add_entry(w, parent, name, SUBDIRECTORY, chain.first, 0, mtime);
+}
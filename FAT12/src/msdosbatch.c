@@ -0,0 +1,631 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fat12.h"
+#include "fat_manifest.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+#define IMAGES_FAILED 3
+
+//Processes many images in one run: each worker takes the next image off a
+//shared list, reads it, writes its manifest (and with -x, extracts it), and
+//moves on. Images are independent, so they're the unit of work; each one is
+//handled on a single thread.
+#define MANIFEST_BUFFER_SIZE (256 * 1024)
+
+#define STATUS_OK 0
+#define STATUS_OPEN_FAILED 1
+#define STATUS_READ_FAILED 2
+#define STATUS_WRITE_FAILED 3
+#define STATUS_EXTRACT_FAILED 4
+
+typedef struct
+{
+	char *image_path;
+	//What the manifest and the extracted tree are named after: the image's
+	//file name, with -N added if an earlier image had the same one, picked
+	//so it isn't any other image's name either, and with -x so no image's
+	//tree has the same path as another's manifest
+	char *name;
+	uint8_t status;
+	uint8_t bits;
+	uint32_t files;
+	uint32_t directories;
+	uint64_t bytes;
+} batch_image_t;
+
+typedef struct
+{
+	batch_image_t *images;
+	uint32_t num_images;
+	uint32_t capacity;
+	const char *out_dir;
+	uint8_t format;
+	uint8_t extract;
+	uint32_t next_image;
+} batch_job_t;
+
+//A name some image's output already has, in name_images' table
+typedef struct
+{
+	const char *name;
+	//For a file name several images share, the suffix to try next
+	uint32_t next_suffix;
+	//Whether an image has the name. A file name no image could keep is only
+	//there for its suffix.
+	uint8_t taken;
+} name_slot_t;
+
+uint8_t add_image(batch_job_t *job, const char *path);
+uint8_t add_directory(batch_job_t *job, const char *path);
+uint8_t add_list(batch_job_t *job, const char *list_path);
+uint8_t name_images(batch_job_t *job);
+const char *image_file_name(batch_image_t *image);
+name_slot_t *find_name(name_slot_t *names, uint32_t size, const char *name);
+uint8_t is_name_taken(name_slot_t *names, uint32_t size, const char *name);
+uint8_t is_name_free(batch_job_t *job, name_slot_t *names, uint32_t size, const char *name, char *scratch);
+const char *manifest_extension(batch_job_t *job);
+void *batch_worker(void *arg);
+void process_image(batch_job_t *job, batch_image_t *image);
+uint8_t extract_image(batch_job_t *job, batch_image_t *image, fat12_t *fat, extract_options_t *options);
+uint8_t write_image_manifest(batch_job_t *job, batch_image_t *image, fat12_t *fat, extract_options_t *hashes);
+void print_summary(batch_job_t *job);
+void free_job(batch_job_t *job);
+
+int main(int argc, char *argv[])
+{
+	batch_job_t job = { NULL, 0, 0, NULL, MANIFEST_CSV, 0, 0 };
+	int threads = 1;
+	const char *list_path = NULL;
+	uint8_t bad_option = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:f:l:x")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j': bad_option |= (threads = atoi(optarg)) < 1; break;
+			case 'f':
+				if (strcmp(optarg, "json") == 0)
+				{
+					job.format = MANIFEST_JSON;
+				}
+				else if (strcmp(optarg, "csv") != 0)
+				{
+					bad_option = 1;
+				}
+				break;
+			case 'l': list_path = optarg; break;
+			case 'x': job.extract = 1; break;
+			default: bad_option = 1; break;
+		}
+	}
+
+	if (bad_option || argc - optind < 1 || (argc - optind < 2 && list_path == NULL))
+	{
+		printf("Usage: %s [-j threads] [-f csv|json] [-x] [-l image_list] [image|directory ...] output_directory\n",
+			argv[0]);
+		return USER_ERROR;
+	}
+	job.out_dir = argv[argc - 1];
+
+	//Directories contribute every regular file in them; the list has one
+	//image per line, and - reads it from stdin
+	uint8_t ok = list_path == NULL || add_list(&job, list_path);
+	int i;
+	for (i = optind; ok && i < argc - 1; i++)
+	{
+		struct stat st;
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+		{
+			ok = add_directory(&job, argv[i]);
+		}
+		else
+		{
+			ok = add_image(&job, argv[i]);
+		}
+	}
+
+	if (!ok || !name_images(&job))
+	{
+		free_job(&job);
+		return SYSTEM_ERROR;
+	}
+
+	if (mkdir(job.out_dir, 0755) < 0 && errno != EEXIST)
+	{
+		perror("Could not create output directory");
+		free_job(&job);
+		return SYSTEM_ERROR;
+	}
+
+	if ((uint32_t) threads > job.num_images)
+	{
+		threads = job.num_images;
+	}
+
+	pthread_t *workers = NULL;
+	int started = 0;
+	if (threads > 1)
+	{
+		workers = malloc((threads - 1) * sizeof *workers);
+	}
+
+	//The calling thread works too, so even if no more threads can be started
+	//every image still gets processed
+	if (workers != NULL)
+	{
+		for (started = 0; started < threads - 1; started++)
+		{
+			if (pthread_create(workers + started, NULL, batch_worker, &job) != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	batch_worker(&job);
+
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+
+	print_summary(&job);
+
+	uint32_t failed = 0, n;
+	for (n = 0; n < job.num_images; n++)
+	{
+		failed += job.images[n].status != STATUS_OK;
+	}
+	free_job(&job);
+	return failed == 0 ? 0 : IMAGES_FAILED;
+}
+
+uint8_t add_image(batch_job_t *job, const char *path)
+{
+	if (job->num_images == job->capacity)
+	{
+		uint32_t capacity = job->capacity == 0 ? 64 : job->capacity * 2;
+		batch_image_t *images = realloc(job->images, capacity * sizeof *images);
+		if (images == NULL)
+		{
+			printf("Could not allocate memory.\n");
+			return 0;
+		}
+		job->images = images;
+		job->capacity = capacity;
+	}
+
+	batch_image_t *image = job->images + job->num_images;
+	memset(image, 0, sizeof *image);
+	image->image_path = strdup(path);
+	if (image->image_path == NULL)
+	{
+		printf("Could not allocate memory.\n");
+		return 0;
+	}
+
+	job->num_images++;
+	return 1;
+}
+
+uint8_t add_directory(batch_job_t *job, const char *path)
+{
+	//Sorted, so the summary comes out in a predictable order
+	struct dirent **names;
+	int count = scandir(path, &names, NULL, alphasort);
+	if (count < 0)
+	{
+		perror(path);
+		return 0;
+	}
+
+	uint8_t ok = 1;
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		size_t len = strlen(path) + 1 + strlen(names[i]->d_name) + 1;
+		char *image_path = malloc(len);
+		struct stat st;
+		if (image_path == NULL)
+		{
+			printf("Could not allocate memory.\n");
+			ok = 0;
+		}
+		else if (ok)
+		{
+			snprintf(image_path, len, "%s/%s", path, names[i]->d_name);
+			if (stat(image_path, &st) == 0 && S_ISREG(st.st_mode))
+			{
+				ok = add_image(job, image_path);
+			}
+		}
+		free(image_path);
+		free(names[i]);
+	}
+	free(names);
+
+	return ok;
+}
+
+uint8_t add_list(batch_job_t *job, const char *list_path)
+{
+	FILE *list = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+	if (list == NULL)
+	{
+		perror("Could not open image list");
+		return 0;
+	}
+
+	uint8_t ok = 1;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	while (ok && (len = getline(&line, &size, list)) >= 0)
+	{
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		{
+			line[--len] = '\0';
+		}
+
+		if (len > 0)
+		{
+			ok = add_image(job, line);
+		}
+	}
+	free(line);
+
+	if (list != stdin)
+	{
+		fclose(list);
+	}
+	return ok;
+}
+
+//Names outputs after the images' file names. Those only clash when images
+//come from different directories; later ones (in input order) get the first
+//of -2, -3 and so on that no other image is already named, so a generated
+//name can't take one that belongs to an image further down the list. With
+//-x, an image named a.csv would extract into the manifest of one named a,
+//so a name whose tree or manifest is another image's output isn't kept
+//either.
+uint8_t name_images(batch_job_t *job)
+{
+	//At most half full with every name plus every file name that's only
+	//there for its suffix, and a power of two so a mask picks the slot
+	uint32_t size = 16;
+	while (size < job->num_images * 4)
+	{
+		size *= 2;
+	}
+
+	//Room for any name with a suffix and an extension, for is_name_free
+	size_t max_len = 0;
+	uint32_t i;
+	for (i = 0; i < job->num_images; i++)
+	{
+		size_t len = strlen(image_file_name(job->images + i));
+		max_len = len > max_len ? len : max_len;
+	}
+
+	name_slot_t *names = calloc(size, sizeof *names);
+	char *scratch = malloc(max_len + 12 + strlen(manifest_extension(job)));
+	uint8_t ok = names != NULL && scratch != NULL;
+
+	//Each file name goes to the first image that has it
+	for (i = 0; i < job->num_images && ok; i++)
+	{
+		batch_image_t *image = job->images + i;
+		const char *base = image_file_name(image);
+		if (is_name_free(job, names, size, base, scratch))
+		{
+			image->name = strdup(base);
+			ok = image->name != NULL;
+			name_slot_t *slot = find_name(names, size, base);
+			slot->name = image->name;
+			slot->next_suffix = 2;
+			slot->taken = 1;
+		}
+	}
+
+	//And every other image with it gets the next suffix that's free
+	for (i = 0; i < job->num_images && ok; i++)
+	{
+		batch_image_t *image = job->images + i;
+		if (image->name != NULL)
+		{
+			continue;
+		}
+
+		const char *base = image_file_name(image);
+		size_t len = strlen(base) + 12;
+		image->name = malloc(len);
+		if (image->name == NULL)
+		{
+			ok = 0;
+			break;
+		}
+
+		name_slot_t *base_slot = find_name(names, size, base);
+		if (base_slot->name == NULL)
+		{
+			base_slot->name = base;
+			base_slot->next_suffix = 2;
+		}
+
+		uint32_t suffix = base_slot->next_suffix;
+		for (;; suffix++)
+		{
+			snprintf(image->name, len, "%s-%u", base, suffix);
+			if (is_name_free(job, names, size, image->name, scratch))
+			{
+				break;
+			}
+		}
+
+		name_slot_t *slot = find_name(names, size, image->name);
+		if (slot->name == NULL)
+		{
+			slot->next_suffix = 2;
+		}
+		slot->name = image->name;
+		slot->taken = 1;
+		base_slot->next_suffix = suffix + 1;
+	}
+	free(names);
+	free(scratch);
+
+	if (!ok)
+	{
+		printf("Could not allocate memory.\n");
+	}
+	return ok;
+}
+
+//The last component of the image's path
+const char *image_file_name(batch_image_t *image)
+{
+	const char *base = strrchr(image->image_path, '/');
+	return base != NULL ? base + 1 : image->image_path;
+}
+
+//The slot holding name, or the empty one it would go in
+name_slot_t *find_name(name_slot_t *names, uint32_t size, const char *name)
+{
+	uint32_t slot = hash_path(name) & (size - 1);
+	while (names[slot].name != NULL && strcmp(names[slot].name, name) != 0)
+	{
+		slot = (slot + 1) & (size - 1);
+	}
+
+	return names + slot;
+}
+
+uint8_t is_name_taken(name_slot_t *names, uint32_t size, const char *name)
+{
+	name_slot_t *slot = find_name(names, size, name);
+	return slot->name != NULL && slot->taken;
+}
+
+//Whether an image can be named name. Without -x the manifest is an image's
+//only output, so that's when no image has it. With -x its tree can't be
+//another image's manifest, and its manifest can't be another image's tree.
+//scratch needs room for name and the manifest's extension.
+uint8_t is_name_free(batch_job_t *job, name_slot_t *names, uint32_t size, const char *name, char *scratch)
+{
+	if (is_name_taken(names, size, name))
+	{
+		return 0;
+	}
+	if (!job->extract)
+	{
+		return 1;
+	}
+
+	const char *extension = manifest_extension(job);
+	size_t len = strlen(name);
+	size_t extension_len = strlen(extension);
+	if (len > extension_len && strcmp(name + len - extension_len, extension) == 0)
+	{
+		memcpy(scratch, name, len - extension_len);
+		scratch[len - extension_len] = '\0';
+		if (is_name_taken(names, size, scratch))
+		{
+			return 0;
+		}
+	}
+
+	strcpy(scratch, name);
+	strcat(scratch, extension);
+	return !is_name_taken(names, size, scratch);
+}
+
+const char *manifest_extension(batch_job_t *job)
+{
+	return job->format == MANIFEST_JSON ? ".json" : ".csv";
+}
+
+//Takes images off the shared job one at a time until there are none left
+void *batch_worker(void *arg)
+{
+	batch_job_t *job = arg;
+	for (;;)
+	{
+		uint32_t n = __atomic_fetch_add(&job->next_image, 1, __ATOMIC_RELAXED);
+		if (n >= job->num_images)
+		{
+			break;
+		}
+
+		process_image(job, job->images + n);
+	}
+
+	return NULL;
+}
+
+void process_image(batch_job_t *job, batch_image_t *image)
+{
+	int fd = open(image->image_path, O_RDONLY);
+	if (fd < 0)
+	{
+		image->status = STATUS_OPEN_FAILED;
+		return;
+	}
+
+	fat12_t fat;
+	if (!read_fat12(fd, &fat))
+	{
+		image->status = STATUS_READ_FAILED;
+		free_fat12(&fat);
+		close(fd);
+		return;
+	}
+
+	image->bits = fat.ops->bits;
+	uint32_t i;
+	for (i = 0; i < fat.num_nodes; i++)
+	{
+		if (is_directory(&fat.nodes[i].entry))
+		{
+			image->directories++;
+		}
+		else
+		{
+			image->files++;
+			image->bytes += fat.nodes[i].entry.filesize;
+		}
+	}
+
+	//With -x the manifest is written after extracting, so it can have each
+	//file's checksums, taken as the file was written. Files that couldn't be
+	//extracted are still listed, just without checksums.
+	extract_options_t options = { NULL, NULL, NULL, 0 };
+	uint8_t status = job->extract ? extract_image(job, image, &fat, &options) : STATUS_OK;
+	if (status != STATUS_WRITE_FAILED &&
+		!write_image_manifest(job, image, &fat, job->extract ? &options : NULL))
+	{
+		status = STATUS_WRITE_FAILED;
+	}
+	image->status = status;
+
+	free(options.hashes);
+	free(options.crcs);
+	free(options.hashed);
+	free_fat12(&fat);
+	close(fd);
+}
+
+//Within an image everything is extracted on this thread; the other threads
+//are busy with other images. Returns STATUS_WRITE_FAILED if nothing could be
+//extracted, and STATUS_EXTRACT_FAILED if only some files were.
+uint8_t extract_image(batch_job_t *job, batch_image_t *image, fat12_t *fat, extract_options_t *options)
+{
+	options->hashes = calloc(fat->num_nodes, sizeof *options->hashes);
+	options->crcs = calloc(fat->num_nodes, sizeof *options->crcs);
+	options->hashed = calloc(fat->num_nodes, sizeof *options->hashed);
+	size_t len = strlen(job->out_dir) + 1 + strlen(image->name) + 1;
+	char *out_dir = malloc(len);
+	if (out_dir == NULL || (fat->num_nodes > 0 &&
+		(options->hashes == NULL || options->crcs == NULL || options->hashed == NULL)))
+	{
+		free(out_dir);
+		return STATUS_WRITE_FAILED;
+	}
+
+	snprintf(out_dir, len, "%s/%s", job->out_dir, image->name);
+	uint8_t status = STATUS_WRITE_FAILED;
+	if (mkdir(out_dir, 0755) == 0 || errno == EEXIST)
+	{
+		status = extract_files(fat, out_dir, NO_NODE, 1, options) == 0 ? STATUS_OK : STATUS_EXTRACT_FAILED;
+	}
+
+	free(out_dir);
+	return status;
+}
+
+uint8_t write_image_manifest(batch_job_t *job, batch_image_t *image, fat12_t *fat, extract_options_t *hashes)
+{
+	const char *extension = manifest_extension(job);
+	size_t len = strlen(job->out_dir) + 1 + strlen(image->name) + strlen(extension) + 1;
+	char *path = malloc(len);
+	if (path == NULL)
+	{
+		return 0;
+	}
+	snprintf(path, len, "%s/%s%s", job->out_dir, image->name, extension);
+
+	FILE *out = fopen(path, "w");
+	free(path);
+	if (out == NULL)
+	{
+		return 0;
+	}
+	setvbuf(out, NULL, _IOFBF, MANIFEST_BUFFER_SIZE);
+
+	uint8_t ok = write_manifest(fat, image->image_path, out, job->format, hashes);
+	return fclose(out) == 0 && ok;
+}
+
+//One line (or object) per image, in input order, whatever order they were
+//processed in
+void print_summary(batch_job_t *job)
+{
+	static const char *statuses[] = { "ok", "could not open", "not a FAT image", "could not write output", "could not extract every file" };
+	if (job->format == MANIFEST_JSON)
+	{
+		printf("[");
+	}
+	else
+	{
+		printf("image,name,status,fat,files,directories,bytes\n");
+	}
+
+	uint32_t i;
+	for (i = 0; i < job->num_images; i++)
+	{
+		batch_image_t *image = job->images + i;
+		if (job->format == MANIFEST_JSON)
+		{
+			printf("%s\n  {\"image\": ", i == 0 ? "" : ",");
+			write_json_string(stdout, image->image_path);
+			printf(", \"name\": ");
+			write_json_string(stdout, image->name);
+			printf(", \"status\": \"%s\", \"fat\": %u, \"files\": %u, \"directories\": %u, \"bytes\": %llu}",
+				statuses[image->status], image->bits, image->files, image->directories,
+				(unsigned long long) image->bytes);
+		}
+		else
+		{
+			write_csv_string(stdout, image->image_path);
+			putchar(',');
+			write_csv_string(stdout, image->name);
+			printf(",%s,%u,%u,%u,%llu\n", statuses[image->status], image->bits,
+				image->files, image->directories, (unsigned long long) image->bytes);
+		}
+	}
+
+	if (job->format == MANIFEST_JSON)
+	{
+		printf("%s]\n", job->num_images > 0 ? "\n" : "");
+	}
+}
+
+void free_job(batch_job_t *job)
+{
+	uint32_t i;
+	for (i = 0; i < job->num_images; i++)
+	{
+		free(job->images[i].image_path);
+		free(job->images[i].name);
+	}
+	free(job->images);
+}
@@ -0,0 +1,504 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fat_writer.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+
+//Builds an image out of a directory tree on the host. The whole tree is read
+//first, so the image can be sized for it up front; then all the directories
+//are laid out together at the start of the data area, and every file after
+//them in one contiguous run of clusters, read straight into the image.
+#define MAX_SUFFIX 999999
+
+typedef struct
+{
+	char *host_path;
+	unsigned char name[MAX_FILE_NAME + MAX_EXTENSION];
+	uint8_t attributes;
+	uint32_t size;
+	time_t mtime;
+	//Children are contiguous, since the tree is read breadth first
+	uint32_t first_child;
+	uint32_t num_children;
+	fat_dir_t dir;
+} build_node_t;
+
+typedef struct
+{
+	build_node_t *nodes;
+	uint32_t num_nodes;
+	uint32_t capacity;
+	uint32_t directories;
+	uint64_t total_bytes;
+	//The output file, so building an image inside the source tree doesn't
+	//try to copy it into itself
+	dev_t skip_dev;
+	ino_t skip_ino;
+} build_tree_t;
+
+uint8_t read_host_tree(build_tree_t *tree, const char *source);
+uint8_t read_host_directory(build_tree_t *tree, uint32_t parent);
+uint8_t add_host_node(build_tree_t *tree, const char *path, const char *name, struct stat *st, uint32_t parent);
+void make_unique_name(build_tree_t *tree, uint32_t parent, uint32_t n, uint8_t exact);
+uint8_t name_taken(build_tree_t *tree, uint32_t first, uint32_t n);
+uint8_t tree_fits(fat_writer_t *w, build_tree_t *tree, uint8_t has_label);
+uint8_t create_image(fat_writer_t *w, int fd, build_tree_t *tree, unsigned long size_kb, int bits, const char *label);
+uint8_t write_tree(fat_writer_t *w, build_tree_t *tree);
+uint8_t copy_host_file(fat_writer_t *w, build_node_t *node, uint32_t first_cluster);
+void free_tree(build_tree_t *tree);
+
+int main(int argc, char *argv[])
+{
+	int bits = 0;
+	unsigned long size_kb = 0;
+	const char *label = NULL;
+	uint8_t bad_option = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:s:l:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': bits = atoi(optarg); break;
+			case 's': size_kb = strtoul(optarg, NULL, 10); break;
+			case 'l': label = optarg; break;
+			default: bad_option = 1; break;
+		}
+	}
+
+	if (bad_option || optind != argc - 2 || (bits != 0 && bits != 12 && bits != 16))
+	{
+		printf("Usage: %s [-t 12|16] [-s size_kb] [-l label] source_directory output_file\n", argv[0]);
+		return USER_ERROR;
+	}
+
+	int fd = open(argv[optind + 1], O_RDWR | O_CREAT, 0644);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		perror("Could not open output file");
+		return SYSTEM_ERROR;
+	}
+
+	build_tree_t tree = { NULL, 0, 0, 0, 0, st.st_dev, st.st_ino };
+	if (!read_host_tree(&tree, argv[optind]))
+	{
+		free_tree(&tree);
+		close(fd);
+		return SYSTEM_ERROR;
+	}
+
+	fat_writer_t w;
+	if (!create_image(&w, fd, &tree, size_kb, bits, label))
+	{
+		fat_writer_free(&w);
+		free_tree(&tree);
+		close(fd);
+		return USER_ERROR;
+	}
+
+	if (!write_tree(&w, &tree) || !fat_writer_finish(&w))
+	{
+		fat_writer_free(&w);
+		free_tree(&tree);
+		close(fd);
+		return SYSTEM_ERROR;
+	}
+
+	printf("%u file(s), %llu bytes, %u directories, %u of %u clusters used\n",
+		tree.num_nodes - 1 - tree.directories, (unsigned long long) tree.total_bytes, tree.directories,
+		w.next_free - 2, w.num_clusters);
+	fat_writer_free(&w);
+	free_tree(&tree);
+	close(fd);
+	return 0;
+}
+
+//Reads the names, sizes and times of everything under source, breadth first.
+//Anything that isn't a regular file or a directory is left out.
+uint8_t read_host_tree(build_tree_t *tree, const char *source)
+{
+	struct stat st;
+	if (stat(source, &st) < 0 || !S_ISDIR(st.st_mode))
+	{
+		printf("%s is not a directory.\n", source);
+		return 0;
+	}
+
+	if (!add_host_node(tree, source, "", &st, 0))
+	{
+		return 0;
+	}
+
+	uint32_t i;
+	for (i = 0; i < tree->num_nodes; i++)
+	{
+		if ((tree->nodes[i].attributes & SUBDIRECTORY) && !read_host_directory(tree, i))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+uint8_t read_host_directory(build_tree_t *tree, uint32_t parent)
+{
+	//Sorted, so the same tree always makes the same image
+	struct dirent **names;
+	int count = scandir(tree->nodes[parent].host_path, &names, NULL, alphasort);
+	if (count < 0)
+	{
+		perror(tree->nodes[parent].host_path);
+		return 0;
+	}
+
+	tree->nodes[parent].first_child = tree->num_nodes;
+	uint8_t ok = 1;
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		const char *name = names[i]->d_name;
+		if (ok && strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+		{
+			size_t len = strlen(tree->nodes[parent].host_path) + 1 + strlen(name) + 1;
+			char *path = malloc(len);
+			struct stat st;
+			if (path == NULL)
+			{
+				printf("Could not allocate memory.\n");
+				ok = 0;
+			}
+			else
+			{
+				snprintf(path, len, "%s/%s", tree->nodes[parent].host_path, name);
+				//Symbolic links aren't followed, so one pointing back up the tree
+				//can't make it endless; like anything else that isn't a
+				//regular file or a directory, they're left out
+				if (lstat(path, &st) < 0)
+				{
+					perror(path);
+					ok = 0;
+				}
+				else if ((S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) &&
+					!(st.st_dev == tree->skip_dev && st.st_ino == tree->skip_ino))
+				{
+					ok = add_host_node(tree, path, name, &st, parent);
+				}
+			}
+			free(path);
+		}
+		free(names[i]);
+	}
+	free(names);
+
+	return ok;
+}
+
+uint8_t add_host_node(build_tree_t *tree, const char *path, const char *name, struct stat *st, uint32_t parent)
+{
+	if (S_ISREG(st->st_mode) && st->st_size > UINT32_MAX)
+	{
+		printf("%s is too large for a FAT file system.\n", path);
+		return 0;
+	}
+
+	if (tree->num_nodes == tree->capacity)
+	{
+		uint32_t capacity = tree->capacity == 0 ? 64 : tree->capacity * 2;
+		build_node_t *nodes = realloc(tree->nodes, capacity * sizeof *nodes);
+		if (nodes == NULL)
+		{
+			printf("Could not allocate memory.\n");
+			return 0;
+		}
+		tree->nodes = nodes;
+		tree->capacity = capacity;
+	}
+
+	build_node_t *node = tree->nodes + tree->num_nodes;
+	node->host_path = strdup(path);
+	if (node->host_path == NULL)
+	{
+		printf("Could not allocate memory.\n");
+		return 0;
+	}
+
+	node->first_child = 0;
+	node->num_children = 0;
+	node->mtime = st->st_mtime;
+	if (S_ISDIR(st->st_mode))
+	{
+		node->attributes = SUBDIRECTORY;
+		node->size = 0;
+	}
+	else
+	{
+		node->attributes = ARCHIVE | (st->st_mode & S_IWUSR ? 0 : READ_ONLY);
+		node->size = st->st_size;
+	}
+
+	uint32_t n = tree->num_nodes++;
+	//Everything but the top directory itself
+	if (n > 0)
+	{
+		tree->nodes[parent].num_children++;
+		if (node->attributes & SUBDIRECTORY)
+		{
+			tree->directories++;
+		}
+		tree->total_bytes += node->size;
+		make_unique_name(tree, parent, n, fat_writer_short_name(name, node->name));
+	}
+
+	return 1;
+}
+
+//Names that had to be changed, or that clash with an earlier one in the same
+//directory, get the first free ~N suffix, the way DOS would
+void make_unique_name(build_tree_t *tree, uint32_t parent, uint32_t n, uint8_t exact)
+{
+	uint32_t first = tree->nodes[parent].first_child;
+	unsigned char *name = tree->nodes[n].name;
+	if (exact && !name_taken(tree, first, n))
+	{
+		return;
+	}
+
+	unsigned char base[MAX_FILE_NAME];
+	memcpy(base, name, MAX_FILE_NAME);
+	uint32_t suffix;
+	for (suffix = 1; suffix <= MAX_SUFFIX; suffix++)
+	{
+		char tail[MAX_FILE_NAME + 1];
+		int tail_len = snprintf(tail, sizeof tail, "~%u", suffix);
+
+		//Keep as much of the name as fits in front of the suffix
+		int keep = MAX_FILE_NAME - tail_len;
+		while (keep > 1 && base[keep - 1] == ' ')
+		{
+			keep--;
+		}
+		memset(name, ' ', MAX_FILE_NAME);
+		memcpy(name, base, keep);
+		memcpy(name + keep, tail, tail_len);
+
+		if (!name_taken(tree, first, n))
+		{
+			return;
+		}
+	}
+}
+
+uint8_t name_taken(build_tree_t *tree, uint32_t first, uint32_t n)
+{
+	uint32_t i;
+	for (i = first; i < n; i++)
+	{
+		if (memcmp(tree->nodes[i].name, tree->nodes[n].name, MAX_FILE_NAME + MAX_EXTENSION) == 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+//Whether everything can go in w: every directory and every file needs its
+//own clusters, and the top directory's entries have to fit in the root
+//directory
+uint8_t tree_fits(fat_writer_t *w, build_tree_t *tree, uint8_t has_label)
+{
+	if (tree->nodes[0].num_children + has_label > w->max_root_dir_entries)
+	{
+		return 0;
+	}
+
+	uint64_t clusters = 0;
+	uint32_t i;
+	for (i = 1; i < tree->num_nodes; i++)
+	{
+		build_node_t *node = tree->nodes + i;
+		if (node->attributes & SUBDIRECTORY)
+		{
+			clusters += fat_writer_clusters_for(w, (uint64_t) (node->num_children + 2) * DIR_ENTRY_MEMBER_SIZE);
+		}
+		else
+		{
+			clusters += fat_writer_clusters_for(w, node->size);
+		}
+	}
+
+	return clusters <= w->num_clusters;
+}
+
+//Makes an empty file system the tree fits in. Without a size, starts from an
+//estimate and grows it an eighth at a time until it fits; without a width,
+//uses FAT12 when that's big enough.
+uint8_t create_image(fat_writer_t *w, int fd, build_tree_t *tree, unsigned long size_kb, int bits, const char *label)
+{
+	w->image = NULL;
+	w->entries = NULL;
+
+	//FAT12 root directories hold 224 entries and FAT16 ones 512
+	if (tree->nodes[0].num_children + (label != NULL) > (bits == 12 ? 224 : 512))
+	{
+		printf("The top directory has too many entries for a FAT%d root directory.\n", bits == 12 ? 12 : 16);
+		return 0;
+	}
+
+	uint64_t size = (uint64_t) size_kb * 1024;
+	if (size_kb == 0)
+	{
+		size = tree->total_bytes + (uint64_t) tree->num_nodes * DIR_ENTRY_MEMBER_SIZE + 64 * 1024;
+	}
+
+	//FAT16 tops out at 65524 clusters of 64 KB
+	const uint64_t max_size = (uint64_t) 4 * 1024 * 1024 * 1024;
+	while (size <= max_size)
+	{
+		uint8_t width;
+		for (width = 12; width <= 16; width += 4)
+		{
+			if (bits != 0 && width != bits)
+			{
+				continue;
+			}
+
+			if (fat_writer_create(w, fd, size, width, label) && tree_fits(w, tree, label != NULL))
+			{
+				return 1;
+			}
+			fat_writer_free(w);
+		}
+
+		if (size_kb != 0)
+		{
+			break;
+		}
+		size += size / 8;
+	}
+
+	if (size_kb != 0)
+	{
+		printf("The tree doesn't fit in a FAT%s file system of %lu KB.\n",
+			bits == 12 ? "12" : bits == 16 ? "16" : "12 or FAT16", size_kb);
+	}
+	else
+	{
+		printf("The tree is too large for a FAT%s file system.\n",
+			bits == 12 ? "12" : bits == 16 ? "16" : "12 or FAT16");
+	}
+	return 0;
+}
+
+//Lays every directory out first, breadth first, so they're packed together
+//at the start of the data area, then every file, each in one extent
+uint8_t write_tree(fat_writer_t *w, build_tree_t *tree)
+{
+	fat_writer_root(w, &tree->nodes[0].dir);
+
+	uint32_t i, c;
+	for (i = 0; i < tree->num_nodes; i++)
+	{
+		build_node_t *parent = tree->nodes + i;
+		for (c = parent->first_child; c < parent->first_child + parent->num_children; c++)
+		{
+			build_node_t *node = tree->nodes + c;
+			if ((node->attributes & SUBDIRECTORY) &&
+				!fat_writer_mkdir(w, &parent->dir, node->name, node->num_children, node->mtime, &node->dir))
+			{
+				printf("Could not make directory %s.\n", node->host_path);
+				return 0;
+			}
+		}
+	}
+
+	for (i = 0; i < tree->num_nodes; i++)
+	{
+		build_node_t *parent = tree->nodes + i;
+		for (c = parent->first_child; c < parent->first_child + parent->num_children; c++)
+		{
+			build_node_t *node = tree->nodes + c;
+			if (node->attributes & SUBDIRECTORY)
+			{
+				continue;
+			}
+
+			fat_chain_t chain = { 0, 0 };
+			if (!fat_writer_extend(w, &chain, fat_writer_clusters_for(w, node->size)) ||
+				!copy_host_file(w, node, chain.first) ||
+				!fat_writer_add_entry(w, &parent->dir, node->name, node->attributes, chain.first, node->size, node->mtime))
+			{
+				printf("Could not copy %s.\n", node->host_path);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+//Reads the whole file straight into its clusters in as few reads as the
+//kernel allows. The rest of the last cluster is already zero.
+uint8_t copy_host_file(fat_writer_t *w, build_node_t *node, uint32_t first_cluster)
+{
+	if (node->size == 0)
+	{
+		return 1;
+	}
+
+	int fd = open(node->host_path, O_RDONLY);
+	if (fd < 0)
+	{
+		perror(node->host_path);
+		return 0;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	uint8_t *dst = fat_writer_cluster_data(w, first_cluster);
+	uint32_t done = 0;
+	while (done < node->size)
+	{
+		ssize_t n = read(fd, dst + done, node->size - done);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			if (n < 0)
+			{
+				perror(node->host_path);
+			}
+			else
+			{
+				printf("%s got shorter while it was being copied.\n", node->host_path);
+			}
+			close(fd);
+			return 0;
+		}
+		done += n;
+	}
+
+	close(fd);
+	return 1;
+}
+
+void free_tree(build_tree_t *tree)
+{
+	uint32_t i;
+	for (i = 0; i < tree->num_nodes; i++)
+	{
+		free(tree->nodes[i].host_path);
+	}
+	free(tree->nodes);
+}
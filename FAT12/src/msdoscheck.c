@@ -0,0 +1,52 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fat12.h"
+#include "fat_check.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+#define PROBLEMS_FOUND 3
+
+int main(int argc, char *argv[])
+{
+	//-j sets how many chains are checked at once
+	int threads = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:")) != -1)
+	{
+		if (opt != 'j' || (threads = atoi(optarg)) < 1)
+		{
+			printf("Usage: %s [-j threads] input_file\n", argv[0]);
+			return USER_ERROR;
+		}
+	}
+
+	if (argc - optind < 1)
+	{
+		printf("Please include the input file as a command line argument.\n");
+		return USER_ERROR;
+	}
+
+	int fd = open(argv[optind], O_RDONLY, NULL);
+	if (fd < 0)
+	{
+		perror("Could not open input file");
+		return SYSTEM_ERROR;
+	}
+
+	fat12_t fat;
+	if (!read_fat12(fd, &fat))
+	{
+		fprintf(stderr, "Could not read file system.\n");
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
+
+	uint32_t problems = check_fat12(&fat, threads);
+	free_fat12(&fat);
+	return problems == 0 ? 0 : PROBLEMS_FOUND;
+}
@@ -1,8 +1,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "fat12.h"
+#include "fat_stream.h"
 
 #define USER_ERROR 1
 #define SYSTEM_ERROR 2
@@ -11,11 +14,12 @@ int main(int argc, char *argv[])
 {
 	if (argc < 2)
 	{
-		printf("Please include the input file as a command line argument.\n");
+		printf("Please include the input file as a command line argument, optionally followed by a path to list.\n");
 		return USER_ERROR;
 	}
 
-	int fd = open(argv[1], O_RDONLY, NULL);
+	//- reads the image from stdin, and .gz images are decompressed on the fly
+	int fd = strcmp(argv[1], "-") == 0 ? STDIN_FILENO : open(argv[1], O_RDONLY, NULL);
 	if (fd < 0)
 	{
 		perror("Could not open input file");
@@ -23,14 +27,24 @@ int main(int argc, char *argv[])
 	}
 
 	fat12_t fat;
-	if (!read_fat12(fd, &fat))
+	if (is_stream_name(argv[1]) ? !read_fat12_stream(fd, &fat, NULL, NULL) : !read_fat12(fd, &fat))
 	{
 		fprintf(stderr, "Could not read file system.");
 		free_fat12(&fat);
 		return SYSTEM_ERROR;
 	}
 
-	print_fat12(&fat);
+	if (argc < 3)
+	{
+		print_fat12(&fat);
+	}
+	else if (!print_path(&fat, argv[2]))
+	{
+		printf("%s is not in the file system.\n", argv[2]);
+		free_fat12(&fat);
+		return USER_ERROR;
+	}
+
 	free_fat12(&fat);
 	return 0;
 }
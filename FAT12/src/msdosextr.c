@@ -1,21 +1,58 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "fat12.h"
+#include "fat_manifest.h"
+#include "fat_stream.h"
 
 #define USER_ERROR 1
 #define SYSTEM_ERROR 2;
 
+uint8_t extract_with_manifest(fat12_t *fat, const char *image_name, char *out_dir, uint32_t selected, int threads, const char *manifest, uint8_t incremental);
+
 int main(int argc, char *argv[])
 {
-	if (argc < 3)
+	//-j sets how many files are extracted at once, -p picks a single file or
+	//directory to extract instead of everything, -c writes a manifest with
+	//every extracted file's checksums, and -m does the same but also reads the
+	//last one so only what changed since is written
+	int threads = 1;
+	char *path = NULL;
+	char *manifest = NULL;
+	uint8_t incremental = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:p:c:m:")) != -1)
+	{
+		if (opt == 'p')
+		{
+			path = optarg;
+		}
+		else if (opt == 'c' || opt == 'm')
+		{
+			manifest = optarg;
+			incremental = opt == 'm';
+		}
+		else if (opt != 'j' || (threads = atoi(optarg)) < 1)
+		{
+			printf("Usage: %s [-j threads] [-p path] [-c checksums | -m manifest] input_file output_directory\n", argv[0]);
+			return USER_ERROR;
+		}
+	}
+
+	if (argc - optind < 2)
 	{
 		printf("Please include the input file and output directories as command line arguments.\n");
 		return USER_ERROR;
 	}
 
-	int fd = open(argv[1], O_RDONLY, NULL);
+	//- reads the image from stdin, and .gz images are decompressed on the fly.
+	//Either way it's read once, front to back, and files are extracted as it
+	//goes, so there's nothing for -j to split up.
+	int fd = strcmp(argv[optind], "-") == 0 ? STDIN_FILENO : open(argv[optind], O_RDONLY, NULL);
 	if (fd < 0)
 	{
 		perror("Could not open input file");
@@ -23,14 +60,112 @@ int main(int argc, char *argv[])
 	}
 
 	fat12_t fat;
-	if (!read_fat12(fd, &fat))
+	uint8_t stream = is_stream_name(argv[optind]);
+	if (stream && manifest != NULL)
+	{
+		//A stream's clusters come in disk order, not file order, so files
+		//can't be checksummed as they're written
+		printf("-c and -m need an image that can be mapped, not a stream.\n");
+		return USER_ERROR;
+	}
+
+	if (stream ? !read_fat12_stream(fd, &fat, argv[optind + 1], path) : !read_fat12(fd, &fat))
 	{
 		fprintf(stderr, "Could not read file system.");
 		free_fat12(&fat);
 		return SYSTEM_ERROR;
 	}
 
-	extract_files(fd, &fat, argv[2]);
+	uint32_t selected = NO_NODE;
+	if (path != NULL && (selected = find_path(&fat, path)) == NO_NODE)
+	{
+		printf("%s is not in the file system.\n", path);
+		free_fat12(&fat);
+		return USER_ERROR;
+	}
+
+	if (manifest != NULL)
+	{
+		if (!extract_with_manifest(&fat, argv[optind], argv[optind + 1], selected, threads, manifest, incremental))
+		{
+			free_fat12(&fat);
+			return SYSTEM_ERROR;
+		}
+	}
+	else if (!stream && extract_files(&fat, argv[optind + 1], selected, threads, NULL) > 0)
+	{
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
 	free_fat12(&fat);
 	return 0;
 }
+
+//Extracts, checksumming each file as it's written, then writes manifest with
+//the checksums. If incremental, the hashes are first read from manifest, if
+//it's there, and files whose entries and data haven't changed since it was
+//written aren't written again. The new manifest goes to a temporary file
+//first, so a run that fails partway leaves the old one alone. Returns 0 if
+//the manifest or any file couldn't be written.
+uint8_t extract_with_manifest(fat12_t *fat, const char *image_name, char *out_dir, uint32_t selected, int threads, const char *manifest, uint8_t incremental)
+{
+	extract_options_t options = { NULL, NULL, NULL, 0 };
+	options.hashes = calloc(fat->num_nodes, sizeof *options.hashes);
+	options.crcs = calloc(fat->num_nodes, sizeof *options.crcs);
+	options.hashed = calloc(fat->num_nodes, sizeof *options.hashed);
+	if (fat->num_nodes > 0 &&
+		(options.hashes == NULL || options.crcs == NULL || options.hashed == NULL))
+	{
+		printf("Could not allocate memory.\n");
+		free(options.hashes);
+		free(options.crcs);
+		free(options.hashed);
+		return 0;
+	}
+
+	FILE *in = incremental ? fopen(manifest, "r") : NULL;
+	if (in != NULL)
+	{
+		if (!read_manifest_hashes(fat, in, &options))
+		{
+			printf("%s isn't a manifest from -m; extracting everything.\n", manifest);
+		}
+		fclose(in);
+	}
+
+	uint32_t failures = extract_files(fat, out_dir, selected, threads, &options);
+
+	//With -m, files outside -p keep their hashes from last time, since they
+	//weren't looked at
+	char *temp_name = malloc(strlen(manifest) + sizeof ".tmp");
+	FILE *out = NULL;
+	if (temp_name != NULL)
+	{
+		strcpy(temp_name, manifest);
+		strcat(temp_name, ".tmp");
+		out = fopen(temp_name, "w");
+	}
+
+	uint8_t ok = out != NULL;
+	if (ok)
+	{
+		ok = write_manifest(fat, image_name, out, MANIFEST_CSV, &options);
+		ok = fclose(out) == 0 && ok;
+		ok = ok && rename(temp_name, manifest) == 0;
+	}
+
+	if (!ok)
+	{
+		perror("Could not write manifest");
+	}
+	else if (incremental)
+	{
+		printf("%u unchanged file(s) skipped\n", options.skipped);
+	}
+
+	free(temp_name);
+	free(options.hashes);
+	free(options.crcs);
+	free(options.hashed);
+	return ok && failures == 0;
+}
@@ -0,0 +1,241 @@
+#define FUSE_USE_VERSION 26
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "fat12.h"
+#include "fat_file.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+
+//Mounts an image read-only. The whole directory tree is decoded once, before
+//mounting, so lookups and listings never touch the image; file data is read
+//straight out of the mapping, and FUSE's default multithreaded loop serves
+//requests in parallel, since nothing below is modified after startup except
+//the extent map cache.
+fat12_t fat;
+
+//Extent maps, built the first time each file is opened and kept until
+//unmount, indexed by node
+fat_file_t **files;
+pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint8_t lookup(const char *path, uint32_t *node);
+time_t entry_time(direntry_t *entry);
+int msdos_getattr(const char *path, struct stat *st);
+int msdos_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
+int msdos_open(const char *path, struct fuse_file_info *fi);
+int msdos_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+struct fuse_operations operations =
+{
+	.getattr = msdos_getattr,
+	.readdir = msdos_readdir,
+	.open = msdos_open,
+	.read = msdos_read,
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s input_file mount_point [FUSE options]\n", argv[0]);
+		return USER_ERROR;
+	}
+
+	int fd = open(argv[1], O_RDONLY, NULL);
+	if (fd < 0)
+	{
+		perror("Could not open input file");
+		return SYSTEM_ERROR;
+	}
+
+	if (!read_fat12(fd, &fat))
+	{
+		fprintf(stderr, "Could not read file system.\n");
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
+
+	files = calloc(fat.num_nodes, sizeof *files);
+	if (files == NULL && fat.num_nodes > 0)
+	{
+		fprintf(stderr, "Could not allocate memory.\n");
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
+
+	//FUSE gets everything but the image, so the mount point comes first
+	argv[1] = argv[0];
+	int status = fuse_main(argc - 1, argv + 1, &operations, NULL);
+
+	uint32_t i;
+	for (i = 0; i < fat.num_nodes; i++)
+	{
+		if (files[i] != NULL)
+		{
+			fat_close(files[i]);
+			free(files[i]);
+		}
+	}
+	free(files);
+	free_fat12(&fat);
+	return status;
+}
+
+//"/" is the root, which has no node of its own (NO_NODE)
+uint8_t lookup(const char *path, uint32_t *node)
+{
+	if (strcmp(path, "/") == 0)
+	{
+		*node = NO_NODE;
+		return 1;
+	}
+
+	*node = find_path(&fat, path);
+	return *node != NO_NODE;
+}
+
+time_t entry_time(direntry_t *entry)
+{
+	struct tm tm;
+	memset(&tm, 0, sizeof tm);
+	tm.tm_year = 80 + (entry->date >> 9);
+	tm.tm_mon = ((entry->date >> 5) & 0xf) - 1;
+	tm.tm_mday = entry->date & 0x1f;
+	tm.tm_hour = entry->time >> 11;
+	tm.tm_min = (entry->time >> 5) & 0x3f;
+	//Stored in units of two seconds
+	tm.tm_sec = (entry->time & 0x1f) * 2;
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+int msdos_getattr(const char *path, struct stat *st)
+{
+	uint32_t node;
+	if (!lookup(path, &node))
+	{
+		return -ENOENT;
+	}
+
+	memset(st, 0, sizeof *st);
+	st->st_blksize = fat.cluster_size;
+	if (node == NO_NODE)
+	{
+		st->st_mode = S_IFDIR | 0555;
+		st->st_nlink = 2;
+		return 0;
+	}
+
+	direntry_t *entry = &fat.nodes[node].entry;
+	st->st_mtime = st->st_atime = st->st_ctime = entry_time(entry);
+	if (is_directory(entry))
+	{
+		st->st_mode = S_IFDIR | 0555;
+		st->st_nlink = 2;
+	}
+	else
+	{
+		st->st_mode = S_IFREG | 0444;
+		st->st_nlink = 1;
+		st->st_size = entry->filesize;
+		st->st_blocks = (entry->filesize + 511) / 512;
+	}
+
+	return 0;
+}
+
+int msdos_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
+{
+	uint32_t node;
+	if (!lookup(path, &node))
+	{
+		return -ENOENT;
+	}
+
+	uint32_t first, count;
+	if (node == NO_NODE)
+	{
+		first = 0;
+		count = fat.num_root_nodes;
+	}
+	else if (is_directory(&fat.nodes[node].entry))
+	{
+		first = fat.nodes[node].first_child;
+		count = fat.nodes[node].child_count;
+	}
+	else
+	{
+		return -ENOTDIR;
+	}
+
+	filler(buf, ".", NULL, 0);
+	filler(buf, "..", NULL, 0);
+
+	uint32_t i;
+	for (i = first; i < first + count; i++)
+	{
+		const char *name = strrchr(fat.nodes[i].path, '/');
+		filler(buf, name != NULL ? name + 1 : fat.nodes[i].path, NULL, 0);
+	}
+
+	return 0;
+}
+
+int msdos_open(const char *path, struct fuse_file_info *fi)
+{
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+	{
+		return -EROFS;
+	}
+
+	uint32_t node;
+	if (!lookup(path, &node) || node == NO_NODE)
+	{
+		return -ENOENT;
+	}
+
+	pthread_mutex_lock(&files_lock);
+	fat_file_t *file = files[node];
+	if (file == NULL)
+	{
+		file = malloc(sizeof *file);
+		if (file == NULL)
+		{
+			pthread_mutex_unlock(&files_lock);
+			return -ENOMEM;
+		}
+
+		if (!fat_open(&fat, fat.nodes[node].path, file))
+		{
+			int error = errno;
+			free(file);
+			pthread_mutex_unlock(&files_lock);
+			return -error;
+		}
+		files[node] = file;
+	}
+	pthread_mutex_unlock(&files_lock);
+
+	//Nothing ever changes, so the kernel can keep what it has cached
+	fi->fh = (uintptr_t) file;
+	fi->keep_cache = 1;
+	return 0;
+}
+
+int msdos_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	fat_file_t *file = (fat_file_t *) (uintptr_t) fi->fh;
+	ssize_t n = fat_pread(file, buf, size, offset);
+	return n < 0 ? -errno : n;
+}
@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fat_writer.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+
+//Builds synthetic images for testing and benchmarking the other tools. Files
+//get pseudo-random sizes and contents from a seeded generator, so the same
+//options always give the same files.
+#define MAX_DIRECTORIES 65536
+//Every entry gets the same time, 2000-01-01, so reruns are comparable
+#define FIXED_MTIME 946684800
+
+typedef struct
+{
+	uint32_t first_child;
+	uint32_t num_children;
+	uint32_t depth;
+	uint32_t files;
+	fat_dir_t dir;
+} gen_dir_t;
+
+uint64_t next_random(uint64_t *state);
+void fill_random(uint64_t *state, uint8_t *dst, size_t n);
+void make_name(char prefix, uint32_t n, const char *extension, unsigned char name[MAX_FILE_NAME + MAX_EXTENSION]);
+uint8_t write_file(fat_writer_t *w, fat_dir_t *dir, uint32_t n, uint32_t size, int fragmentation, uint64_t *state);
+
+int main(int argc, char *argv[])
+{
+	int bits = 12, fragmentation = 0;
+	unsigned long size_kb = 1440, files = 100, depth = 0, width = 2, max_file_size = 65536;
+	unsigned long long seed = 1;
+	uint8_t bad_option = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:s:n:d:w:f:z:S:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': bits = atoi(optarg); break;
+			case 's': size_kb = strtoul(optarg, NULL, 10); break;
+			case 'n': files = strtoul(optarg, NULL, 10); break;
+			case 'd': depth = strtoul(optarg, NULL, 10); break;
+			case 'w': width = strtoul(optarg, NULL, 10); break;
+			case 'f': fragmentation = atoi(optarg); break;
+			case 'z': max_file_size = strtoul(optarg, NULL, 10); break;
+			case 'S': seed = strtoull(optarg, NULL, 10); break;
+			default: bad_option = 1; break;
+		}
+	}
+
+	if (bad_option || optind != argc - 1 || (bits != 12 && bits != 16) || fragmentation < 0 || fragmentation > 100 ||
+		width == 0 || max_file_size > UINT32_MAX)
+	{
+		printf("Usage: %s [-t 12|16] [-s size_kb] [-n files] [-d depth] [-w subdirectories_per_directory]\n"
+			"\t[-f fragmentation_percent] [-z max_file_size] [-S seed] output_file\n", argv[0]);
+		return USER_ERROR;
+	}
+
+	//Lay the tree out breadth first, so every directory's children are
+	//contiguous and come after it
+	gen_dir_t *dirs = malloc(MAX_DIRECTORIES * sizeof *dirs);
+	if (dirs == NULL)
+	{
+		printf("Could not allocate memory.\n");
+		return SYSTEM_ERROR;
+	}
+
+	uint32_t num_dirs = 1, i;
+	dirs[0].depth = 0;
+	dirs[0].files = 0;
+	for (i = 0; i < num_dirs; i++)
+	{
+		dirs[i].first_child = num_dirs;
+		dirs[i].num_children = dirs[i].depth < depth ? width : 0;
+		if (num_dirs + dirs[i].num_children > MAX_DIRECTORIES)
+		{
+			printf("That makes more than %d directories.\n", MAX_DIRECTORIES);
+			free(dirs);
+			return USER_ERROR;
+		}
+
+		uint32_t c;
+		for (c = 0; c < dirs[i].num_children; c++)
+		{
+			dirs[num_dirs].depth = dirs[i].depth + 1;
+			dirs[num_dirs].files = 0;
+			num_dirs++;
+		}
+	}
+
+	//Files go in the subdirectories when there are any, since the root
+	//directory can't grow
+	unsigned long f;
+	for (f = 0; f < files; f++)
+	{
+		dirs[num_dirs == 1 ? 0 : 1 + f % (num_dirs - 1)].files++;
+	}
+
+	int fd = open(argv[optind], O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		perror("Could not open output file");
+		free(dirs);
+		return SYSTEM_ERROR;
+	}
+
+	fat_writer_t w;
+	if (!fat_writer_create(&w, fd, (uint64_t) size_kb * 1024, bits, "MSDOSGEN"))
+	{
+		printf("Could not make a FAT%d file system of %lu KB.\n", bits, size_kb);
+		fat_writer_free(&w);
+		close(fd);
+		free(dirs);
+		return USER_ERROR;
+	}
+	fat_writer_root(&w, &dirs[0].dir);
+
+	uint64_t state = seed ? seed : 1;
+	uint64_t total_bytes = 0;
+	uint32_t file_number = 0;
+	uint8_t ok = 1;
+	for (i = 0; ok && i < num_dirs; i++)
+	{
+		uint32_t c;
+		for (c = dirs[i].first_child; ok && c < dirs[i].first_child + dirs[i].num_children; c++)
+		{
+			unsigned char name[MAX_FILE_NAME + MAX_EXTENSION];
+			make_name('D', c, "", name);
+			ok = fat_writer_mkdir(&w, &dirs[i].dir, name, dirs[c].files + dirs[c].num_children,
+				FIXED_MTIME, &dirs[c].dir);
+		}
+
+		for (f = 0; ok && f < dirs[i].files; f++)
+		{
+			uint32_t size = next_random(&state) % (max_file_size + 1);
+			ok = write_file(&w, &dirs[i].dir, file_number++, size, fragmentation, &state);
+			total_bytes += size;
+		}
+	}
+
+	if (!ok)
+	{
+		printf("The files don't fit in %lu KB (or in the root directory).\n", size_kb);
+		fat_writer_free(&w);
+		close(fd);
+		free(dirs);
+		return USER_ERROR;
+	}
+
+	if (!fat_writer_finish(&w))
+	{
+		perror("Could not write output file");
+		fat_writer_free(&w);
+		close(fd);
+		free(dirs);
+		return SYSTEM_ERROR;
+	}
+
+	printf("%u file(s), %llu bytes, %u directories, %u of %u clusters used\n",
+		file_number, (unsigned long long) total_bytes, num_dirs - 1, w.next_free - 2, w.num_clusters);
+	fat_writer_free(&w);
+	close(fd);
+	free(dirs);
+	return 0;
+}
+
+//xorshift64*
+uint64_t next_random(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+void fill_random(uint64_t *state, uint8_t *dst, size_t n)
+{
+	while (n >= sizeof(uint64_t))
+	{
+		uint64_t r = next_random(state);
+		memcpy(dst, &r, sizeof r);
+		dst += sizeof r;
+		n -= sizeof r;
+	}
+
+	if (n > 0)
+	{
+		uint64_t r = next_random(state);
+		memcpy(dst, &r, n);
+	}
+}
+
+void make_name(char prefix, uint32_t n, const char *extension, unsigned char name[MAX_FILE_NAME + MAX_EXTENSION])
+{
+	char buf[MAX_FILE_NAME + 1];
+	snprintf(buf, sizeof buf, "%c%07u", prefix, n % 10000000);
+	memset(name, ' ', MAX_FILE_NAME + MAX_EXTENSION);
+	memcpy(name, buf, MAX_FILE_NAME);
+	memcpy(name + MAX_FILE_NAME, extension, strlen(extension));
+}
+
+//With fragmentation at 0 every file is one extent. Otherwise each cluster
+//after the first starts a new extent, after a small hole, with that
+//probability (in percent).
+uint8_t write_file(fat_writer_t *w, fat_dir_t *dir, uint32_t n, uint32_t size, int fragmentation, uint64_t *state)
+{
+	fat_chain_t chain = { 0, 0 };
+	uint32_t left = fat_writer_clusters_for(w, size);
+	uint32_t bytes_left = size;
+	while (left > 0)
+	{
+		uint32_t run = 1;
+		while (run < left && (int) (next_random(state) % 100) >= fragmentation)
+		{
+			run++;
+		}
+
+		uint32_t first = w->next_free;
+		if (!fat_writer_extend(w, &chain, run))
+		{
+			return 0;
+		}
+
+		uint64_t run_bytes = (uint64_t) run * w->cluster_size;
+		uint32_t fill = run_bytes < bytes_left ? run_bytes : bytes_left;
+		fill_random(state, fat_writer_cluster_data(w, first), fill);
+		bytes_left -= fill;
+
+		left -= run;
+		if (left > 0)
+		{
+			fat_writer_skip(w, 1 + next_random(state) % 4);
+		}
+	}
+
+	unsigned char name[MAX_FILE_NAME + MAX_EXTENSION];
+	make_name('F', n, "BIN", name);
+	return fat_writer_add_entry(w, dir, name, ARCHIVE, chain.first, size, FIXED_MTIME);
+}
@@ -0,0 +1,105 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fat12.h"
+#include "fat_recover.h"
+
+#define USER_ERROR 1
+#define SYSTEM_ERROR 2
+
+void print_recovery(recovery_t *recovery);
+
+int main(int argc, char *argv[])
+{
+	//-j sets how many files are written at once, and -n only lists what
+	//could be recovered
+	int threads = 1;
+	uint8_t list_only = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:n")) != -1)
+	{
+		if (opt == 'n')
+		{
+			list_only = 1;
+		}
+		else if (opt != 'j' || (threads = atoi(optarg)) < 1)
+		{
+			printf("Usage: %s [-j threads] [-n] input_file [output_directory]\n", argv[0]);
+			return USER_ERROR;
+		}
+	}
+
+	if (argc - optind < (list_only ? 1 : 2))
+	{
+		printf("Please include the input file and output directories as command line arguments.\n");
+		return USER_ERROR;
+	}
+
+	int fd = open(argv[optind], O_RDONLY, NULL);
+	if (fd < 0)
+	{
+		perror("Could not open input file");
+		return SYSTEM_ERROR;
+	}
+
+	fat12_t fat;
+	if (!read_fat12(fd, &fat))
+	{
+		fprintf(stderr, "Could not read file system.\n");
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
+
+	recovery_t recovery;
+	if (!scan_recoverable(&fat, &recovery))
+	{
+		printf("Could not allocate memory.\n");
+		free_recovery(&recovery);
+		free_fat12(&fat);
+		return SYSTEM_ERROR;
+	}
+
+	print_recovery(&recovery);
+	if (!list_only)
+	{
+		uint32_t written = write_recovered(&fat, &recovery, argv[optind + 1], threads);
+		printf("%u file(s) written to %s\n", written, argv[optind + 1]);
+	}
+
+	free_recovery(&recovery);
+	free_fat12(&fat);
+	return 0;
+}
+
+//One line per item, in the order they were found, then the totals
+void print_recovery(recovery_t *recovery)
+{
+	static const char *statuses[] = { "recoverable", "overwritten", "out of range", "lost chain" };
+	uint32_t files = 0, recoverable = 0, orphans = 0;
+	uint64_t orphan_bytes = 0;
+
+	printf("%-12s %10s %10s  %s\n", "status", "size", "cluster", "path");
+	uint32_t i;
+	for (i = 0; i < recovery->count; i++)
+	{
+		recovered_t *item = recovery->items + i;
+		if (item->kind == RECOVERED_ORPHAN)
+		{
+			orphans++;
+			orphan_bytes += item->size;
+		}
+		else
+		{
+			files++;
+			recoverable += item->status == RECOVERABLE;
+		}
+
+		printf("%-12s %10u %10u  %s\n", item->kind == RECOVERED_ORPHAN ? "orphan" : statuses[item->status],
+			item->size, item->start_cluster, item->path);
+	}
+
+	printf("\n%u deleted file(s), %u recoverable; %u orphaned run(s) of %llu bytes\n",
+		files, recoverable, orphans, (unsigned long long) orphan_bytes);
+}
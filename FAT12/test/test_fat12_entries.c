@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fat12_entries.h"
+
+//Checks the bulk 12-bit FAT decoder against the scalar loop it replaces, on
+//random tables of every length up to MAX_SMALL_COUNT and some large ones, odd
+//and even, and that encoding and decoding are each other's reverse. Each
+//packed table ends right before a page that can't be read, so a decoder that
+//reads past the end crashes rather than passing by luck.
+#define MAX_SMALL_COUNT 300
+
+//Not in the header, since only the dispatcher should be called normally
+void decode_fat12_entries_scalar(const uint8_t *src, uint16_t *dst, size_t count);
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+void decode_fat12_entries_ssse3(const uint8_t *src, uint16_t *dst, size_t count);
+#endif
+
+typedef struct
+{
+	uint8_t *mapping;
+	size_t mapping_size;
+	//The last size bytes before the guard page
+	uint8_t *bytes;
+} guarded_t;
+
+uint8_t guarded_alloc(guarded_t *g, size_t size);
+void guarded_free(guarded_t *g);
+uint8_t check_count(size_t count);
+uint8_t check_decoder(const char *name, void (*decode)(const uint8_t *, uint16_t *, size_t),
+	const uint8_t *src, const uint16_t *expected, size_t count);
+
+static long page_size;
+
+int main(void)
+{
+	page_size = sysconf(_SC_PAGESIZE);
+	srand(12);
+
+	static const size_t large_counts[] = { 4084, 4085, 65524, 65525, 1 << 20, (1 << 20) + 1 };
+	uint32_t failures = 0, checked = 0;
+	size_t count;
+	for (count = 0; count <= MAX_SMALL_COUNT; count++, checked++)
+	{
+		failures += !check_count(count);
+	}
+
+	size_t i;
+	for (i = 0; i < sizeof large_counts / sizeof *large_counts; i++, checked++)
+	{
+		failures += !check_count(large_counts[i]);
+	}
+
+	if (failures > 0)
+	{
+		printf("%u of %u table sizes failed\n", failures, checked);
+		return 1;
+	}
+
+	printf("All %u table sizes decode and encode the same as the scalar path\n", checked);
+	return 0;
+}
+
+//size bytes that end where an unreadable page begins
+uint8_t guarded_alloc(guarded_t *g, size_t size)
+{
+	size_t pages = (size + page_size - 1) / page_size;
+	g->mapping_size = (pages + 1) * page_size;
+	g->mapping = mmap(NULL, g->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (g->mapping == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	if (mprotect(g->mapping + pages * page_size, page_size, PROT_NONE) < 0)
+	{
+		munmap(g->mapping, g->mapping_size);
+		return 0;
+	}
+
+	g->bytes = g->mapping + pages * page_size - size;
+	return 1;
+}
+
+void guarded_free(guarded_t *g)
+{
+	munmap(g->mapping, g->mapping_size);
+}
+
+uint8_t check_count(size_t count)
+{
+	size_t packed_size = FAT12_PACKED_SIZE(count);
+	guarded_t packed;
+	uint16_t *expected = malloc((count + 1) * sizeof *expected);
+	uint16_t *entries = malloc((count + 1) * sizeof *entries);
+	uint8_t *encoded = malloc(packed_size + 1);
+	if (expected == NULL || entries == NULL || encoded == NULL || !guarded_alloc(&packed, packed_size))
+	{
+		printf("Could not allocate memory for %zu entries\n", count);
+		free(expected);
+		free(entries);
+		free(encoded);
+		return 0;
+	}
+
+	size_t i;
+	for (i = 0; i < packed_size; i++)
+	{
+		packed.bytes[i] = rand() & 0xff;
+	}
+	decode_fat12_entries_scalar(packed.bytes, expected, count);
+
+	uint8_t ok = 1;
+#ifdef HAVE_X86_SIMD
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		ok = check_decoder("SSSE3", decode_fat12_entries_ssse3, packed.bytes, expected, count) && ok;
+	}
+#endif
+	ok = check_decoder("dispatched", decode_fat12_entries, packed.bytes, expected, count) && ok;
+
+	//Encoding what was decoded gives back the same bytes, and with an odd
+	//count the high nibble of the last byte, which isn't one of these entries,
+	//is left as it was
+	if (packed_size > 0)
+	{
+		encoded[packed_size - 1] = packed.bytes[packed_size - 1] ^ 0x0f;
+	}
+	encode_fat12_entries(expected, encoded, count);
+	if (memcmp(encoded, packed.bytes, packed_size) != 0)
+	{
+		printf("%zu entries: encoding the decoded entries changed the table\n", count);
+		ok = 0;
+	}
+
+	//And decoding what was encoded gives back the same entries
+	for (i = 0; i < count; i++)
+	{
+		expected[i] = rand() & 0xfff;
+	}
+	encode_fat12_entries(expected, encoded, count);
+	decode_fat12_entries(encoded, entries, count);
+	if (memcmp(entries, expected, count * sizeof *entries) != 0)
+	{
+		printf("%zu entries: decoding encoded entries changed them\n", count);
+		ok = 0;
+	}
+
+	guarded_free(&packed);
+	free(expected);
+	free(entries);
+	free(encoded);
+	return ok;
+}
+
+//Also checks that nothing past the last entry is written
+uint8_t check_decoder(const char *name, void (*decode)(const uint8_t *, uint16_t *, size_t),
+	const uint8_t *src, const uint16_t *expected, size_t count)
+{
+	uint16_t *entries = malloc((count + 1) * sizeof *entries);
+	if (entries == NULL)
+	{
+		printf("Could not allocate memory for %zu entries\n", count);
+		return 0;
+	}
+
+	entries[count] = 0xbeef;
+	decode(src, entries, count);
+
+	uint8_t ok = 1;
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		if (entries[i] != expected[i])
+		{
+			printf("%s, %zu entries: entry %zu is 0x%03x, not 0x%03x\n", name, count, i, entries[i], expected[i]);
+			ok = 0;
+			break;
+		}
+	}
+
+	if (entries[count] != 0xbeef)
+	{
+		printf("%s, %zu entries: wrote past the last entry\n", name, count);
+		ok = 0;
+	}
+
+	free(entries);
+	return ok;
+}
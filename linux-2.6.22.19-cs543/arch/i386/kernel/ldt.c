@@ -18,6 +18,11 @@
 #include <asm/ldt.h>
 #include <asm/desc.h>
 #include <asm/mmu_context.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <asm/vsyscall_gtod.h>
+/*Finish additions******************/
 
 #ifdef CONFIG_SMP /* avoids "defined but not used" warnig */
 static void flush_ldt(void *null)
@@ -96,12 +101,32 @@ int init_new_context(struct task_struct *tsk, struct mm_struct *mm)
 
 	init_MUTEX(&mm->context.sem);
 	mm->context.size = 0;
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//On fork the context was copied from the parent, so this overwrites the
+	//parent's page rather than sharing it
+	retval = vsyscall_pid_init(mm, tsk);
+	if (retval)
+	{
+		return retval;
+	}
+	/*Finish additions******************/
 	old_mm = current->mm;
 	if (old_mm && old_mm->context.size > 0) {
 		down(&old_mm->context.sem);
 		retval = copy_ldt(&mm->context, &old_mm->context);
 		up(&old_mm->context.sem);
 	}
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//destroy_context() isn't called when this fails
+	if (retval)
+	{
+		vsyscall_pid_release(mm);
+	}
+	/*Finish additions******************/
 	return retval;
 }
 
@@ -119,6 +144,11 @@ void destroy_context(struct mm_struct *mm)
 			kfree(mm->context.ldt);
 		mm->context.size = 0;
 	}
+	/************************************
+		Added by Austin Herring
+	************************************/
+	vsyscall_pid_release(mm);
+	/*Finish additions******************/
 }
 
 static int read_ldt(void __user * ptr, unsigned long bytecount)
@@ -57,6 +57,33 @@
 
 #include <asm/tlbflush.h>
 #include <asm/cpu.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <asm/vsyscall_gtod.h>
+
+//The vDSO's getpid() returns whatever tgid is in the mm's pid page, which is
+//only right while a single thread group uses the mm. If some other thread
+//group (a vfork child, or CLONE_VM without CLONE_THREAD) is about to run on
+//it, zero the page so getpid() goes back to making the system call for as
+//long as this mm lives. Kernel threads borrowing the mm for aio don't count.
+static inline void vsyscall_pid_check(struct task_struct *next_p)
+{
+	struct mm_struct *mm = next_p->mm;
+	struct vsyscall_pid_data *data;
+
+	if (mm == NULL || mm->context.vdso_pid_page == NULL || (next_p->flags & PF_BORROWED_MM))
+	{
+		return;
+	}
+
+	data = page_address(mm->context.vdso_pid_page);
+	if (unlikely(data->tgid != next_p->tgid && data->tgid != 0))
+	{
+		data->tgid = 0;
+	}
+}
+/*Finish additions******************/
 
 asmlinkage void ret_from_fork(void) __asm__("ret_from_fork");
 
@@ -693,6 +720,12 @@ struct task_struct fastcall * __switch_to(struct task_struct *prev_p, struct tas
 	    || test_tsk_thread_flag(prev_p, TIF_IO_BITMAP)))
 		__switch_to_xtra(next_p, tss);
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	vsyscall_pid_check(next_p);
+	/*Finish additions******************/
+
 	disable_tsc(prev_p, next_p);
 
 	/*
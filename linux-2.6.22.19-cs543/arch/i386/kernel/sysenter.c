@@ -24,6 +24,13 @@
 #include <asm/unistd.h>
 #include <asm/elf.h>
 #include <asm/tlbflush.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <linux/clocksource.h>
+#include <linux/slab.h>
+#include <asm/vsyscall_gtod.h>
+/*Finish additions******************/
 
 enum {
 	VDSO_DISABLED = 0,
@@ -217,6 +224,140 @@ static int __init gate_vma_init(void)
 extern const char vsyscall_int80_start, vsyscall_int80_end;
 extern const char vsyscall_sysenter_start, vsyscall_sysenter_end;
 static struct page *syscall_pages[1];
+/************************************
+	Added by Austin Herring
+************************************/
+//The text page is mapped like it always was, writable by a debugger. The pid
+//and time pages in front of it get a vma each, without VM_MAYWRITE, so that a
+//COW can never leave a process reading a stale copy of either; see
+//install_vdso_data_mapping(). The time page is the same for every process.
+static struct page *vdso_gtod_page;
+
+//Mapped at FIX_VDSO_PID in compat mode. Its tgid is always 0, so getpid()
+//from a compat vDSO always makes the system call.
+static struct page *vdso_compat_pid_page;
+
+struct vsyscall_gtod_data *vsyscall_gtod;
+
+//Copies the timekeeping state the vDSO needs into the shared time page.
+//Called with xtime_lock held for writing, so there's only ever one writer.
+void update_vsyscall(struct timespec *wall_time, struct clocksource *clock)
+{
+	if (vsyscall_gtod == NULL)
+	{
+		//sysenter_setup() hasn't run yet; the next tick will fill it in
+		return;
+	}
+
+	vsyscall_gtod->seq++;
+	smp_wmb();
+
+	//Only the TSC clocksource sets vread, see arch/i386/kernel/tsc.c
+	vsyscall_gtod->tsc_clock = clock->vread != NULL;
+	vsyscall_gtod->mult = clock->mult;
+	vsyscall_gtod->shift = clock->shift;
+	vsyscall_gtod->cycle_last = clock->cycle_last;
+	vsyscall_gtod->mask = clock->mask;
+	vsyscall_gtod->wall_time_sec = wall_time->tv_sec;
+	vsyscall_gtod->wall_time_nsec = wall_time->tv_nsec;
+	vsyscall_gtod->wall_to_monotonic_sec = wall_to_monotonic.tv_sec;
+	vsyscall_gtod->wall_to_monotonic_nsec = wall_to_monotonic.tv_nsec;
+	vsyscall_gtod->sys_tz = sys_tz;
+
+	smp_wmb();
+	vsyscall_gtod->seq++;
+}
+
+//Called from init_new_context() for every new mm, both on fork (tsk is the
+//child) and on exec (tsk is current)
+int vsyscall_pid_init(struct mm_struct *mm, struct task_struct *tsk)
+{
+	struct page *page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (page == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	((struct vsyscall_pid_data *)page_address(page))->tgid = tsk->tgid;
+	mm->context.vdso_pid_page = page;
+	return 0;
+}
+
+void vsyscall_pid_release(struct mm_struct *mm)
+{
+	if (mm->context.vdso_pid_page != NULL)
+	{
+		__free_page(mm->context.vdso_pid_page);
+		mm->context.vdso_pid_page = NULL;
+	}
+}
+
+//The pid page is looked up through vm_mm rather than vm_private_data, so the
+//copy of this vma a fork makes picks up the child's page instead of the
+//parent's
+static struct page *vdso_pid_nopage(struct vm_area_struct *vma,
+	unsigned long address, int *type)
+{
+	struct page *page = vma->vm_mm->context.vdso_pid_page;
+	if (page == NULL)
+	{
+		return NOPAGE_SIGBUS;
+	}
+
+	get_page(page);
+	return page;
+}
+
+static struct page *vdso_gtod_nopage(struct vm_area_struct *vma,
+	unsigned long address, int *type)
+{
+	get_page(vdso_gtod_page);
+	return vdso_gtod_page;
+}
+
+//Having a close hook keeps the vma from being merged with its neighbours
+static void vdso_data_close(struct vm_area_struct *vma)
+{
+}
+
+static struct vm_operations_struct vdso_pid_vmops = {
+	.close = vdso_data_close,
+	.nopage = vdso_pid_nopage,
+};
+
+static struct vm_operations_struct vdso_gtod_vmops = {
+	.close = vdso_data_close,
+	.nopage = vdso_gtod_nopage,
+};
+
+//Like install_special_mapping() for one page, but with vmops. No VM_MAYWRITE,
+//so the page can never be COWed away from the one the kernel updates.
+static int install_vdso_data_mapping(struct mm_struct *mm, unsigned long addr,
+	struct vm_operations_struct *vmops)
+{
+	struct vm_area_struct *vma = kmem_cache_zalloc(vm_area_cachep, GFP_KERNEL);
+	if (vma == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	vma->vm_mm = mm;
+	vma->vm_start = addr;
+	vma->vm_end = addr + PAGE_SIZE;
+	vma->vm_flags = VM_READ | VM_MAYREAD | VM_DONTEXPAND | mm->def_flags;
+	vma->vm_page_prot = protection_map[vma->vm_flags & 7];
+	vma->vm_ops = vmops;
+
+	if (insert_vm_struct(mm, vma))
+	{
+		kmem_cache_free(vm_area_cachep, vma);
+		return -ENOMEM;
+	}
+
+	mm->total_vm++;
+	return 0;
+}
+/*Finish additions******************/
 
 static void map_compat_vdso(int map)
 {
@@ -229,6 +370,14 @@ static void map_compat_vdso(int map)
 
 	__set_fixmap(FIX_VDSO, page_to_pfn(syscall_pages[0]) << PAGE_SHIFT,
 		     map ? PAGE_READONLY_EXEC : PAGE_NONE);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	__set_fixmap(FIX_VDSO_GTOD, page_to_pfn(vdso_gtod_page) << PAGE_SHIFT,
+		     map ? PAGE_READONLY : PAGE_NONE);
+	__set_fixmap(FIX_VDSO_PID, page_to_pfn(vdso_compat_pid_page) << PAGE_SHIFT,
+		     map ? PAGE_READONLY : PAGE_NONE);
+	/*Finish additions******************/
 
 	/* flush stray tlbs */
 	flush_tlb_all();
@@ -240,8 +389,33 @@ int __init sysenter_setup(void)
 	const void *vsyscall;
 	size_t vsyscall_len;
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	void *gtod_page = (void *)get_zeroed_page(GFP_ATOMIC);
+	void *compat_pid_page = (void *)get_zeroed_page(GFP_ATOMIC);
+
+	//Without all three there's no vDSO to map. vsyscall_gtod stays NULL,
+	//which is what arch_setup_additional_pages() and update_vsyscall() check.
+	if (syscall_page == NULL || gtod_page == NULL || compat_pid_page == NULL) {
+		free_page((unsigned long)syscall_page);
+		free_page((unsigned long)gtod_page);
+		free_page((unsigned long)compat_pid_page);
+		vdso_enabled = VDSO_DISABLED;
+		printk(KERN_ERR "vDSO: out of memory, disabled\n");
+		return -ENOMEM;
+	}
+	/*Finish additions******************/
+
 	syscall_pages[0] = virt_to_page(syscall_page);
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	vdso_gtod_page = virt_to_page(gtod_page);
+	vdso_compat_pid_page = virt_to_page(compat_pid_page);
+	/*Finish additions******************/
+
 	gate_vma_init();
 
 	printk("Compat vDSO mapped to %08lx.\n", __fix_to_virt(FIX_VDSO));
@@ -254,9 +428,23 @@ int __init sysenter_setup(void)
 		vsyscall_len = &vsyscall_sysenter_end - &vsyscall_sysenter_start;
 	}
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//The vDSO code finds its data pages relative to its own page
+	BUG_ON(vsyscall_len > PAGE_SIZE);
+	/*Finish additions******************/
 	memcpy(syscall_page, vsyscall, vsyscall_len);
 	relocate_vdso(syscall_page);
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//Only now that everything is in place does update_vsyscall() start
+	//filling it in
+	vsyscall_gtod = gtod_page;
+	/*Finish additions******************/
+
 	return 0;
 }
 
@@ -271,6 +459,14 @@ int arch_setup_additional_pages(struct linux_binprm *bprm, int exstack)
 	int ret = 0;
 	bool compat;
 
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//sysenter_setup() couldn't get its pages, so there's nothing to map
+	if (vsyscall_gtod == NULL)
+		return 0;
+	/*Finish additions******************/
+
 	down_write(&mm->mmap_sem);
 
 	/* Test compat mode once here, in case someone
@@ -282,12 +478,29 @@ int arch_setup_additional_pages(struct linux_binprm *bprm, int exstack)
 	if (compat)
 		addr = VDSO_HIGH_BASE;
 	else {
-		addr = get_unmapped_area(NULL, 0, PAGE_SIZE, 0, 0);
+		/************************************
+			Added by Austin Herring
+		************************************/
+		//[pid page][time page][text page], see asm/vsyscall_gtod.h
+		addr = get_unmapped_area(NULL, 0, VDSO_PAGES * PAGE_SIZE, 0, 0);
 		if (IS_ERR_VALUE(addr)) {
 			ret = addr;
 			goto up_fail;
 		}
 
+		ret = install_vdso_data_mapping(mm, addr + VDSO_PID_PAGE * PAGE_SIZE,
+						&vdso_pid_vmops);
+		if (ret)
+			goto up_fail;
+
+		ret = install_vdso_data_mapping(mm, addr + VDSO_GTOD_PAGE * PAGE_SIZE,
+						&vdso_gtod_vmops);
+		if (ret)
+			goto up_fail;
+
+		addr += VDSO_TEXT_PAGE * PAGE_SIZE;
+		/*Finish additions******************/
+
 		/*
 		 * MAYWRITE to allow gdb to COW and set breakpoints
 		 *
@@ -321,6 +534,12 @@ const char *arch_vma_name(struct vm_area_struct *vma)
 {
 	if (vma->vm_mm && vma->vm_start == (long)vma->vm_mm->context.vdso)
 		return "[vdso]";
+	/************************************
+		Added by Austin Herring
+	************************************/
+	if (vma->vm_ops == &vdso_pid_vmops || vma->vm_ops == &vdso_gtod_vmops)
+		return "[vvar]";
+	/*Finish additions******************/
 	return NULL;
 }
 
@@ -267,6 +267,13 @@ static struct clocksource clocksource_tsc = {
 	.name			= "tsc",
 	.rating			= 300,
 	.read			= read_tsc,
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//Nothing calls this on i386; a non-NULL vread tells update_vsyscall()
+	//that userspace can read this clock itself with rdtsc
+	.vread			= read_tsc,
+	/*Finish additions******************/
 	.mask			= CLOCKSOURCE_MASK(64),
 	.mult			= 0, /* to be set */
 	.shift			= 22,
@@ -0,0 +1,190 @@
+/************************************
+      Added by Austin Herring
+************************************/
+//Userspace implementations of gettimeofday, clock_gettime and getpid that are
+//linked into both vsyscall DSO images. They run in user mode out of the vDSO
+//text page and only read the two data pages the kernel maps in front of it
+//(see include/asm-i386/vsyscall_gtod.h), trapping into the kernel only when
+//the answer can't be worked out from those.
+//
+//This is built -fPIC with no access to anything outside the DSO: no globals,
+//no libgcc, no jump tables, so keep it to straight-line code.
+#include <linux/time.h>
+#include <asm/page.h>
+#include <asm/unistd.h>
+#include <asm/vsyscall_gtod.h>
+
+//sys_mygetpid's slot in arch/i386/kernel/syscall_table.S
+#define VDSO_NR_MYGETPID 324
+
+#define vdso_barrier() asm volatile("" : : : "memory")
+
+//Start of the text page this code is running from. The data pages are at
+//fixed offsets before it both in a normal mapping and at VDSO_HIGH_BASE.
+static inline unsigned long vdso_text_page(void)
+{
+	unsigned long eip;
+	asm("call 1f\n1:\tpopl %0" : "=r" (eip));
+	return eip & PAGE_MASK;
+}
+
+static inline volatile struct vsyscall_gtod_data *vdso_gtod(void)
+{
+	return (volatile struct vsyscall_gtod_data *)
+		(vdso_text_page() - (VDSO_TEXT_PAGE - VDSO_GTOD_PAGE) * PAGE_SIZE);
+}
+
+static inline volatile struct vsyscall_pid_data *vdso_pid(void)
+{
+	return (volatile struct vsyscall_pid_data *)
+		(vdso_text_page() - (VDSO_TEXT_PAGE - VDSO_PID_PAGE) * PAGE_SIZE);
+}
+
+//%ebx is the PIC register, so swap the first argument through %edi rather
+//than asking the compiler for %ebx directly
+static inline long vdso_syscall0(long nr)
+{
+	long ret;
+	asm volatile("int $0x80" : "=a" (ret) : "0" (nr) : "memory");
+	return ret;
+}
+
+static inline long vdso_syscall2(long nr, long arg1, long arg2)
+{
+	long ret;
+	asm volatile("xchgl %%ebx, %%edi\n\t"
+		"int $0x80\n\t"
+		"xchgl %%ebx, %%edi"
+		: "=a" (ret)
+		: "0" (nr), "D" (arg1), "c" (arg2)
+		: "memory");
+	return ret;
+}
+
+static inline u64 vdso_rdtsc(void)
+{
+	u64 ret;
+	asm volatile("rdtsc" : "=A" (ret));
+	return ret;
+}
+
+static inline u32 gtod_read_begin(volatile struct vsyscall_gtod_data *gtod)
+{
+	u32 seq;
+	while ((seq = gtod->seq) & 1)
+	{
+		asm volatile("rep; nop");
+	}
+	vdso_barrier();
+	return seq;
+}
+
+static inline int gtod_read_retry(volatile struct vsyscall_gtod_data *gtod, u32 seq)
+{
+	vdso_barrier();
+	return gtod->seq != seq;
+}
+
+//Adds ns to *ts without a 64-bit division, which would need libgcc. ns is
+//at most a tick or so, so this only loops once or twice.
+static inline void vdso_timespec_add_ns(struct timespec *ts, time_t sec, u64 nsec)
+{
+	while (nsec >= NSEC_PER_SEC)
+	{
+		nsec -= NSEC_PER_SEC;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = (long)nsec;
+}
+
+//Returns 0 and fills in *ts, or -1 if the clock can't be read from here and
+//the caller has to make the system call
+static inline int do_clock(volatile struct vsyscall_gtod_data *gtod, struct timespec *ts, int monotonic)
+{
+	u32 seq;
+	time_t sec;
+	u64 nsec;
+
+	do
+	{
+		seq = gtod_read_begin(gtod);
+		if (!gtod->tsc_clock)
+		{
+			return -1;
+		}
+
+		sec = gtod->wall_time_sec;
+		nsec = gtod->wall_time_nsec;
+		if (monotonic)
+		{
+			sec += gtod->wall_to_monotonic_sec;
+			nsec += gtod->wall_to_monotonic_nsec;
+		}
+		nsec += (((vdso_rdtsc() - gtod->cycle_last) & gtod->mask) * gtod->mult) >> gtod->shift;
+	} while (gtod_read_retry(gtod, seq));
+
+	vdso_timespec_add_ns(ts, sec, nsec);
+	return 0;
+}
+
+asmlinkage int __vdso_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+	if (clock == CLOCK_REALTIME || clock == CLOCK_MONOTONIC)
+	{
+		if (do_clock(vdso_gtod(), ts, clock == CLOCK_MONOTONIC) == 0)
+		{
+			return 0;
+		}
+	}
+
+	return vdso_syscall2(__NR_clock_gettime, clock, (long)ts);
+}
+
+asmlinkage int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	volatile struct vsyscall_gtod_data *gtod = vdso_gtod();
+
+	if (tv != NULL)
+	{
+		struct timespec ts;
+		if (do_clock(gtod, &ts, 0) != 0)
+		{
+			return vdso_syscall2(__NR_gettimeofday, (long)tv, (long)tz);
+		}
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+
+	if (tz != NULL)
+	{
+		tz->tz_minuteswest = gtod->sys_tz.tz_minuteswest;
+		tz->tz_dsttime = gtod->sys_tz.tz_dsttime;
+	}
+
+	return 0;
+}
+
+asmlinkage pid_t __vdso_getpid(void)
+{
+	pid_t tgid = vdso_pid()->tgid;
+	if (tgid != 0)
+	{
+		return tgid;
+	}
+
+	return vdso_syscall0(__NR_getpid);
+}
+
+//sys_mygetpid returns current->tgid too, so it gets the same fast path
+asmlinkage pid_t __vdso_mygetpid(void)
+{
+	pid_t tgid = vdso_pid()->tgid;
+	if (tgid != 0)
+	{
+		return tgid;
+	}
+
+	return vdso_syscall0(VDSO_NR_MYGETPID);
+}
+/*Finish additions******************/
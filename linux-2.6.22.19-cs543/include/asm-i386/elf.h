@@ -152,8 +152,14 @@ extern int arch_setup_additional_pages(struct linux_binprm *bprm,
 
 extern unsigned int vdso_enabled;
 
+/************************************
+	Added by Austin Herring
+************************************/
+//No vDSO is mapped, whatever vdso_enabled says, if sysenter_setup() couldn't
+//allocate it; VDSO_CURRENT_BASE is 0 then
+/*Finish additions******************/
 #define ARCH_DLINFO							\
-do if (vdso_enabled) {							\
+do if (vdso_enabled && VDSO_CURRENT_BASE) {				\
 		NEW_AUX_ENT(AT_SYSINFO,	VDSO_ENTRY);			\
 		NEW_AUX_ENT(AT_SYSINFO_EHDR, VDSO_CURRENT_BASE);	\
 } while (0)
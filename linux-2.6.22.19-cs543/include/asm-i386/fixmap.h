@@ -54,6 +54,14 @@ extern unsigned long __FIXADDR_TOP;
 enum fixed_addresses {
 	FIX_HOLE,
 	FIX_VDSO,
+/************************************
+	Added by Austin Herring
+************************************/
+	//The vDSO's data pages go directly below its text page (fixmap
+	//addresses grow downwards), see asm/vsyscall_gtod.h
+	FIX_VDSO_GTOD,
+	FIX_VDSO_PID,
+/*Finish additions******************/
 #ifdef CONFIG_X86_LOCAL_APIC
 	FIX_APIC_BASE,	/* local (CPU) APIC) -- required for SMP or not */
 #endif
@@ -13,6 +13,12 @@ typedef struct {
 	struct semaphore sem;
 	void *ldt;
 	void *vdso;
+/************************************
+	Added by Austin Herring
+************************************/
+	//The vDSO page getpid() reads the tgid from, see asm/vsyscall_gtod.h
+	struct page *vdso_pid_page;
+/*Finish additions******************/
 } mm_context_t;
 
 #endif
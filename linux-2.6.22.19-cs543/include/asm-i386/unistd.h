@@ -332,7 +332,13 @@
 
 #ifdef __KERNEL__
 
-#define NR_syscalls 324
+/************************************
+	Added by Austin Herring
+************************************/
+//Covers the added calls at the end of arch/i386/kernel/syscall_table.S;
+//sys_multicall bounds checks against it
+#define NR_syscalls 335
+/*Finish additions******************/
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
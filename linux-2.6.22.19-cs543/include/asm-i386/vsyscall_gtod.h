@@ -0,0 +1,62 @@
+/************************************
+      Added by Austin Herring
+************************************/
+#ifndef __ASM_I386_VSYSCALL_GTOD_H__
+#define __ASM_I386_VSYSCALL_GTOD_H__
+
+#include <linux/types.h>
+#include <linux/time.h>
+
+//The vDSO is mapped as three pages, in this order:
+//	[pid page][time page][vsyscall text]
+//so the code in the text page finds its data by masking its own address down
+//to a page boundary and stepping backwards. Everything the vDSO code reads has
+//to be in one of these structures, since the DSO itself has no writable data.
+#define VDSO_PID_PAGE 0
+#define VDSO_GTOD_PAGE 1
+#define VDSO_TEXT_PAGE 2
+#define VDSO_PAGES 3
+
+//Written by update_vsyscall() with xtime_lock held for writing, read locklessly
+//by userspace. seq is odd while an update is in progress.
+struct vsyscall_gtod_data
+{
+	u32 seq;
+
+	//Nonzero when the current clocksource is the TSC; otherwise every call
+	//falls back to the real system call
+	u32 tsc_clock;
+	u32 mult;
+	u32 shift;
+	u64 cycle_last;
+	u64 mask;
+
+	time_t wall_time_sec;
+	long wall_time_nsec;
+	time_t wall_to_monotonic_sec;
+	long wall_to_monotonic_nsec;
+	struct timezone sys_tz;
+};
+
+//One per mm. tgid is the thread group that owns the mm, or 0 once the mm has
+//been seen running under a second thread group (vfork, CLONE_VM without
+//CLONE_THREAD), after which getpid() always traps.
+struct vsyscall_pid_data
+{
+	pid_t tgid;
+};
+
+//The vDSO code includes this header too, built with -DBUILD_VDSO
+#ifndef BUILD_VDSO
+struct mm_struct;
+struct task_struct;
+
+extern struct vsyscall_gtod_data *vsyscall_gtod;
+//Defined in kernel/time.c, which has no header for it
+extern struct timezone sys_tz;
+extern int vsyscall_pid_init(struct mm_struct *mm, struct task_struct *tsk);
+extern void vsyscall_pid_release(struct mm_struct *mm);
+#endif
+
+#endif
+/*Finish additions******************/
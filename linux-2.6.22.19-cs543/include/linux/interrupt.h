@@ -56,6 +56,15 @@
 #define IRQF_PERCPU		0x00000400
 #define IRQF_NOBALANCING	0x00000800
 #define IRQF_IRQPOLL		0x00001000
+/************************************
+	Added by Austin Herring
+************************************/
+//IRQF_ONESHOT - keep the irq line disabled from the time the primary handler
+//               wakes the irq thread until the thread handler has finished.
+//               Needed for level triggered devices whose primary handler
+//               can't quiet the device itself.
+#define IRQF_ONESHOT		0x00002000
+/*Finish additions******************/
 
 /*
  * Migration helpers. Scheduled for removal in 9/2007
@@ -90,11 +99,38 @@ struct irqaction {
 	struct irqaction *next;
 	int irq;
 	struct proc_dir_entry *dir;
+	/************************************
+		Added by Austin Herring
+	************************************/
+	irq_handler_t thread_fn;
+	struct task_struct *thread;
+	unsigned long thread_flags;
+	int thread_prio;
+	/*Finish additions******************/
 };
 
 extern irqreturn_t no_action(int cpl, void *dev_id);
 extern int __must_check request_irq(unsigned int, irq_handler_t handler,
 		       unsigned long, const char *, void *);
+/************************************
+	Added by Austin Herring
+************************************/
+//Bits in irqaction.thread_flags
+#define IRQTF_RUNTHREAD		0
+//No primary handler (a forced thread, or none was given), so only the thread
+//handler's return value says whether an interrupt was this action's
+#define IRQTF_CLAIM_IN_THREAD	1
+
+//Priority irq threads start with; changed at runtime through
+//proc/irq/<irq>/<name>/thread_priority
+#define IRQ_THREAD_DEFAULT_PRIO	(MAX_USER_RT_PRIO / 2)
+
+extern int __must_check request_threaded_irq(unsigned int irq,
+		irq_handler_t handler, irq_handler_t thread_fn,
+		unsigned long flags, const char *name, void *dev_id);
+extern int irq_set_thread_priority(struct irqaction *action, int prio);
+extern int irq_set_thread_affinity(struct irqaction *action, cpumask_t mask);
+/*Finish additions******************/
 extern void free_irq(unsigned int, void *);
 
 extern int __must_check devm_request_irq(struct device *dev, unsigned int irq,
@@ -22,4 +22,15 @@ typedef int irqreturn_t;
 #define IRQ_HANDLED	(1)
 #define IRQ_RETVAL(x)	((x) != 0)
 
+/************************************
+	Added by Austin Herring
+************************************/
+//Returned by the primary handler of a threaded irq (see request_threaded_irq)
+//when the device has been quieted and the rest of the work should be done in
+//the irq's thread. handle_IRQ_event reports it to the flow handlers as
+//IRQ_HANDLED, unless the action has no primary handler of its own, in which
+//case the thread handler's return value decides.
+#define IRQ_WAKE_THREAD	(2)
+/*Finish additions******************/
+
 #endif
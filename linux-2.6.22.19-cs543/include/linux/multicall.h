@@ -0,0 +1,24 @@
+/************************************
+      Added by Austin Herring
+************************************/
+#ifndef __INCLUDE_LINUX_MULTICALL_H__
+#define __INCLUDE_LINUX_MULTICALL_H__
+
+#define MULTICALL_MAX_ENTRIES 1024
+
+//Flags for sys_multicall
+#define MULTICALL_STOP_ON_ERROR 0x1
+
+//One system call in a batch. nr and args are what would have been passed to
+//syscall(2); result is written back with what it returned, which is a
+//negative errno on failure just as the system call itself would return.
+//Entries that were never run (after a stop on error) are left untouched.
+struct multicall_entry
+{
+	long nr;
+	long args[6];
+	long result;
+};
+
+#endif
+/*Finish additions******************/
@@ -35,6 +35,23 @@
 #define SCHED_RR		2
 #define SCHED_BATCH		3
 
+/************************************
+	Added by Austin Herring
+************************************/
+/*
+ * Where sched_fork puts a new child and where sched_exec moves a task, set
+ * per process with sys_setplacement and inherited across fork:
+ *   PLACEMENT_DEFAULT - balance through the sched domains (SD_BALANCE_FORK/EXEC)
+ *   PLACEMENT_LOCAL   - stay on the parent's/current CPU
+ *   PLACEMENT_SPREAD  - go to the least loaded allowed CPU, idle ones first
+ *   PLACEMENT_NODE    - like SPREAD, but only over the CPUs of placement_node
+ */
+#define PLACEMENT_DEFAULT	0
+#define PLACEMENT_LOCAL		1
+#define PLACEMENT_SPREAD	2
+#define PLACEMENT_NODE		3
+/*Finish additions******************/
+
 #ifdef __KERNEL__
 
 struct sched_param {
@@ -1082,6 +1099,9 @@ struct task_struct {
 	************************************/
 	struct semaphore join_semaphore;
 	size_t joined_processes;
+	int fork_placement;
+	int exec_placement;
+	int placement_node;
 	/*Finish additions******************/
 };
 
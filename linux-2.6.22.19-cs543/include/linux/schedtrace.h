@@ -0,0 +1,45 @@
+/************************************
+      Added by Austin Herring
+************************************/
+#ifndef __INCLUDE_LINUX_SCHEDTRACE_H__
+#define __INCLUDE_LINUX_SCHEDTRACE_H__
+
+#include <linux/types.h>
+
+#define SCHED_TRACE_SWITCH 1
+#define SCHED_TRACE_WAKEUP 2
+
+//One fixed-size record per event, written into the relay buffer of the CPU
+//the event happened on. Readers (wrappers/schedtrace.c) depend on this
+//layout, so only ever add fields to the end.
+struct sched_trace_entry
+{
+	u64 timestamp;
+	u32 type;
+	u32 cpu;
+	pid_t prev_pid;
+	pid_t next_pid;
+	s32 prev_prio;
+	s32 next_prio;
+	s64 prev_state;
+};
+
+#ifdef __KERNEL__
+struct task_struct;
+
+#ifdef CONFIG_SCHED_TRACE
+void sched_trace_switch(struct task_struct *prev, struct task_struct *next);
+void sched_trace_wakeup(struct task_struct *p);
+#else
+static inline void sched_trace_switch(struct task_struct *prev, struct task_struct *next)
+{
+}
+
+static inline void sched_trace_wakeup(struct task_struct *p)
+{
+}
+#endif
+#endif
+
+#endif
+/*Finish additions******************/
@@ -623,6 +623,9 @@ asmlinkage long sys_myjoin(pid_t target);
 asmlinkage ssize_t sys_forcewrite(unsigned int fd, const char __user *buff, size_t count);
 asmlinkage long sys_mysend(pid_t pid, const char __user *buff, size_t n);
 asmlinkage long sys_myreceive(pid_t pid, const char __user *buff, size_t n);
+asmlinkage long sys_setplacement(pid_t pid, int fork_placement, int exec_placement, int node);
+struct multicall_entry;
+asmlinkage long sys_multicall(struct multicall_entry __user *entries, unsigned int nr, unsigned int flags);
 /*Finish additions*******************/
 
 int kernel_execve(const char *filename, char *const argv[], char *const envp[]);
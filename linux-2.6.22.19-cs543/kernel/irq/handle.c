@@ -119,6 +119,36 @@ irqreturn_t no_action(int cpl, void *dev_id)
 	return IRQ_NONE;
 }
 
+/************************************
+	Added by Austin Herring
+************************************/
+/*
+ * The primary handler of a threaded irq has asked for its thread. For a
+ * oneshot irq the line stays disabled until irq_thread has run the thread
+ * handler, so a level triggered device can't keep interrupting in the mean
+ * time. If the thread hasn't gotten to the last wakeup yet, this one is
+ * folded into it, and so is the disable.
+ */
+static void irq_wake_thread(unsigned int irq, struct irqaction *action)
+{
+	if (unlikely(action->thread == NULL))
+	{
+		return;
+	}
+
+	if (test_and_set_bit(IRQTF_RUNTHREAD, &action->thread_flags))
+	{
+		return;
+	}
+
+	if (action->flags & IRQF_ONESHOT)
+	{
+		disable_irq_nosync(irq);
+	}
+	wake_up_process(action->thread);
+}
+/*Finish additions******************/
+
 /**
  * handle_IRQ_event - irq action chain handler
  * @irq:	the interrupt number
@@ -138,6 +168,21 @@ irqreturn_t handle_IRQ_event(unsigned int irq, struct irqaction *action)
 
 	do {
 		ret = action->handler(irq, action->dev_id);
+		/************************************
+			Added by Austin Herring
+		************************************/
+		if (ret == IRQ_WAKE_THREAD)
+		{
+			irq_wake_thread(irq, action);
+			//Without a primary handler of its own, the action hasn't
+			//claimed the interrupt yet; on a shared line it may not
+			//be its at all. The thread takes this back if it was.
+			if (test_bit(IRQTF_CLAIM_IN_THREAD, &action->thread_flags))
+				ret = IRQ_NONE;
+			else
+				ret = IRQ_HANDLED;
+		}
+		/*Finish additions******************/
 		if (ret == IRQ_HANDLED)
 			status |= action->flags;
 		retval |= ret;
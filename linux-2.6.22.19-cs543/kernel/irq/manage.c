@@ -11,6 +11,15 @@
 #include <linux/module.h>
 #include <linux/random.h>
 #include <linux/interrupt.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <linux/kthread.h>
+#include <linux/init.h>
+
+static int irq_stop_thread(struct irqaction *action);
+static void __enable_irq(struct irq_desc *desc, unsigned int irq);
+/*Finish additions******************/
 
 #include "internals.h"
 
@@ -152,6 +161,25 @@ void enable_irq(unsigned int irq)
 		return;
 
 	spin_lock_irqsave(&desc->lock, flags);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	__enable_irq(desc, irq);
+	/*Finish additions******************/
+	spin_unlock_irqrestore(&desc->lock, flags);
+}
+EXPORT_SYMBOL(enable_irq);
+
+/************************************
+	Added by Austin Herring
+************************************/
+/*
+ * enable_irq() with desc->lock already held, for free_irq(), which has to
+ * decide whether to undo a disable in the same critical section that decides
+ * whether to shut the line down.
+ */
+static void __enable_irq(struct irq_desc *desc, unsigned int irq)
+{
 	switch (desc->depth) {
 	case 0:
 		printk(KERN_WARNING "Unbalanced enable for IRQ %d\n", irq);
@@ -168,9 +196,8 @@ void enable_irq(unsigned int irq)
 	default:
 		desc->depth--;
 	}
-	spin_unlock_irqrestore(&desc->lock, flags);
 }
-EXPORT_SYMBOL(enable_irq);
+/*Finish additions******************/
 
 /**
  *	set_irq_wake - control irq power management wakeup
@@ -433,6 +460,34 @@ void free_irq(unsigned int irq, void *dev_id)
 				desc->chip->release(irq, dev_id);
 #endif
 
+			/************************************
+				Added by Austin Herring
+			************************************/
+			/*
+			 * The thread has to be gone before the line can be
+			 * shut down, or finishing a oneshot run would enable
+			 * it again. A oneshot wakeup it never got to still
+			 * holds a disable on the line: other actions on it
+			 * need that undone, but a line about to be shut down
+			 * doesn't, since setup_irq() starts it over anyway.
+			 *
+			 * Its proc files go first: they point at the action
+			 * and the thread, and the thread is about to go.
+			 */
+			if (action->thread) {
+				int oneshot_pending;
+
+				spin_unlock_irqrestore(&desc->lock, flags);
+				unregister_handler_proc(irq, action);
+				synchronize_irq(irq);
+				oneshot_pending = irq_stop_thread(action);
+				spin_lock_irqsave(&desc->lock, flags);
+
+				if (oneshot_pending && desc->action)
+					__enable_irq(desc, irq);
+			}
+			/*Finish additions******************/
+
 			if (!desc->action) {
 				desc->status |= IRQ_DISABLED;
 				if (desc->chip->shutdown)
@@ -499,9 +554,224 @@ EXPORT_SYMBOL(free_irq);
  */
 int request_irq(unsigned int irq, irq_handler_t handler,
 		unsigned long irqflags, const char *devname, void *dev_id)
+{
+	/************************************
+		Added by Austin Herring
+	************************************/
+	return request_threaded_irq(irq, handler, NULL, irqflags, devname, dev_id);
+}
+EXPORT_SYMBOL(request_irq);
+
+/*
+ * The primary handler used when a threaded irq is requested without one:
+ * there's nothing to quiet the device with, so the line has to stay
+ * disabled (IRQF_ONESHOT) until the thread has run. Nothing has looked at
+ * the device either, so whether the interrupt was its own is only known
+ * once the thread handler has run (IRQTF_CLAIM_IN_THREAD).
+ */
+static irqreturn_t irq_default_primary_handler(int irq, void *dev_id)
+{
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Irqs listed on the command line with threadirqs=<irq>[,<irq>...] have
+ * their plain request_irq handlers moved into a thread, so that a noisy
+ * device can be pushed below latency sensitive tasks without touching its
+ * driver.
+ */
+#define MAX_FORCED_THREAD_IRQS 16
+static int forced_thread_irqs[MAX_FORCED_THREAD_IRQS + 1];
+
+static int __init threadirqs_setup(char *str)
+{
+	get_options(str, ARRAY_SIZE(forced_thread_irqs), forced_thread_irqs);
+	return 1;
+}
+__setup("threadirqs=", threadirqs_setup);
+
+static int irq_forced_thread(unsigned int irq)
+{
+	int i;
+	for (i = 1; i <= forced_thread_irqs[0]; i++)
+	{
+		if (forced_thread_irqs[i] == irq)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int irq_wait_for_interrupt(struct irqaction *action)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop())
+	{
+		if (test_and_clear_bit(IRQTF_RUNTHREAD, &action->thread_flags))
+		{
+			__set_current_state(TASK_RUNNING);
+			return 0;
+		}
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return -1;
+}
+
+/*
+ * handle_IRQ_event counted the interrupt that woke an IRQTF_CLAIM_IN_THREAD
+ * thread as unhandled; now that the thread handler has claimed it, take that
+ * back. The line is still disabled (oneshot), so once the flow handler that
+ * did the counting has finished, nothing else touches the count meanwhile.
+ */
+static void irq_thread_claimed(unsigned int irq)
+{
+	struct irq_desc *desc = irq_desc + irq;
+
+	synchronize_irq(irq);
+	//The count starts over every 100000 interrupts, maybe in between
+	if (desc->irqs_unhandled > 0)
+	{
+		desc->irqs_unhandled--;
+	}
+}
+
+static int irq_thread(void *data)
+{
+	struct irqaction *action = data;
+	struct sched_param param = { .sched_priority = action->thread_prio };
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+	current->flags |= PF_NOFREEZE;
+
+	while (!irq_wait_for_interrupt(action))
+	{
+		irqreturn_t ret = action->thread_fn(action->irq, action->dev_id);
+
+		if (ret == IRQ_HANDLED &&
+		    test_bit(IRQTF_CLAIM_IN_THREAD, &action->thread_flags))
+		{
+			irq_thread_claimed(action->irq);
+		}
+
+		//Matches the disable_irq_nosync in irq_wake_thread
+		if (action->flags & IRQF_ONESHOT)
+		{
+			enable_irq(action->irq);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Stops the thread of an action that's no longer on its irq's list, and
+ * returns whether a oneshot wakeup it never got to was still holding a
+ * disable on the line. Undoing that is up to the caller, which knows whether
+ * the line is being shut down.
+ */
+static int irq_stop_thread(struct irqaction *action)
+{
+	if (action->thread == NULL)
+	{
+		return 0;
+	}
+
+	kthread_stop(action->thread);
+	action->thread = NULL;
+	return test_and_clear_bit(IRQTF_RUNTHREAD, &action->thread_flags) &&
+		(action->flags & IRQF_ONESHOT);
+}
+
+/**
+ *	irq_set_thread_priority - change the SCHED_FIFO priority of an irq thread
+ *	@action: the threaded irqaction
+ *	@prio: the new real-time priority, 1 to MAX_USER_RT_PRIO - 1
+ */
+int irq_set_thread_priority(struct irqaction *action, int prio)
+{
+	struct sched_param param = { .sched_priority = prio };
+	//Read once: free_irq() clears it when it stops the thread
+	struct task_struct *thread = action->thread;
+	int retval;
+
+	if (thread == NULL)
+	{
+		return -EINVAL;
+	}
+	if (prio < 1 || prio >= MAX_USER_RT_PRIO)
+	{
+		return -EINVAL;
+	}
+
+	retval = sched_setscheduler(thread, SCHED_FIFO, &param);
+	if (!retval)
+	{
+		action->thread_prio = prio;
+	}
+
+	return retval;
+}
+
+/**
+ *	irq_set_thread_affinity - restrict the CPUs an irq thread may run on
+ *	@action: the threaded irqaction
+ *	@mask: the CPUs the thread may run on
+ */
+int irq_set_thread_affinity(struct irqaction *action, cpumask_t mask)
+{
+	struct task_struct *thread = action->thread;
+
+	if (thread == NULL)
+	{
+		return -EINVAL;
+	}
+
+	return set_cpus_allowed(thread, mask);
+}
+
+/**
+ *	request_threaded_irq - allocate an interrupt line with a handler thread
+ *	@irq: Interrupt line to allocate
+ *	@handler: Primary handler, called in hard interrupt context. It should
+ *		only check and quiet the device, and return IRQ_WAKE_THREAD to
+ *		have @thread_fn run. If NULL, the line is left disabled until
+ *		@thread_fn has run (IRQF_ONESHOT).
+ *	@thread_fn: Handler run in a dedicated SCHED_FIFO kernel thread, or NULL
+ *		for a plain request_irq
+ *	@irqflags: Interrupt type flags
+ *	@devname: An ascii name for the claiming device
+ *	@dev_id: A cookie passed back to the handler functions
+ *
+ *	The thread is named irq/<irq>-<devname>, starts at priority
+ *	IRQ_THREAD_DEFAULT_PRIO with the affinity of the irq, and both can be
+ *	changed through /proc/irq/<irq>/<devname>/.
+ */
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+		irq_handler_t thread_fn, unsigned long irqflags,
+		const char *devname, void *dev_id)
 {
 	struct irqaction *action;
 	int retval;
+	int claim_in_thread = 0;
+
+	if (!thread_fn && handler && irq_forced_thread(irq) &&
+	    !(irqflags & (IRQF_TIMER | IRQF_PERCPU)))
+	{
+		thread_fn = handler;
+		handler = NULL;
+	}
+	if (!handler && thread_fn)
+	{
+		handler = irq_default_primary_handler;
+		irqflags |= IRQF_ONESHOT;
+		claim_in_thread = 1;
+	}
+	/*Finish additions******************/
 
 #ifdef CONFIG_LOCKDEP
 	/*
@@ -534,6 +804,27 @@ int request_irq(unsigned int irq, irq_handler_t handler,
 	action->name = devname;
 	action->next = NULL;
 	action->dev_id = dev_id;
+	/************************************
+		Added by Austin Herring
+	************************************/
+	action->thread_fn = thread_fn;
+	action->thread = NULL;
+	action->thread_flags = claim_in_thread ? 1UL << IRQTF_CLAIM_IN_THREAD : 0;
+	action->thread_prio = IRQ_THREAD_DEFAULT_PRIO;
+	action->irq = irq;
+
+	if (thread_fn)
+	{
+		action->thread = kthread_create(irq_thread, action, "irq/%d-%s",
+			irq, devname);
+		if (IS_ERR(action->thread))
+		{
+			retval = PTR_ERR(action->thread);
+			kfree(action);
+			return retval;
+		}
+	}
+	/*Finish additions******************/
 
 	select_smp_affinity(irq);
 
@@ -557,9 +848,23 @@ int request_irq(unsigned int irq, irq_handler_t handler,
 #endif
 
 	retval = setup_irq(irq, action);
+	/************************************
+		Added by Austin Herring
+	************************************/
 	if (retval)
+	{
+		irq_stop_thread(action);
 		kfree(action);
+	}
+	else if (action->thread)
+	{
+#ifdef CONFIG_SMP
+		set_cpus_allowed(action->thread, irq_desc[irq].affinity);
+#endif
+		wake_up_process(action->thread);
+	}
 
 	return retval;
 }
-EXPORT_SYMBOL(request_irq);
+EXPORT_SYMBOL(request_threaded_irq);
+/*Finish additions******************/
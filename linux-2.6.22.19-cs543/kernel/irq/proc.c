@@ -9,6 +9,11 @@
 #include <linux/irq.h>
 #include <linux/proc_fs.h>
 #include <linux/interrupt.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <asm/uaccess.h>
+/*Finish additions******************/
 
 #include "internals.h"
 
@@ -67,6 +72,109 @@ static int irq_affinity_write_proc(struct file *file, const char __user *buffer,
 
 #endif
 
+/************************************
+	Added by Austin Herring
+************************************/
+static int irq_thread_priority_read_proc(char *page, char **start, off_t off,
+					 int count, int *eof, void *data)
+{
+	struct irqaction *action = data;
+	return sprintf(page, "%d\n", action->thread_prio);
+}
+
+static int irq_thread_priority_write_proc(struct file *file,
+					  const char __user *buffer,
+					  unsigned long count, void *data)
+{
+	struct irqaction *action = data;
+	char buf[16];
+	int prio, err;
+
+	if (count >= sizeof(buf))
+	{
+		return -EINVAL;
+	}
+	if (copy_from_user(buf, buffer, count))
+	{
+		return -EFAULT;
+	}
+	buf[count] = '\0';
+
+	prio = simple_strtol(buf, NULL, 10);
+	err = irq_set_thread_priority(action, prio);
+
+	return err ? err : count;
+}
+
+static int irq_thread_affinity_read_proc(char *page, char **start, off_t off,
+					 int count, int *eof, void *data)
+{
+	struct irqaction *action = data;
+	struct task_struct *thread = action->thread;
+	int len;
+
+	//free_irq() removes this file before stopping the thread, but a read
+	//that already got here can still see it gone
+	if (thread == NULL)
+	{
+		return -ENODEV;
+	}
+
+	len = cpumask_scnprintf(page, count, thread->cpus_allowed);
+	if (count - len < 2)
+	{
+		return -EINVAL;
+	}
+	len += sprintf(page + len, "\n");
+	return len;
+}
+
+static int irq_thread_affinity_write_proc(struct file *file,
+					  const char __user *buffer,
+					  unsigned long count, void *data)
+{
+	struct irqaction *action = data;
+	cpumask_t new_value;
+	int err;
+
+	err = cpumask_parse_user(buffer, count, new_value);
+	if (err)
+	{
+		return err;
+	}
+
+	err = irq_set_thread_affinity(action, new_value);
+
+	return err ? err : count;
+}
+
+/*
+ * Threaded handlers get proc/irq/<irq>/<name>/thread_priority and
+ * thread_affinity, so the irq thread can be placed relative to the
+ * latency sensitive tasks on the machine.
+ */
+static void register_thread_proc(struct irqaction *action)
+{
+	struct proc_dir_entry *entry;
+
+	entry = create_proc_entry("thread_priority", 0600, action->dir);
+	if (entry)
+	{
+		entry->data = action;
+		entry->read_proc = irq_thread_priority_read_proc;
+		entry->write_proc = irq_thread_priority_write_proc;
+	}
+
+	entry = create_proc_entry("thread_affinity", 0600, action->dir);
+	if (entry)
+	{
+		entry->data = action;
+		entry->read_proc = irq_thread_affinity_read_proc;
+		entry->write_proc = irq_thread_affinity_write_proc;
+	}
+}
+/*Finish additions******************/
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -101,6 +209,14 @@ void register_handler_proc(unsigned int irq, struct irqaction *action)
 
 	/* create /proc/irq/1234/handler/ */
 	action->dir = proc_mkdir(name, irq_desc[irq].dir);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	if (action->dir && action->thread)
+	{
+		register_thread_proc(action);
+	}
+	/*Finish additions******************/
 }
 
 #undef MAX_NAMELEN
@@ -142,8 +258,25 @@ void register_irq_proc(unsigned int irq)
 
 void unregister_handler_proc(unsigned int irq, struct irqaction *action)
 {
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//The thread files exist for as long as thread_fn is set; the thread
+	//itself may already be stopped
+	if (action->dir && action->thread_fn)
+	{
+		remove_proc_entry("thread_affinity", action->dir);
+		remove_proc_entry("thread_priority", action->dir);
+	}
+	/*Finish additions******************/
 	if (action->dir)
 		remove_proc_entry(action->dir->name, irq_desc[irq].dir);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	//free_irq() unregisters a threaded action early, then again as usual
+	action->dir = NULL;
+	/*Finish additions******************/
 }
 
 void init_irq_proc(void)
@@ -0,0 +1,164 @@
+/************************************
+	Added by Austin Herring
+************************************/
+#include <linux/err.h>
+#include <linux/errno.h>
+#include <linux/linkage.h>
+#include <linux/multicall.h>
+#include <linux/sched.h>
+#include <linux/syscalls.h>
+#include <asm/uaccess.h>
+#include <asm/unistd.h>
+
+//Runs a batch of system calls with one trip through the entry code. Every
+//entry goes straight through sys_call_table, so syscall tracing and auditing
+//would only ever see the multicall itself. A task they're watching can't
+//use it, so nothing it does gets past them.
+
+//Both tables are laid out as one pointer per entry
+extern const unsigned long sys_call_table[];
+
+#ifdef CONFIG_X86_64
+#include <asm/asm-offsets.h>
+#define MULTICALL_NR_SYSCALLS (__NR_syscall_max + 1)
+#else
+#define MULTICALL_NR_SYSCALLS NR_syscalls
+#endif
+
+//A task with any of these set has each system call stopped at or recorded on
+//the way in, which the entries would skip
+#ifdef TIF_SYSCALL_EMU
+#define MULTICALL_WATCHED (_TIF_SYSCALL_TRACE | _TIF_SYSCALL_AUDIT | _TIF_SYSCALL_EMU)
+#else
+#define MULTICALL_WATCHED (_TIF_SYSCALL_TRACE | _TIF_SYSCALL_AUDIT)
+#endif
+
+typedef asmlinkage long (*multicall_fn)(long, long, long, long, long, long);
+
+//System calls that can't be called as plain functions from here: the ones
+//that look at or rewrite the saved user registers (and so expect to be
+//called straight from the entry code), plus the ones whose return path only
+//works when they are the system call being returned from
+static int multicall_denied(long nr)
+{
+	if (sys_call_table[nr] == (unsigned long)sys_multicall)
+	{
+		return 1;
+	}
+
+	switch (nr)
+	{
+	case __NR_restart_syscall:
+	case __NR_fork:
+	case __NR_vfork:
+	case __NR_clone:
+	case __NR_execve:
+	case __NR_iopl:
+	case __NR_rt_sigreturn:
+	case __NR_rt_sigsuspend:
+	case __NR_sigaltstack:
+#ifdef __NR_sigreturn
+	case __NR_sigreturn:
+#endif
+#ifdef __NR_sigsuspend
+	case __NR_sigsuspend:
+#endif
+#ifdef __NR_vm86old
+	case __NR_vm86old:
+#endif
+#ifdef __NR_vm86
+	case __NR_vm86:
+#endif
+		return 1;
+	}
+
+	return 0;
+}
+
+static long multicall_one(long nr, long *args)
+{
+	long result;
+
+	if (nr < 0 || nr >= MULTICALL_NR_SYSCALLS || multicall_denied(nr))
+	{
+		return -ENOSYS;
+	}
+
+	result = ((multicall_fn)sys_call_table[nr])(args[0], args[1], args[2],
+		args[3], args[4], args[5]);
+
+	//A restart would rerun the whole batch, including the entries that
+	//already finished, so the entry just fails instead
+	if (result == -ERESTARTSYS || result == -ERESTARTNOINTR ||
+		result == -ERESTARTNOHAND || result == -ERESTART_RESTARTBLOCK)
+	{
+		result = -EINTR;
+	}
+
+	return result;
+}
+
+//Returns the number of entries that were run, which is less than nr when
+//MULTICALL_STOP_ON_ERROR stopped the batch or a signal came in between two
+//entries. A failing entry is counted, so entries[return - 1] holds its error.
+//Under ptrace or audit it fails with ENOSYS, so callers fall back to making
+//the calls one at a time.
+asmlinkage long sys_multicall(struct multicall_entry __user *entries, unsigned int nr, unsigned int flags)
+{
+	unsigned int i;
+
+	if (current_thread_info()->flags & MULTICALL_WATCHED)
+	{
+		return -ENOSYS;
+	}
+
+	if (flags & ~MULTICALL_STOP_ON_ERROR)
+	{
+		return -EINVAL;
+	}
+
+	if (nr > MULTICALL_MAX_ENTRIES)
+	{
+		return -EINVAL;
+	}
+
+	if (!access_ok(VERIFY_WRITE, entries, nr * sizeof(*entries)))
+	{
+		return -EFAULT;
+	}
+
+	for (i = 0; i < nr; i++)
+	{
+		long call_nr;
+		long args[6];
+		long result;
+
+		if (i > 0 && signal_pending(current))
+		{
+			break;
+		}
+
+		if (__get_user(call_nr, &entries[i].nr) ||
+			__copy_from_user(args, entries[i].args, sizeof(args)))
+		{
+			return i > 0 ? i : -EFAULT;
+		}
+
+		result = multicall_one(call_nr, args);
+
+		if (__put_user(result, &entries[i].result))
+		{
+			return i > 0 ? i : -EFAULT;
+		}
+
+		if ((flags & MULTICALL_STOP_ON_ERROR) && IS_ERR_VALUE(result))
+		{
+			return i + 1;
+		}
+
+		cond_resched();
+	}
+
+	return i;
+}
+/*Finish additions******************/
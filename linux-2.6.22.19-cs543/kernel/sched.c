@@ -53,6 +53,11 @@
 #include <linux/kprobes.h>
 #include <linux/delayacct.h>
 #include <linux/reciprocal_div.h>
+/************************************
+	Added by Austin Herring
+************************************/
+#include <linux/schedtrace.h>
+/*Finish additions******************/
 
 #include <asm/tlb.h>
 #include <asm/unistd.h>
@@ -1441,6 +1446,109 @@ static int sched_balance_self(int cpu, int flag)
 	return cpu;
 }
 
+/************************************
+	Added by Austin Herring
+************************************/
+/*
+ * The CPU each CPU last spread a task to. A burst of forks places every child
+ * before any of them is on a runqueue, so each would see the same CPU as the
+ * idlest; scanning from just past the last choice deals them out in turn.
+ */
+static DEFINE_PER_CPU(int, spread_rotor);
+
+/*
+ * find_spread_cpu - pick a CPU for a task being placed by PLACEMENT_SPREAD or
+ * PLACEMENT_NODE. An idle CPU wins outright (cpu itself first, so a spread
+ * task still stays put if its own CPU is idle); otherwise the CPU with the
+ * least weighted load does. Other CPUs are looked at starting after the one
+ * this CPU picked last time, so ties go round rather than to the lowest.
+ * Returns -1 if p may not run on any CPU in mask.
+ *
+ * preempt must be disabled.
+ */
+static int find_spread_cpu(struct task_struct *p, int cpu, cpumask_t mask)
+{
+	unsigned long load, min_load = ULONG_MAX;
+	int *rotor = &__get_cpu_var(spread_rotor);
+	int i, n, best = -1;
+	cpumask_t allowed;
+
+	cpus_and(allowed, mask, p->cpus_allowed);
+	cpus_and(allowed, allowed, cpu_online_map);
+
+	if (cpu_isset(cpu, allowed) && !cpu_rq(cpu)->nr_running)
+	{
+		return cpu;
+	}
+
+	i = next_cpu(*rotor, allowed);
+	for (n = cpus_weight(allowed); n > 0; n--)
+	{
+		if (i >= NR_CPUS)
+		{
+			i = first_cpu(allowed);
+		}
+
+		if (!cpu_rq(i)->nr_running)
+		{
+			best = i;
+			break;
+		}
+
+		load = weighted_cpuload(i);
+		if (load < min_load)
+		{
+			min_load = load;
+			best = i;
+		}
+		i = next_cpu(i, allowed);
+	}
+
+	if (best >= 0)
+	{
+		*rotor = best;
+	}
+	return best;
+}
+
+/*
+ * sched_place_self - where current (or its new child) should run, according
+ * to one of current's placement policies. flag is the sched domain flag
+ * (SD_BALANCE_FORK or SD_BALANCE_EXEC) used for PLACEMENT_DEFAULT.
+ *
+ * preempt must be disabled.
+ */
+static int sched_place_self(int cpu, int placement, int flag)
+{
+	struct task_struct *t = current;
+	int new_cpu = -1;
+
+	switch (placement)
+	{
+	case PLACEMENT_LOCAL:
+		if (cpu_isset(cpu, t->cpus_allowed))
+		{
+			return cpu;
+		}
+		break;
+	case PLACEMENT_SPREAD:
+		new_cpu = find_spread_cpu(t, cpu, cpu_online_map);
+		break;
+	case PLACEMENT_NODE:
+		new_cpu = find_spread_cpu(t, cpu, node_to_cpumask(t->placement_node));
+		break;
+	}
+
+	//Also the fallback when the policy couldn't find anywhere to go
+	if (new_cpu < 0)
+	{
+		new_cpu = sched_balance_self(cpu, flag);
+	}
+
+	return new_cpu;
+}
+/*Finish additions******************/
+
 #endif /* CONFIG_SMP */
 
 /*
@@ -1642,6 +1750,11 @@ out_activate:
 
 
 	activate_task(p, rq, cpu == this_cpu);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	sched_trace_wakeup(p);
+	/*Finish additions******************/
 	/*
 	 * Sync wakeups (i.e. those types of wakeups where the waker
 	 * has indicated that it will leave the CPU in short order)
@@ -1686,7 +1799,11 @@ void fastcall sched_fork(struct task_struct *p, int clone_flags)
 	int cpu = get_cpu();
 
 #ifdef CONFIG_SMP
-	cpu = sched_balance_self(cpu, SD_BALANCE_FORK);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	cpu = sched_place_self(cpu, current->fork_placement, SD_BALANCE_FORK);
+	/*Finish additions******************/
 #endif
 	set_task_cpu(p, cpu);
 
@@ -2174,7 +2291,11 @@ out:
 void sched_exec(void)
 {
 	int new_cpu, this_cpu = get_cpu();
-	new_cpu = sched_balance_self(this_cpu, SD_BALANCE_EXEC);
+	/************************************
+		Added by Austin Herring
+	************************************/
+	new_cpu = sched_place_self(this_cpu, current->exec_placement, SD_BALANCE_EXEC);
+	/*Finish additions******************/
 	put_cpu();
 	if (new_cpu != this_cpu)
 		sched_migrate_task(current, new_cpu);
@@ -3702,6 +3823,11 @@ switch_tasks:
 		rq->nr_switches++;
 		rq->curr = next;
 		++*switch_count;
+		/************************************
+			Added by Austin Herring
+		************************************/
+		sched_trace_switch(prev, next);
+		/*Finish additions******************/
 
 		prepare_task_switch(rq, next);
 		prev = context_switch(rq, prev, next);
@@ -4233,6 +4359,74 @@ int can_nice(const struct task_struct *p, const int nice)
 		capable(CAP_SYS_NICE));
 }
 
+/************************************
+	Added by Austin Herring
+************************************/
+static int valid_placement(int placement)
+{
+	return placement >= PLACEMENT_DEFAULT && placement <= PLACEMENT_NODE;
+}
+
+/**
+ * sys_setplacement - set where a process's children and execs are placed
+ * @pid: the process, or 0 for current
+ * @fork_placement: PLACEMENT_* used by sched_fork for its new children
+ * @exec_placement: PLACEMENT_* used by sched_exec when it execs
+ * @node: the node used by PLACEMENT_NODE
+ *
+ * A negative value for any of the arguments leaves that setting alone. The
+ * settings are inherited by children, so setting them on a build's top
+ * level make covers the whole build.
+ */
+asmlinkage long sys_setplacement(pid_t pid, int fork_placement, int exec_placement, int node)
+{
+	struct task_struct *p;
+	int retval = 0;
+
+	if ((fork_placement >= 0 && !valid_placement(fork_placement)) ||
+	    (exec_placement >= 0 && !valid_placement(exec_placement)))
+	{
+		return -EINVAL;
+	}
+	if (node >= 0 && (node >= MAX_NUMNODES || !node_online(node)))
+	{
+		return -EINVAL;
+	}
+
+	read_lock(&tasklist_lock);
+	p = pid ? find_task_by_pid(pid) : current;
+	if (p == NULL)
+	{
+		retval = -ESRCH;
+		goto out_unlock;
+	}
+
+	if (current->euid != p->euid && current->euid != p->uid &&
+	    !capable(CAP_SYS_NICE))
+	{
+		retval = -EPERM;
+		goto out_unlock;
+	}
+
+	if (fork_placement >= 0)
+	{
+		p->fork_placement = fork_placement;
+	}
+	if (exec_placement >= 0)
+	{
+		p->exec_placement = exec_placement;
+	}
+	if (node >= 0)
+	{
+		p->placement_node = node;
+	}
+
+out_unlock:
+	read_unlock(&tasklist_lock);
+	return retval;
+}
+/*Finish additions******************/
+
 #ifdef __ARCH_WANT_SYS_NICE
 
 /*
@@ -0,0 +1,139 @@
+/************************************
+	Added by Austin Herring
+************************************/
+#include <linux/schedtrace.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/relay.h>
+#include <linux/sched.h>
+
+#define SCHED_TRACE_SUBBUF_SIZE 65536
+#define SCHED_TRACE_NUMBER_SUBBUFS 8
+
+static struct rchan *sched_trace_chan;
+static struct dentry *sched_trace_dir;
+static struct dentry *sched_trace_enabled_file;
+static struct dentry *sched_trace_dropped_file;
+
+//Tracing is off until something writes 1 to schedtrace/enabled, so that
+//having the option compiled in costs one branch per event
+static u32 sched_trace_enabled;
+
+//Number of times a sub-buffer switch found the buffer full. Only touched from
+//subbuf_start with interrupts off, so it can be off by a little when two CPUs
+//fill up at the same time, which is fine for telling whether a run is usable
+static u32 sched_trace_dropped;
+
+static int sched_trace_subbuf_start(struct rchan_buf *buf, void *subbuf,
+	void *prev_subbuf, size_t prev_padding)
+{
+	//Don't overwrite anything the reader hasn't gotten to yet; a benchmark
+	//run with holes in it is more honest than one with the start missing
+	if (relay_buf_full(buf))
+	{
+		sched_trace_dropped++;
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct dentry *sched_trace_create_buf_file(const char *filename,
+	struct dentry *parent, int mode, struct rchan_buf *buf, int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+		&relay_file_operations);
+}
+
+static int sched_trace_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static struct rchan_callbacks sched_trace_callbacks =
+{
+	.subbuf_start = sched_trace_subbuf_start,
+	.create_buf_file = sched_trace_create_buf_file,
+	.remove_buf_file = sched_trace_remove_buf_file,
+};
+
+//Both of the hooks below are called from the scheduler with the runqueue lock
+//held and interrupts off, so relay_reserve can be used on this CPU's buffer
+//without any more protection
+static struct sched_trace_entry *sched_trace_reserve(void)
+{
+	if (likely(!sched_trace_enabled) || sched_trace_chan == NULL)
+	{
+		return NULL;
+	}
+
+	return relay_reserve(sched_trace_chan, sizeof(struct sched_trace_entry));
+}
+
+void sched_trace_switch(struct task_struct *prev, struct task_struct *next)
+{
+	struct sched_trace_entry *entry = sched_trace_reserve();
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	entry->timestamp = sched_clock();
+	entry->type = SCHED_TRACE_SWITCH;
+	entry->cpu = smp_processor_id();
+	entry->prev_pid = prev->pid;
+	entry->next_pid = next->pid;
+	entry->prev_prio = prev->prio;
+	entry->next_prio = next->prio;
+	entry->prev_state = prev->state;
+}
+
+void sched_trace_wakeup(struct task_struct *p)
+{
+	struct sched_trace_entry *entry = sched_trace_reserve();
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	entry->timestamp = sched_clock();
+	entry->type = SCHED_TRACE_WAKEUP;
+	entry->cpu = smp_processor_id();
+	entry->prev_pid = current->pid;
+	entry->next_pid = p->pid;
+	entry->prev_prio = current->prio;
+	entry->next_prio = p->prio;
+	entry->prev_state = 0;
+}
+
+static int __init sched_trace_init(void)
+{
+	sched_trace_dir = debugfs_create_dir("schedtrace", NULL);
+	if (sched_trace_dir == NULL)
+	{
+		printk(KERN_ERR "schedtrace: could not create debugfs directory\n");
+		return -ENOMEM;
+	}
+
+	sched_trace_enabled_file = debugfs_create_bool("enabled", 0644,
+		sched_trace_dir, &sched_trace_enabled);
+	sched_trace_dropped_file = debugfs_create_u32("dropped", 0444,
+		sched_trace_dir, &sched_trace_dropped);
+
+	sched_trace_chan = relay_open("cpu", sched_trace_dir,
+		SCHED_TRACE_SUBBUF_SIZE, SCHED_TRACE_NUMBER_SUBBUFS,
+		&sched_trace_callbacks, NULL);
+	if (sched_trace_chan == NULL)
+	{
+		printk(KERN_ERR "schedtrace: could not open relay channel\n");
+		debugfs_remove(sched_trace_dropped_file);
+		debugfs_remove(sched_trace_enabled_file);
+		debugfs_remove(sched_trace_dir);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+__initcall(sched_trace_init);
+/*Finish additions******************/
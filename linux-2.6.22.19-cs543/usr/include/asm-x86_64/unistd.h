@@ -652,6 +652,10 @@ __SYSCALL(__NR_forcewrite, sys_forcewrite)
 __SYSCALL(__NR_mysend, sys_mysend)
 #define __NR_myreceive      293
 __SYSCALL(__NR_myreceive, sys_myreceive)
+#define __NR_setplacement   294
+__SYSCALL(__NR_setplacement, sys_setplacement)
+#define __NR_multicall      295
+__SYSCALL(__NR_multicall, sys_multicall)
 /*Finish additions*******************/
 
 
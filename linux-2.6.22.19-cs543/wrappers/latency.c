@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//cyclictest-style wakeup latency: sleep until an absolute deadline over and
+//over, and measure how late we actually got to run each time. Run it with a
+//priority (needs root) to measure the latency a real-time task sees, or with
+//priority 0 to see what a normal task sees under the same load.
+#define NSEC_PER_SEC 1000000000L
+#define HISTOGRAM_BUCKETS 1000
+
+static void timespec_add_ns(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= NSEC_PER_SEC)
+	{
+		ts->tv_nsec -= NSEC_PER_SEC;
+		ts->tv_sec++;
+	}
+}
+
+static long timespec_diff_ns(struct timespec *later, struct timespec *earlier)
+{
+	return (later->tv_sec - earlier->tv_sec) * NSEC_PER_SEC +
+		(later->tv_nsec - earlier->tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+	long interval_us = argc > 1 ? atol(argv[1]) : 1000;
+	long loops = argc > 2 ? atol(argv[2]) : 10000;
+	int priority = argc > 3 ? atoi(argv[3]) : 0;
+	if (interval_us <= 0 || loops <= 0 || priority < 0)
+	{
+		printf("Usage: %s [interval_us] [loops] [rt_priority]\n", argv[0]);
+		return 1;
+	}
+
+	if (priority > 0)
+	{
+		struct sched_param param;
+		param.sched_priority = priority;
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+		{
+			perror("Could not set SCHED_FIFO");
+			return 2;
+		}
+	}
+
+	//One bucket per microsecond; anything later than that lands in the last one
+	static unsigned long histogram[HISTOGRAM_BUCKETS];
+	long min = -1, max = 0;
+	double total = 0;
+
+	struct timespec next, now;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	long i;
+	for (i = 0; i < loops; i++)
+	{
+		timespec_add_ns(&next, interval_us * 1000);
+		int ret;
+		while ((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)) == EINTR)
+		{
+		}
+		if (ret != 0)
+		{
+			errno = ret;
+			perror("Failure in clock_nanosleep");
+			return 2;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		long late = timespec_diff_ns(&now, &next);
+		if (min < 0 || late < min)
+		{
+			min = late;
+		}
+		if (late > max)
+		{
+			max = late;
+		}
+		total += late;
+
+		long bucket = late / 1000;
+		histogram[bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1]++;
+	}
+
+	printf("%ld wakeups every %ld us, priority %d\n", loops, interval_us, priority);
+	printf("Latency (us): min %.1f, avg %.1f, max %.1f\n",
+		min / 1000.0, total / loops / 1000.0, max / 1000.0);
+
+	printf("Histogram (us: count):\n");
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		if (histogram[i] != 0)
+		{
+			printf("%s%4ld: %lu\n", i == HISTOGRAM_BUCKETS - 1 ? ">=" : "  ", i, histogram[i]);
+		}
+	}
+
+	return 0;
+}
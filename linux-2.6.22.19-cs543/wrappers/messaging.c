@@ -0,0 +1,160 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//hackbench-style fan-out: every group has FDS_PER_GROUP senders and as many
+//receivers, and every sender writes loops messages to every receiver in its
+//group. All of the processes are blocked on socket reads/writes most of the
+//time, so the run time is dominated by wakeups and context switches.
+#define FDS_PER_GROUP 20
+#define MESSAGE_SIZE 100
+
+static void sender(int *out_fds, int loops)
+{
+	char message[MESSAGE_SIZE];
+	memset(message, 0, sizeof message);
+
+	int i, j;
+	for (i = 0; i < loops; i++)
+	{
+		for (j = 0; j < FDS_PER_GROUP; j++)
+		{
+			size_t written = 0;
+			while (written < sizeof message)
+			{
+				ssize_t ret = write(out_fds[j], message + written, sizeof message - written);
+				if (ret < 0)
+				{
+					perror("Failure in sender write");
+					exit(2);
+				}
+				written += ret;
+			}
+		}
+	}
+}
+
+static void receiver(int in_fd, int loops)
+{
+	char message[MESSAGE_SIZE];
+	size_t remaining = (size_t) loops * FDS_PER_GROUP * sizeof message;
+	while (remaining > 0)
+	{
+		ssize_t ret = read(in_fd, message, sizeof message);
+		if (ret <= 0)
+		{
+			perror("Failure in receiver read");
+			exit(2);
+		}
+		remaining -= ret;
+	}
+}
+
+static int start_group(int loops)
+{
+	int out_fds[FDS_PER_GROUP];
+	int i;
+	for (i = 0; i < FDS_PER_GROUP; i++)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		{
+			perror("Could not create socket pair");
+			return -1;
+		}
+
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("Could not fork receiver");
+			return -1;
+		}
+		else if (pid == 0)
+		{
+			close(fds[1]);
+			receiver(fds[0], loops);
+			exit(0);
+		}
+
+		close(fds[0]);
+		out_fds[i] = fds[1];
+	}
+
+	for (i = 0; i < FDS_PER_GROUP; i++)
+	{
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("Could not fork sender");
+			return -1;
+		}
+		else if (pid == 0)
+		{
+			sender(out_fds, loops);
+			exit(0);
+		}
+	}
+
+	//The parent doesn't need its copies anymore; the senders have their own
+	for (i = 0; i < FDS_PER_GROUP; i++)
+	{
+		close(out_fds[i]);
+	}
+
+	return 2 * FDS_PER_GROUP;
+}
+
+int main(int argc, char *argv[])
+{
+	int groups = argc > 1 ? atoi(argv[1]) : 10;
+	int loops = argc > 2 ? atoi(argv[2]) : 100;
+	if (groups <= 0 || loops <= 0)
+	{
+		printf("Usage: %s [groups] [loops]\n", argv[0]);
+		return 1;
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	int children = 0;
+	int i;
+	for (i = 0; i < groups; i++)
+	{
+		int started = start_group(loops);
+		if (started < 0)
+		{
+			return 2;
+		}
+		children += started;
+	}
+
+	int failed = 0;
+	for (i = 0; i < children; i++)
+	{
+		int status;
+		if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			failed = 1;
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+	if (failed)
+	{
+		printf("Failure in messaging: a child did not finish cleanly\n");
+		return 2;
+	}
+
+	printf("%d groups, %d processes, %d loops: %.3f seconds\n",
+		groups, children, loops, elapsed);
+	return 0;
+}
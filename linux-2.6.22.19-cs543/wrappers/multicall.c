@@ -0,0 +1,92 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+//Runs the same run of cheap system calls (getppid, which nothing caches) one
+//at a time and then in batches through sys_multicall, and prints the cost of
+//each call both ways. With a batch size of 1 the difference is the overhead
+//multicall adds on top of a single trap.
+#define MAX_BATCH 1024
+#define MULTICALL_STOP_ON_ERROR 0x1
+
+//Must match struct multicall_entry in include/linux/multicall.h
+struct multicall_entry
+{
+	long nr;
+	long args[6];
+	long result;
+};
+
+static double elapsed_usec(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_usec - start->tv_usec);
+}
+
+int main(int argc, char *argv[])
+{
+	long calls = argc > 1 ? atol(argv[1]) : 1000000;
+	int batch = argc > 2 ? atoi(argv[2]) : 32;
+	if (calls <= 0 || batch <= 0 || batch > MAX_BATCH)
+	{
+		printf("Usage: %s [calls] [batch_size (1-%d)]\n", argv[0], MAX_BATCH);
+		return 1;
+	}
+
+	static struct multicall_entry entries[MAX_BATCH];
+	memset(entries, 0, sizeof entries);
+	int i;
+	for (i = 0; i < batch; i++)
+	{
+		entries[i].nr = SYS_getppid;
+	}
+
+	//One failing call in the middle to check stop-on-error
+	struct multicall_entry check[3];
+	memset(check, 0, sizeof check);
+	check[0].nr = SYS_getppid;
+	check[1].nr = SYS_close;
+	check[1].args[0] = -1;
+	check[2].nr = SYS_getppid;
+	long done = syscall(295, check, 3, MULTICALL_STOP_ON_ERROR);
+	if (done < 0)
+	{
+		perror("Failure in multicall");
+		return 2;
+	}
+	else if (done != 2 || check[0].result != getppid() || check[1].result != -EBADF)
+	{
+		printf("Stop on error: ran %ld entries, results %ld %ld\n", done, check[0].result, check[1].result);
+		return 2;
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	long j;
+	for (j = 0; j < calls; j++)
+	{
+		syscall(SYS_getppid);
+	}
+	gettimeofday(&end, NULL);
+	double single = elapsed_usec(&start, &end);
+
+	gettimeofday(&start, NULL);
+	for (j = 0; j < calls; j += batch)
+	{
+		int n = calls - j < batch ? calls - j : batch;
+		if (syscall(295, entries, n, 0) != n)
+		{
+			perror("Failure in multicall");
+			return 2;
+		}
+	}
+	gettimeofday(&end, NULL);
+	double batched = elapsed_usec(&start, &end);
+
+	printf("%ld calls: %.3f usec each one at a time, %.3f usec each in batches of %d\n",
+		calls, single / calls, batched / calls, batch);
+	return 0;
+}
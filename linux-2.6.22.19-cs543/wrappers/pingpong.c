@@ -0,0 +1,69 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//Two processes bounce one byte back and forth over a pair of pipes. Every
+//round trip is two wakeups and two context switches, so the time per round
+//trip is a direct measure of the switch path.
+int main(int argc, char *argv[])
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 100000;
+	if (iterations <= 0)
+	{
+		printf("Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	int ping[2], pong[2];
+	if (pipe(ping) < 0 || pipe(pong) < 0)
+	{
+		perror("Could not create pipes");
+		return 2;
+	}
+
+	char token = 0;
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		perror("Could not fork");
+		return 2;
+	}
+	else if (pid == 0)
+	{
+		long i;
+		for (i = 0; i < iterations; i++)
+		{
+			if (read(ping[0], &token, 1) != 1 || write(pong[1], &token, 1) != 1)
+			{
+				perror("Failure in child");
+				return 2;
+			}
+		}
+		return 0;
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	long i;
+	for (i = 0; i < iterations; i++)
+	{
+		if (write(ping[1], &token, 1) != 1 || read(pong[0], &token, 1) != 1)
+		{
+			perror("Failure in parent");
+			return 2;
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	waitpid(pid, NULL, 0);
+
+	double elapsed = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
+	printf("%ld round trips: %.3f seconds, %.3f usec per round trip, %.3f usec per switch\n",
+		iterations, elapsed / 1e6, elapsed / iterations, elapsed / iterations / 2);
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//Must match PLACEMENT_* in include/linux/sched.h
+static const char *placements[] =
+{
+	"default",
+	"local",
+	"spread",
+	"node",
+};
+
+static int parse_placement(const char *name)
+{
+	size_t i;
+	for (i = 0; i < sizeof(placements) / sizeof(*placements); i++)
+	{
+		if (strcmp(name, placements[i]) == 0)
+		{
+			return i;
+		}
+	}
+
+	//"-" (or anything else) leaves the setting alone
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 4)
+	{
+		printf("Please include the pid, the fork placement and the exec placement "
+			"(default, local, spread, node or -) and optionally the node as command line parameters.\n");
+		return 1;
+	}
+
+	pid_t pid = atol(argv[1]);
+	int fork_placement = parse_placement(argv[2]);
+	int exec_placement = parse_placement(argv[3]);
+	int node = argc > 4 ? atoi(argv[4]) : -1;
+
+	long success = syscall(294, pid, fork_placement, exec_placement, node);
+	if (success < 0)
+	{
+		perror("Failure in setplacement");
+		return 2;
+	}
+
+	printf("Success!\n");
+	return 0;
+}
@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+//Reader for the CONFIG_SCHED_TRACE relay buffers. Usage:
+//	schedtrace start  - turn recording on
+//	schedtrace stop   - turn recording off
+//	schedtrace report - drain the per-CPU buffers and summarize them
+//Typical use is start, run one of the benchmarks in this directory, stop,
+//report.
+#define DEFAULT_TRACE_DIR "/sys/kernel/debug/schedtrace"
+#define MAX_CPUS 256
+#define PENDING_BUCKETS 65536
+
+#define SCHED_TRACE_SWITCH 1
+#define SCHED_TRACE_WAKEUP 2
+
+//Must match struct sched_trace_entry in include/linux/schedtrace.h
+struct sched_trace_entry
+{
+	uint64_t timestamp;
+	uint32_t type;
+	uint32_t cpu;
+	int32_t prev_pid;
+	int32_t next_pid;
+	int32_t prev_prio;
+	int32_t next_prio;
+	int64_t prev_state;
+};
+
+struct pending_wakeup
+{
+	int32_t pid;
+	uint64_t timestamp;
+};
+
+struct cpu_stats
+{
+	unsigned long switches;
+	unsigned long involuntary;
+	unsigned long wakeups;
+};
+
+static int set_enabled(const char *dir, const char *value)
+{
+	char path[256];
+	snprintf(path, sizeof path, "%s/enabled", dir);
+
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+	{
+		perror("Could not open enabled file (is CONFIG_SCHED_TRACE on and debugfs mounted?)");
+		return 2;
+	}
+
+	if (write(fd, value, 1) != 1)
+	{
+		perror("Could not write enabled file");
+		close(fd);
+		return 2;
+	}
+
+	close(fd);
+	return 0;
+}
+
+//Append every record in one CPU's buffer to *entries, growing it as needed
+static int read_cpu_buffer(int fd, struct sched_trace_entry **entries, size_t *count, size_t *capacity)
+{
+	for (;;)
+	{
+		if (*count == *capacity)
+		{
+			size_t new_capacity = *capacity ? *capacity * 2 : 4096;
+			struct sched_trace_entry *tmp = realloc(*entries, new_capacity * sizeof *tmp);
+			if (tmp == NULL)
+			{
+				return 0;
+			}
+			*entries = tmp;
+			*capacity = new_capacity;
+		}
+
+		//Relay hands back whole records as long as we ask for whole records
+		ssize_t ret = read(fd, *entries + *count, (*capacity - *count) * sizeof **entries);
+		if (ret < 0)
+		{
+			return 0;
+		}
+		else if (ret == 0)
+		{
+			return 1;
+		}
+		*count += ret / sizeof **entries;
+	}
+}
+
+static int compare_timestamps(const void *a, const void *b)
+{
+	const struct sched_trace_entry *x = a, *y = b;
+	return x->timestamp < y->timestamp ? -1 : x->timestamp > y->timestamp;
+}
+
+static int report(const char *dir)
+{
+	struct sched_trace_entry *entries = NULL;
+	size_t count = 0, capacity = 0;
+
+	int cpus = 0;
+	for (cpus = 0; cpus < MAX_CPUS; cpus++)
+	{
+		char path[256];
+		snprintf(path, sizeof path, "%s/cpu%d", dir, cpus);
+		int fd = open(path, O_RDONLY | O_NONBLOCK);
+		if (fd < 0)
+		{
+			break;
+		}
+
+		int success = read_cpu_buffer(fd, &entries, &count, &capacity);
+		close(fd);
+		if (!success)
+		{
+			perror("Could not read trace buffer");
+			free(entries);
+			return 2;
+		}
+	}
+
+	if (cpus == 0)
+	{
+		printf("No trace buffers found in %s\n", dir);
+		return 2;
+	}
+
+	//Each CPU's buffer is already in order, but a wakeup on one CPU is
+	//usually followed by a switch on another, so merge them all
+	qsort(entries, count, sizeof *entries, compare_timestamps);
+
+	struct cpu_stats stats[MAX_CPUS];
+	memset(stats, 0, sizeof stats);
+	static struct pending_wakeup pending[PENDING_BUCKETS];
+
+	unsigned long latencies = 0;
+	uint64_t latency_total = 0, latency_max = 0;
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		struct sched_trace_entry *entry = entries + i;
+		struct cpu_stats *cpu = stats + (entry->cpu < MAX_CPUS ? entry->cpu : 0);
+		struct pending_wakeup *slot = pending + (entry->next_pid % PENDING_BUCKETS);
+
+		if (entry->type == SCHED_TRACE_WAKEUP)
+		{
+			cpu->wakeups++;
+			slot->pid = entry->next_pid;
+			slot->timestamp = entry->timestamp;
+		}
+		else if (entry->type == SCHED_TRACE_SWITCH)
+		{
+			cpu->switches++;
+			//A task that was still TASK_RUNNING when it was switched out was preempted
+			if (entry->prev_state == 0)
+			{
+				cpu->involuntary++;
+			}
+
+			if (slot->pid == entry->next_pid && slot->timestamp != 0)
+			{
+				uint64_t latency = entry->timestamp - slot->timestamp;
+				latencies++;
+				latency_total += latency;
+				if (latency > latency_max)
+				{
+					latency_max = latency;
+				}
+				slot->timestamp = 0;
+			}
+		}
+	}
+
+	printf("%zu events on %d CPU(s)", count, cpus);
+	if (count > 1)
+	{
+		printf(" over %.3f ms", (entries[count - 1].timestamp - entries[0].timestamp) / 1e6);
+	}
+	printf("\n\n");
+
+	int c;
+	for (c = 0; c < cpus; c++)
+	{
+		printf("CPU%d: %lu switches (%lu involuntary), %lu wakeups\n",
+			c, stats[c].switches, stats[c].involuntary, stats[c].wakeups);
+	}
+
+	if (latencies > 0)
+	{
+		printf("\nWakeup to run latency: avg %.1f us, max %.1f us over %lu wakeups\n",
+			latency_total / 1000.0 / latencies, latency_max / 1000.0, latencies);
+	}
+
+	free(entries);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("Please include start, stop, or report (and optionally the trace directory).\n");
+		return 1;
+	}
+
+	const char *dir = argc > 2 ? argv[2] : DEFAULT_TRACE_DIR;
+	if (strcmp(argv[1], "start") == 0)
+	{
+		return set_enabled(dir, "1");
+	}
+	else if (strcmp(argv[1], "stop") == 0)
+	{
+		return set_enabled(dir, "0");
+	}
+	else if (strcmp(argv[1], "report") == 0)
+	{
+		return report(dir);
+	}
+
+	printf("Unknown command %s\n", argv[1]);
+	return 1;
+}
@@ -0,0 +1,168 @@
+#include <elf.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+//Times getpid, gettimeofday and clock_gettime through the vDSO fast paths
+//(arch/i386/kernel/vsyscall-gtod.c) against the same calls made as real
+//system calls. The vDSO functions are looked up by hand in the image the
+//kernel maps in, so this doesn't depend on the C library knowing about them.
+typedef pid_t (*getpid_fn)(void);
+typedef int (*gettimeofday_fn)(struct timeval *, struct timezone *);
+typedef int (*clock_gettime_fn)(clockid_t, struct timespec *);
+
+static void *vdso_lookup(const char *name)
+{
+	ElfW(Ehdr) *ehdr = (ElfW(Ehdr) *) getauxval(AT_SYSINFO_EHDR);
+	if (ehdr == NULL)
+	{
+		return NULL;
+	}
+
+	//The image is prelinked to 0 (or to its compat address), so everything
+	//is relative to where the first PT_LOAD ended up
+	ElfW(Phdr) *phdr = (ElfW(Phdr) *) ((char *) ehdr + ehdr->e_phoff);
+	ElfW(Dyn) *dyn = NULL;
+	ElfW(Addr) load_offset = 0;
+	int i;
+	for (i = 0; i < ehdr->e_phnum; i++)
+	{
+		if (phdr[i].p_type == PT_LOAD)
+		{
+			load_offset = (ElfW(Addr)) ehdr + phdr[i].p_offset - phdr[i].p_vaddr;
+		}
+		else if (phdr[i].p_type == PT_DYNAMIC)
+		{
+			dyn = (ElfW(Dyn) *) ((char *) ehdr + phdr[i].p_offset);
+		}
+	}
+
+	if (dyn == NULL)
+	{
+		return NULL;
+	}
+
+	ElfW(Sym) *symtab = NULL;
+	const char *strtab = NULL;
+	ElfW(Word) *hash = NULL;
+	for (; dyn->d_tag != DT_NULL; dyn++)
+	{
+		if (dyn->d_tag == DT_SYMTAB)
+		{
+			symtab = (ElfW(Sym) *) (dyn->d_un.d_ptr + load_offset);
+		}
+		else if (dyn->d_tag == DT_STRTAB)
+		{
+			strtab = (const char *) (dyn->d_un.d_ptr + load_offset);
+		}
+		else if (dyn->d_tag == DT_HASH)
+		{
+			hash = (ElfW(Word) *) (dyn->d_un.d_ptr + load_offset);
+		}
+	}
+
+	if (symtab == NULL || strtab == NULL || hash == NULL)
+	{
+		return NULL;
+	}
+
+	//hash[1] is the number of symbols
+	ElfW(Word) j;
+	for (j = 0; j < hash[1]; j++)
+	{
+		if (symtab[j].st_shndx != SHN_UNDEF && strcmp(strtab + symtab[j].st_name, name) == 0)
+		{
+			return (void *) (symtab[j].st_value + load_offset);
+		}
+	}
+
+	return NULL;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+	if (iterations <= 0)
+	{
+		printf("Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	getpid_fn vdso_getpid = vdso_lookup("__vdso_getpid");
+	gettimeofday_fn vdso_gettimeofday = vdso_lookup("__vdso_gettimeofday");
+	clock_gettime_fn vdso_clock_gettime = vdso_lookup("__vdso_clock_gettime");
+	if (vdso_getpid == NULL || vdso_gettimeofday == NULL || vdso_clock_gettime == NULL)
+	{
+		printf("This kernel's vDSO doesn't have the fast paths.\n");
+		return 2;
+	}
+
+	if (vdso_getpid() != syscall(SYS_getpid))
+	{
+		printf("vDSO getpid returned %d, but the system call returned %ld\n",
+			vdso_getpid(), syscall(SYS_getpid));
+		return 2;
+	}
+
+	struct timeval tv;
+	struct timespec ts;
+	double start, syscall_ns, vdso_ns;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		syscall(SYS_getpid);
+	}
+	syscall_ns = (now_ns() - start) / iterations;
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		vdso_getpid();
+	}
+	vdso_ns = (now_ns() - start) / iterations;
+	printf("getpid:        %8.1f ns syscall, %8.1f ns vDSO\n", syscall_ns, vdso_ns);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		syscall(SYS_gettimeofday, &tv, NULL);
+	}
+	syscall_ns = (now_ns() - start) / iterations;
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		vdso_gettimeofday(&tv, NULL);
+	}
+	vdso_ns = (now_ns() - start) / iterations;
+	printf("gettimeofday:  %8.1f ns syscall, %8.1f ns vDSO\n", syscall_ns, vdso_ns);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+	}
+	syscall_ns = (now_ns() - start) / iterations;
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+	{
+		vdso_clock_gettime(CLOCK_MONOTONIC, &ts);
+	}
+	vdso_ns = (now_ns() - start) / iterations;
+	printf("clock_gettime: %8.1f ns syscall, %8.1f ns vDSO\n", syscall_ns, vdso_ns);
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//A number of processes that do nothing but call sched_yield. With more than
+//one of them per CPU, every yield should turn into a context switch, so this
+//measures the cost of a trip through schedule() and how fairly the yields
+//are spread between the processes.
+int main(int argc, char *argv[])
+{
+	int processes = argc > 1 ? atoi(argv[1]) : 4;
+	long yields = argc > 2 ? atol(argv[2]) : 1000000;
+	if (processes <= 0 || yields <= 0)
+	{
+		printf("Usage: %s [processes] [yields_per_process]\n", argv[0]);
+		return 1;
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	int i;
+	for (i = 0; i < processes; i++)
+	{
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("Could not fork");
+			return 2;
+		}
+		else if (pid == 0)
+		{
+			struct timeval child_start, child_end;
+			gettimeofday(&child_start, NULL);
+
+			long j;
+			for (j = 0; j < yields; j++)
+			{
+				sched_yield();
+			}
+
+			gettimeofday(&child_end, NULL);
+			double elapsed = (child_end.tv_sec - child_start.tv_sec) +
+				(child_end.tv_usec - child_start.tv_usec) / 1e6;
+			printf("Process %d: %ld yields in %.3f seconds\n", getpid(), yields, elapsed);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < processes; i++)
+	{
+		wait(NULL);
+	}
+
+	gettimeofday(&end, NULL);
+	double elapsed = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
+	printf("%d processes, %ld yields total: %.3f seconds, %.3f usec per yield\n",
+		processes, processes * yields, elapsed / 1e6, elapsed / (processes * yields));
+	return 0;
+}